@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------
+// @file  arena.h
+//------------------------------------------------------------------------------
+// @brief bump allocator with reset, and an STL allocator on top of it.
+//------------------------------------------------------------------------------
+// an allocation moves a pointer forward in the current block. nothing is
+// freed on its own: Reset() drops everything at once (keeping the current
+// block for the next round) and the destructor gives the blocks back.
+// destructors of the objects are not run, so they should own nothing but
+// arena memory. not thread safe: one arena per request / per thread.
+// @code
+// cu::Arena arena;
+// for (const auto& line : lines) {
+//   cu::ArenaAllocator<char> alloc(arena);
+//   auto fields = cu::strutil::split(line, "\t", false, alloc);
+//   Handle(fields);
+//   arena.Reset();  // the vector and its strings, in O(1)
+// }
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_ARENA_H_
+#define CPPUTIL_ARENA_H_
+#include <cstddef>      // for std::max_align_t
+#include <cstdint>      // for std::uintptr_t
+#include <limits>       // for std::numeric_limits
+#include <new>          // for operator new, std::bad_alloc
+#include <type_traits>  // for std::true_type
+#include <utility>      // for std::forward
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class Arena
+//------------------------------------------------------------------------------
+// blocks start at 'block_size' bytes and double up to kMaxBlockSize. a
+// request larger than the next block gets a block of its own.
+//------------------------------------------------------------------------------
+class Arena {
+ public:
+  static constexpr std::size_t kMaxBlockSize = std::size_t(1) << 20;
+
+ public:
+  explicit Arena(std::size_t block_size = 4096)
+      : head_{nullptr}, ptr_{nullptr}, end_{nullptr},
+        next_size_{block_size < 64 ? 64 : block_size}, used_{0} { }
+
+  ~Arena() {
+    Free(head_);
+  }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+ public:
+  // 'align' is a power of two.
+  void* Allocate(std::size_t size,
+                 std::size_t align = alignof(std::max_align_t)) {
+    char* p = Align(ptr_, align);
+    if (p == nullptr || p > end_ ||
+        size > static_cast<std::size_t>(end_ - p))
+      p = AllocateSlow(size, align);
+    else
+      ptr_ = p + size;
+    used_ += size;
+    return p;
+  }
+
+  // an object whose destructor is never run.
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // forgets every allocation. the current block is kept, the others are
+  // given back.
+  void Reset() {
+    if (head_ == nullptr)
+      return;
+    Free(head_->prev);
+    head_->prev = nullptr;
+    ptr_ = head_->data();
+    used_ = 0;
+  }
+
+  // bytes handed out since the last Reset().
+  std::size_t used() const {
+    return used_;
+  }
+
+  // bytes held in blocks.
+  std::size_t capacity() const {
+    std::size_t n = 0;
+    for (Block* b = head_; b; b = b->prev)
+      n += b->size;
+    return n;
+  }
+
+ private:
+  struct alignas(std::max_align_t) Block {
+    Block* prev;
+    std::size_t size;  // of data()
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+  };
+
+  static char* Align(char* p, std::size_t align) {
+    const std::uintptr_t v = reinterpret_cast<std::uintptr_t>(p);
+    return reinterpret_cast<char*>((v + align - 1) & ~(align - 1));
+  }
+
+  static Block* NewBlock(std::size_t size, Block* prev) {
+    if (size > std::numeric_limits<std::size_t>::max() - sizeof(Block))
+      throw std::bad_alloc();
+    Block* b = static_cast<Block*>(::operator new(sizeof(Block) + size));
+    b->prev = prev;
+    b->size = size;
+    return b;
+  }
+
+  static void Free(Block* b) {
+    while (b) {
+      Block* prev = b->prev;
+      ::operator delete(b);
+      b = prev;
+    }
+  }
+
+  char* AllocateSlow(std::size_t size, std::size_t align) {
+    const std::size_t need = size + align;
+    if (need < size)
+      throw std::bad_alloc();
+    if (need > next_size_ / 2 && head_ != nullptr) {
+      // a block of its own, behind the current one.
+      head_->prev = NewBlock(need, head_->prev);
+      return Align(head_->prev->data(), align);
+    }
+    while (next_size_ < need)
+      next_size_ *= 2;
+    head_ = NewBlock(next_size_, head_);
+    if (next_size_ < kMaxBlockSize)
+      next_size_ *= 2;
+    char* p = Align(head_->data(), align);
+    ptr_ = p + size;
+    end_ = head_->data() + head_->size;
+    return p;
+  }
+
+ private:
+  Block* head_;  // current block
+  char* ptr_;
+  char* end_;
+  std::size_t next_size_;
+  std::size_t used_;
+};
+
+
+//------------------------------------------------------------------------------
+// @class ArenaAllocator<T>
+//------------------------------------------------------------------------------
+// STL allocator drawing from an Arena, which must outlive the container.
+// deallocate() does nothing; memory comes back with Arena::Reset(). two
+// allocators compare equal if they share the arena.
+//------------------------------------------------------------------------------
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+ public:
+  explicit ArenaAllocator(Arena& arena) noexcept : arena_{&arena} { }
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept  // NOLINT (rebind)
+      : arena_{other.arena()} { }
+
+  T* allocate(std::size_t n) {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      throw std::bad_alloc();
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, std::size_t) noexcept { }
+
+  Arena* arena() const {
+    return arena_;
+  }
+
+ private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a,
+                       const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a,
+                       const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_ARENA_H_
@@ -0,0 +1,164 @@
+//------------------------------------------------------------------------------
+// @file  alloc_bench.cc
+//------------------------------------------------------------------------------
+// @brief count heap allocations per submitted task, with and without the
+//        pool / arena allocators. (and per split line)
+//        exits with failure if Submit()/Post() allocate in steady state.
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "arena.h"
+#include "future_vector.h"
+#include "object_pool.h"
+#include "strutil.h"
+#include "thread_pool.h"
+#include "stopwatch.h"
+
+
+namespace {
+std::atomic<std::size_t> g_allocs{0};
+}  // namespace
+
+
+void* operator new(std::size_t size) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+// gcc can't tell that operator new above is malloc based.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+#pragma GCC diagnostic pop
+
+
+namespace {
+
+using cu::ThreadPool;
+
+const std::size_t kTasks = 100000;
+
+
+template <typename F>
+void Measure(const char* name, F submit) {
+  submit(kTasks);  // warm up queues and pooled state
+  std::size_t before = g_allocs.load();
+  cu::Stopwatch sw;
+  submit(kTasks);
+  double elapsed = sw.sec();
+  std::size_t allocs = g_allocs.load() - before;
+  std::printf("%-14s %10.3f allocs/task %12.0f task/s\n",
+              name, static_cast<double>(allocs) / kTasks, kTasks / elapsed);
+}
+
+// allocations of a second round of kTasks.
+template <typename F>
+std::size_t SteadyAllocs(F submit) {
+  submit(kTasks);
+  std::size_t before = g_allocs.load();
+  submit(kTasks);
+  return g_allocs.load() - before;
+}
+
+}  // namespace
+
+
+int main() {
+  ThreadPool pool{2};
+  std::atomic<long> sum{0};
+
+  Measure("Enqueue", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i++)
+        pool.Enqueue([&sum](int x) { sum += x; }, 1).get();
+    });
+
+  Measure("Submit", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i++)
+        pool.Submit([&sum](int x) { sum += x; return x; }, 1).get();
+    });
+
+  Measure("Post", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i++)
+        pool.Post([&sum](int x) { sum += x; }, 1);
+      while (pool.size() > 0) { }
+    });
+
+  Measure("Enqueue/pool", [&](std::size_t n) {
+      cu::PoolAllocator<char> alloc;
+      for (std::size_t i = 0; i < n; i++)
+        pool.Enqueue(std::allocator_arg, alloc,
+                     [&sum](int x) { sum += x; }, 1).get();
+    });
+
+  // (one FutureVector per 1000 tasks)
+  Measure("FutureVector", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i += 1000) {
+        cu::FutureVector<int> fv(pool);
+        for (std::size_t j = 0; j < 1000; j++)
+          fv.Enqueue([](int x) { return x; }, 1);
+        sum += fv.get().size();
+      }
+    });
+
+  cu::Arena arena;
+  Measure("FV/arena", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i += 1000) {
+        cu::ArenaAllocator<int> alloc(arena);
+        cu::FutureVector<int, cu::ArenaAllocator<int>> fv(pool, alloc);
+        for (std::size_t j = 0; j < 1000; j++)
+          fv.Enqueue([](int x) { return x; }, 1);
+        sum += fv.get().size();
+        arena.Reset();
+      }
+    });
+
+  // (per line of 16 fields)
+  const std::string line =
+      "alpha,beta,gamma,delta,epsilon,zeta,eta,theta,iota,kappa,lambda,"
+      "mu,nu,xi,omicron,pi";
+  Measure("split", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i++)
+        sum += cu::strutil::split(line, ",").size();
+    });
+  Measure("split/arena", [&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i++) {
+        sum += cu::strutil::split(line, ",", false,
+                                  cu::ArenaAllocator<char>(arena)).size();
+        arena.Reset();
+      }
+    });
+
+  // steady state must be allocation free.
+  std::size_t allocs = SteadyAllocs([&](std::size_t n) {
+      for (std::size_t i = 0; i < n; i++)
+        pool.Submit([&sum](int x) { sum += x; return x; }, 1).get();
+    });
+  if (allocs != 0) {
+    std::printf("FAIL: Submit() allocated %zu times\n", allocs);
+    return EXIT_FAILURE;
+  }
+  std::atomic<std::size_t> done{0};
+  allocs = SteadyAllocs([&](std::size_t n) {
+      done = 0;
+      for (std::size_t i = 0; i < n; i++)
+        pool.Post([&done](int x) { done += x; }, 1);
+      while (done.load() < n) { }
+    });
+  if (allocs != 0) {
+    std::printf("FAIL: Post() allocated %zu times\n", allocs);
+    return EXIT_FAILURE;
+  }
+  std::printf("OK: Submit() and Post() are allocation free\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// @file  clock_bench.cc
+//------------------------------------------------------------------------------
+// @brief cost of one reading of each clock source (std::chrono clocks,
+//        clock_gettime, rdtsc, rdtscp), and of Stopwatch::Lap() with each
+//        clock policy.
+//------------------------------------------------------------------------------
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include "stopwatch.h"
+#include "tsc_clock.h"
+
+
+namespace {
+
+const std::size_t kSamples = 1 << 22;
+
+
+// ns per call of read(), timed with steady_clock around all of them.
+template <typename F>
+void Measure(const char* name, F read) {
+  auto begin = std::chrono::steady_clock::now();
+  std::int64_t sum = 0;
+  for (std::size_t i = 0; i < kSamples; i++)
+    sum += read();
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+  std::printf("  %-28s %8.1f ns  (%lld)\n", name, ns / kSamples,
+              static_cast<long long>(sum & 0xff));
+}
+
+template <typename Stopwatch>
+void MeasureLap(const char* name) {
+  Stopwatch sw;
+  Measure(name, [&sw] { return static_cast<std::int64_t>(sw.Lap()); });
+}
+
+}  // namespace
+
+
+int main() {
+  std::printf("tsc: %s, %.3f GHz\n",
+              cu::TscClock::invariant() ? "invariant" : "not invariant "
+              "(tsc clocks fall back to steady_clock)",
+              cu::TscClock::frequency() / 1e9);
+
+  std::printf("\none reading\n");
+  Measure("high_resolution_clock", [] {
+    return std::chrono::high_resolution_clock::now().time_since_epoch()
+        .count();
+  });
+  Measure("steady_clock", [] {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+  });
+  Measure("clock_gettime(MONOTONIC)", [] {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::int64_t>(ts.tv_nsec);
+  });
+  Measure("TscClock (rdtsc)", [] { return cu::TscClock::now(); });
+  Measure("TscpClock (rdtscp)", [] { return cu::TscpClock::now(); });
+
+  std::printf("\nStopwatch::Lap()\n");
+  MeasureLap<cu::Stopwatch>("Stopwatch");
+  MeasureLap<cu::SteadyStopwatch>("SteadyStopwatch");
+  MeasureLap<cu::TscStopwatch>("TscStopwatch");
+  MeasureLap<cu::BasicStopwatch<cu::TscpClock>>("BasicStopwatch<TscpClock>");
+
+  // the tsc against steady_clock over a longer interval.
+  cu::SteadyStopwatch steady;
+  cu::TscStopwatch tsc;
+  while (steady.msec() < 200) { }
+  std::printf("\n200 ms: steady %.3f ms, tsc %.3f ms\n", steady.msec(),
+              tsc.msec());
+  return 0;
+}
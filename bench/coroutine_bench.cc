@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------
+// @file  coroutine_bench.cc
+//------------------------------------------------------------------------------
+// @brief cost of coroutine hops on the pool, compared with the same chain
+//        of steps written with Post()/then(). needs c++20. ('make coro')
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "coroutine.h"
+#include "stopwatch.h"
+
+
+namespace {
+
+using cu::ThreadPool;
+
+const std::size_t kChains = 64;
+const std::size_t kSteps = 4096;
+
+
+cu::Task<std::size_t> Hop(ThreadPool& pool, std::size_t steps) {
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < steps; i++) {
+    co_await pool.schedule();
+    n++;
+  }
+  co_return n;
+}
+
+cu::Task<std::size_t> AwaitFutures(ThreadPool& pool, std::size_t steps) {
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < steps; i++)
+    n += co_await cu::resume_on(pool, pool.Submit([] { return 1; }));
+  co_return n;
+}
+
+cu::Task<> Sleep(ThreadPool& pool, std::chrono::milliseconds d) {
+  co_await cu::sleep_for(pool, d);
+}
+
+
+// every step posts the next one.
+struct PostChain {
+  ThreadPool* pool;
+  std::size_t left;
+  std::atomic<std::size_t>* done;
+  void operator()() {
+    if (--left == 0)
+      done->fetch_add(1);
+    else
+      pool->Post(PostChain{pool, left, done});
+  }
+};
+
+
+double HopBench(ThreadPool& pool) {
+  cu::Stopwatch sw;
+  std::vector<cu::Future<std::size_t>> chains;
+  for (std::size_t c = 0; c < kChains; c++)
+    chains.emplace_back(cu::spawn(Hop(pool, kSteps)));
+  for (auto& f : chains)
+    f.get();
+  return sw.sec() * 1e9 / (kChains * kSteps);
+}
+
+double PostBench(ThreadPool& pool) {
+  cu::Stopwatch sw;
+  std::atomic<std::size_t> done{0};
+  for (std::size_t c = 0; c < kChains; c++)
+    pool.Post(PostChain{&pool, kSteps, &done});
+  while (done.load() < kChains)
+    std::this_thread::yield();
+  return sw.sec() * 1e9 / (kChains * kSteps);
+}
+
+double AwaitBench(ThreadPool& pool) {
+  cu::Stopwatch sw;
+  std::vector<cu::Future<std::size_t>> chains;
+  for (std::size_t c = 0; c < kChains; c++)
+    chains.emplace_back(cu::spawn(AwaitFutures(pool, kSteps / 16)));
+  for (auto& f : chains)
+    f.get();
+  return sw.sec() * 1e9 / (kChains * (kSteps / 16));
+}
+
+double ThenBench(ThreadPool& pool) {
+  cu::Stopwatch sw;
+  std::vector<cu::Future<int>> chains;
+  for (std::size_t c = 0; c < kChains; c++) {
+    cu::Future<int> f = pool.Submit([] { return 1; });
+    for (std::size_t i = 1; i < kSteps / 16; i++)
+      f = f.then(pool, [](int v) { return v + 1; });
+    chains.emplace_back(std::move(f));
+  }
+  for (auto& f : chains)
+    f.get();
+  return sw.sec() * 1e9 / (kChains * (kSteps / 16));
+}
+
+double SleepBench(ThreadPool& pool, std::size_t sleepers) {
+  cu::Stopwatch sw;
+  std::vector<cu::Future<void>> all;
+  for (std::size_t i = 0; i < sleepers; i++)
+    all.emplace_back(cu::spawn(Sleep(pool, std::chrono::milliseconds(10))));
+  for (auto& f : all)
+    f.get();
+  return sw.sec() * 1e3;
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t num_workers = std::thread::hardware_concurrency();
+  if (argc > 1)
+    num_workers = std::strtoul(argv[1], nullptr, 10);
+  if (num_workers == 0)
+    num_workers = 1;
+  ThreadPool pool(num_workers);
+
+  std::printf("workers: %zu\n", num_workers);
+  std::printf("co_await schedule()  %8.1f ns/step\n", HopBench(pool));
+  std::printf("Post() chain         %8.1f ns/step\n", PostBench(pool));
+  std::printf("co_await resume_on() %8.1f ns/step\n", AwaitBench(pool));
+  std::printf("then() chain         %8.1f ns/step\n", ThenBench(pool));
+  std::printf("10000 x sleep_for(10ms) %6.1f ms\n", SleepBench(pool, 10000));
+  return 0;
+}
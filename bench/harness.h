@@ -0,0 +1,343 @@
+//------------------------------------------------------------------------------
+// @file  harness.h
+//------------------------------------------------------------------------------
+// @brief a small microbenchmark harness: warmup, repetitions, statistics,
+//        json results, and a comparison of two result files.
+//------------------------------------------------------------------------------
+// a case is a body doing 'ops' operations. it is run 'warmup' times untimed,
+// then 'reps' times timed with cu::Stopwatch; the statistics are over the
+// ns per operation of each repetition. regressions are judged by the median.
+// @code
+// cu::bench::Harness h(options);
+// h.Run("split/256", 10000, [&] {
+//   for (int i = 0; i < 10000; i++)
+//     cu::bench::DoNotOptimize(strutil::split(line, ","));
+// });
+// h.WriteJson("now.json");
+// int n = cu::bench::Compare(cu::bench::ReadJson("base.json"), h.results(),
+//                            5.0);  // cases more than 5% slower
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_BENCH_HARNESS_H_
+#define CPPUTIL_BENCH_HARNESS_H_
+#include <algorithm>      // for std::sort
+#include <cerrno>         // for errno
+#include <cmath>          // for std::sqrt
+#include <cstdio>         // for std::printf, std::fopen
+#include <cstdlib>        // for std::strtod
+#include <cstring>        // for std::strerror
+#include <map>            // for std::map
+#include <string>         // for std::string
+#include <vector>         // for std::vector
+#include "exception.h"    // for cu::SystemError, cu::RuntimeError
+#include "stopwatch.h"    // for cu::Stopwatch
+
+
+namespace cu {
+namespace bench {
+
+
+// keeps the compiler from dropping the computation of 'value'.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "m"(value) : "memory");
+}
+
+
+//------------------------------------------------------------------------------
+// @struct Result
+// @brief statistics of one case, in ns per operation.
+//------------------------------------------------------------------------------
+struct Result {
+  std::string name;
+  std::size_t ops = 0;   // operations per repetition
+  std::size_t reps = 0;
+  double min = 0;
+  double median = 0;
+  double mean = 0;
+  double stddev = 0;
+  double max = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// @class Harness
+//------------------------------------------------------------------------------
+class Harness {
+ public:
+  struct Options {
+    std::size_t warmup = 1;
+    std::size_t reps = 5;
+    std::string filter;  // only cases whose name contains it
+    bool quiet = false;  // don't print each result
+  };
+
+ public:
+  explicit Harness(const Options& options) : options_(options) { }
+
+  // runs body(), which does 'ops' operations. (skipped if filtered out)
+  template <typename F>
+  void Run(const std::string& name, std::size_t ops, F&& body) {
+    if (!options_.filter.empty() &&
+        name.find(options_.filter) == std::string::npos)
+      return;
+    for (std::size_t i = 0; i < options_.warmup; i++)
+      body();
+    std::vector<double> ns(options_.reps < 1 ? 1 : options_.reps);
+    for (auto& t : ns) {
+      Stopwatch sw;
+      body();
+      t = sw.nsec() / (ops > 0 ? ops : 1);
+    }
+    results_.push_back(Summarize(name, ops, ns));
+    if (!options_.quiet)
+      Print(results_.back());
+  }
+
+  const std::vector<Result>& results() const {
+    return results_;
+  }
+
+  std::string ToJson() const;
+
+  // throws SystemError if the file can't be written.
+  void WriteJson(const std::string& path) const;
+
+  static void Print(const Result& r) {
+    std::printf("%-36s %12.1f ns/op  (min %.1f, max %.1f, sd %.1f%%)\n",
+                r.name.c_str(), r.median, r.min, r.max,
+                r.mean > 0 ? 100 * r.stddev / r.mean : 0.0);
+  }
+
+ private:
+  static Result Summarize(const std::string& name, std::size_t ops,
+                          std::vector<double> ns) {
+    std::sort(ns.begin(), ns.end());
+    Result r;
+    r.name = name;
+    r.ops = ops;
+    r.reps = ns.size();
+    r.min = ns.front();
+    r.max = ns.back();
+    const std::size_t n = ns.size();
+    r.median = n % 2 ? ns[n / 2] : (ns[n / 2 - 1] + ns[n / 2]) / 2;
+    for (double t : ns)
+      r.mean += t;
+    r.mean /= n;
+    for (double t : ns)
+      r.stddev += (t - r.mean) * (t - r.mean);
+    r.stddev = n > 1 ? std::sqrt(r.stddev / (n - 1)) : 0;
+    return r;
+  }
+
+ private:
+  Options options_;
+  std::vector<Result> results_;
+};
+
+
+namespace detail {
+
+inline void AppendJsonString(std::string* out, const std::string& s) {
+  out->push_back('"');
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out->push_back('\\');
+    out->push_back(c);
+  }
+  out->push_back('"');
+}
+
+// the json of Harness::ToJson(): objects of string and number members.
+// (not a general json parser)
+class ResultParser {
+ public:
+  explicit ResultParser(const std::string& json) : s_(json), p_{0} { }
+
+  std::vector<Result> Parse() {
+    std::vector<Result> results;
+    p_ = s_.find('[');
+    if (p_ == std::string::npos)
+      Fail();
+    p_++;
+    while (Skip() != ']') {
+      if (s_[p_] == ',') {
+        p_++;
+        continue;
+      }
+      results.push_back(Object());
+    }
+    return results;
+  }
+
+ private:
+  Result Object() {
+    Expect('{');
+    Result r;
+    while (Skip() != '}') {
+      if (s_[p_] == ',') {
+        p_++;
+        continue;
+      }
+      const std::string key = String();
+      Expect(':');
+      if (Skip() == '"') {
+        std::string value = String();
+        if (key == "name")
+          r.name = value;
+        continue;
+      }
+      const char* begin = s_.c_str() + p_;
+      char* end;
+      const double v = std::strtod(begin, &end);
+      if (end == begin)
+        Fail();
+      p_ += end - begin;
+      if (key == "ops") r.ops = static_cast<std::size_t>(v);
+      else if (key == "reps") r.reps = static_cast<std::size_t>(v);
+      else if (key == "min") r.min = v;
+      else if (key == "median") r.median = v;
+      else if (key == "mean") r.mean = v;
+      else if (key == "stddev") r.stddev = v;
+      else if (key == "max") r.max = v;
+    }
+    p_++;
+    return r;
+  }
+
+  std::string String() {
+    Expect('"');
+    std::string value;
+    while (p_ < s_.size() && s_[p_] != '"') {
+      if (s_[p_] == '\\')
+        p_++;
+      if (p_ < s_.size())
+        value.push_back(s_[p_++]);
+    }
+    Expect('"');
+    return value;
+  }
+
+  // the next non-blank character. (not consumed)
+  char Skip() {
+    while (p_ < s_.size() && (s_[p_] == ' ' || s_[p_] == '\n' ||
+                              s_[p_] == '\r' || s_[p_] == '\t'))
+      p_++;
+    if (p_ >= s_.size())
+      Fail();
+    return s_[p_];
+  }
+
+  void Expect(char c) {
+    if (Skip() != c)
+      Fail();
+    p_++;
+  }
+
+  [[noreturn]] void Fail() const {
+    throw RuntimeError("bench: malformed results at offset " +
+                       std::to_string(p_));
+  }
+
+ private:
+  const std::string& s_;
+  std::size_t p_;
+};
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief results as json.
+//------------------------------------------------------------------------------
+inline std::string Harness::ToJson() const {
+  std::string out = "{\"unit\":\"ns/op\",\"results\":[";
+  char buf[256];
+  for (std::size_t i = 0; i < results_.size(); i++) {
+    const Result& r = results_[i];
+    out += i ? ",\n{\"name\":" : "\n{\"name\":";
+    detail::AppendJsonString(&out, r.name);
+    std::snprintf(buf, sizeof(buf),
+                  ",\"ops\":%zu,\"reps\":%zu,\"min\":%.3f,\"median\":%.3f,"
+                  "\"mean\":%.3f,\"stddev\":%.3f,\"max\":%.3f}",
+                  r.ops, r.reps, r.min, r.median, r.mean, r.stddev, r.max);
+    out += buf;
+  }
+  out += "\n]}\n";
+  return out;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief write results to a file.
+//------------------------------------------------------------------------------
+inline void Harness::WriteJson(const std::string& path) const {
+  const std::string json = ToJson();
+  std::FILE* f = std::fopen(path.c_str(), "w");
+  if (f == nullptr)
+    throw SystemError("bench: " + path + ": " + std::strerror(errno));
+  const bool ok = std::fwrite(json.data(), 1, json.size(), f) == json.size();
+  const int saved = errno;
+  if (std::fclose(f) != 0 || !ok)
+    throw SystemError("bench: " + path + ": " +
+                      std::strerror(ok ? errno : saved));
+}
+
+
+//------------------------------------------------------------------------------
+// @brief results written by Harness::WriteJson().
+//        throws SystemError if unreadable, RuntimeError if malformed.
+//------------------------------------------------------------------------------
+inline std::vector<Result> ReadJson(const std::string& path) {
+  std::FILE* f = std::fopen(path.c_str(), "r");
+  if (f == nullptr)
+    throw SystemError("bench: " + path + ": " + std::strerror(errno));
+  std::string json;
+  char buf[4096];
+  std::size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+    json.append(buf, n);
+  std::fclose(f);
+  return detail::ResultParser(json).Parse();
+}
+
+
+//------------------------------------------------------------------------------
+// @brief prints the cases of 'current' against 'base', by median.
+// @return number of cases more than 'threshold' percent slower.
+//------------------------------------------------------------------------------
+inline std::size_t Compare(const std::vector<Result>& base,
+                           const std::vector<Result>& current,
+                           double threshold) {
+  std::map<std::string, const Result*> by_name;
+  for (const auto& r : base)
+    by_name[r.name] = &r;
+  std::size_t regressions = 0;
+  std::printf("%-36s %12s %12s %9s\n", "case", "base ns/op", "ns/op",
+              "change");
+  for (const auto& r : current) {
+    auto it = by_name.find(r.name);
+    if (it == by_name.end()) {
+      std::printf("%-36s %12s %12.1f %9s\n", r.name.c_str(), "-", r.median,
+                  "new");
+      continue;
+    }
+    const double b = it->second->median;
+    const double change = b > 0 ? 100 * (r.median - b) / b : 0;
+    const char* mark = "";
+    if (change > threshold) {
+      mark = "  REGRESSION";
+      regressions++;
+    } else if (change < -threshold) {
+      mark = "  faster";
+    }
+    std::printf("%-36s %12.1f %12.1f %+8.1f%%%s\n", r.name.c_str(), b,
+                r.median, change, mark);
+  }
+  return regressions;
+}
+
+
+}  // namespace bench
+}  // namespace cu
+#endif  // CPPUTIL_BENCH_HARNESS_H_
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// @file  histogram_bench.cc
+//------------------------------------------------------------------------------
+// @brief cost of recording one value: Histogram, a mutex around a Histogram
+//        and ConcurrentHistogram, by number of threads. and of a ScopedTimer.
+//        usage: histogram_bench [max threads]
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+#include "stopwatch.h"
+
+
+namespace {
+
+const std::size_t kRecords = 1 << 22;
+
+
+// ns per Record() with 'threads' threads recording kRecords values each.
+template <typename F>
+double Run(std::size_t threads, F record) {
+  cu::Stopwatch sw;
+  std::vector<std::thread> workers;
+  for (std::size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&record, t] {
+      std::uint64_t v = 88172645463325252ull + t;
+      for (std::size_t i = 0; i < kRecords; i++) {
+        v ^= v << 13;  // (xorshift, values of all magnitudes)
+        v ^= v >> 7;
+        v ^= v << 17;
+        record(static_cast<std::int64_t>(v >> (40 + v % 24)));
+      }
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  return sw.nsec() / kRecords;
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t max_threads = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_threads = std::strtoul(argv[1], nullptr, 10);
+  if (max_threads == 0)
+    max_threads = 1;
+
+  std::printf("%-8s %12s %12s %12s  (ns per record, per thread)\n",
+              "threads", "Histogram", "mutex", "Concurrent");
+  for (std::size_t n = 1; n <= max_threads; n *= 2) {
+    cu::Histogram plain;
+    double t_plain = n == 1 ? Run(1, [&](std::int64_t v) { plain.Record(v); })
+                            : 0.0;
+    std::mutex mutex;
+    cu::Histogram locked;
+    double t_locked = Run(n, [&](std::int64_t v) {
+      std::lock_guard<std::mutex> lock(mutex);
+      locked.Record(v);
+    });
+    cu::ConcurrentHistogram concurrent;
+    double t_concurrent = Run(n, [&](std::int64_t v) {
+      concurrent.Record(v);
+    });
+    char plain_ns[32] = "-";  // (one thread only)
+    if (n == 1)
+      std::snprintf(plain_ns, sizeof(plain_ns), "%.1f", t_plain);
+    std::printf("%-8zu %12s %12.1f %12.1f\n", n, plain_ns, t_locked,
+                t_concurrent);
+  }
+
+  cu::ConcurrentHistogram& h = cu::Histograms().Get("empty scope");
+  for (std::size_t i = 0; i < kRecords; i++)
+    cu::ScopedTimer t(h);
+  cu::Histogram s = h.Snapshot();
+  std::printf("\nScopedTimer around nothing: %s\n", s.ToString().c_str());
+  return 0;
+}
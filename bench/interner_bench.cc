@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+// @file  interner_bench.cc
+//------------------------------------------------------------------------------
+// @brief strutil::split (one std::string per field) vs split_view +
+//        StringInterner (one 32 bit id per field) on lines made of a small
+//        vocabulary, on one thread and on a ThreadPool.
+//        usage: interner_bench [max workers]
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "interner.h"
+#include "parallel.h"
+#include "stopwatch.h"
+#include "strutil.h"
+
+
+namespace {
+
+namespace strutil = cu::strutil;
+
+const std::size_t kLines = 400000;
+const std::size_t kFields = 10;
+const std::size_t kVocabulary = 2000;
+
+
+std::vector<std::string> MakeLines() {
+  std::vector<std::string> words;
+  std::srand(1);
+  for (std::size_t i = 0; i < kVocabulary; i++) {
+    std::string w;
+    std::size_t len = 3 + std::rand() % 12;
+    for (std::size_t c = 0; c < len; c++)
+      w += static_cast<char>('a' + std::rand() % 26);
+    words.push_back(w);
+  }
+  std::vector<std::string> lines;
+  lines.reserve(kLines);
+  for (std::size_t i = 0; i < kLines; i++) {
+    std::string line;
+    for (std::size_t f = 0; f < kFields; f++) {
+      if (f > 0)
+        line += '\t';
+      line += words[std::rand() % kVocabulary];
+    }
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+void Print(const char* name, std::size_t fields, double sec,
+           std::size_t sum) {
+  std::printf("%-26s %8.1f ns/field  (%zu)\n", name, sec * 1e9 / fields, sum);
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t max_workers = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_workers = std::strtoul(argv[1], nullptr, 10);
+  if (max_workers == 0)
+    max_workers = 1;
+
+  std::vector<std::string> lines = MakeLines();
+  const std::size_t fields = kLines * kFields;
+
+  {
+    cu::Stopwatch sw;
+    std::size_t sum = 0;
+    for (const auto& l : lines) {
+      for (const auto& f : strutil::split(l, "\t"))
+        sum += f.size();
+    }
+    Print("split", fields, sw.sec(), sum);
+  }
+  {
+    cu::StringInterner interner;
+    std::vector<cu::StringInterner::Id> ids;
+    cu::Stopwatch sw;
+    std::size_t sum = 0;
+    for (const auto& l : lines) {
+      ids.clear();
+      interner.InternAll(strutil::split_view(l, '\t'), &ids);
+      for (auto id : ids)
+        sum += interner.view(id).size();
+    }
+    Print("split_view + Intern", fields, sw.sec(), sum);
+    std::printf("(%zu distinct)\n", interner.size());
+  }
+
+  std::printf("\n(workers: pool threads + the calling thread)\n");
+  for (std::size_t w = 1; w <= max_workers; w *= 2) {
+    cu::ThreadPool pool(w);
+    cu::StringInterner interner;
+    std::atomic<std::size_t> sum{0};
+    cu::Stopwatch sw;
+    cu::parallel_for(pool, std::size_t(0), lines.size(), 1024,
+                     [&](std::size_t i) {
+      std::size_t n = 0;
+      for (cu::StringView f : strutil::split_view(lines[i], '\t'))
+        n += interner.view(interner.Intern(f)).size();
+      sum += n;
+    });
+    char name[64];
+    std::snprintf(name, sizeof(name), "Intern x%zu", w + 1);
+    Print(name, fields, sw.sec(), sum.load());
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// @file  metrics_bench.cc
+//------------------------------------------------------------------------------
+// @brief overhead of ThreadPool::Options::metrics on small tasks, and a
+//        sample snapshot.
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "thread_pool.h"
+#include "stopwatch.h"
+
+
+namespace {
+
+using cu::ThreadPool;
+
+const std::size_t kTasks = 1 << 20;
+
+
+double Run(ThreadPool::Scheduling scheduling, std::size_t num_workers,
+           bool metrics, cu::PoolMetrics* snapshot) {
+  ThreadPool::Options options;
+  options.num_threads = num_workers;
+  options.scheduling = scheduling;
+  options.metrics = metrics;
+  ThreadPool pool{options};
+
+  std::atomic<std::size_t> done{0};
+  cu::Stopwatch sw;
+  for (std::size_t i = 0; i < kTasks; i++)
+    pool.Post([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+  while (done.load() < kTasks)
+    std::this_thread::yield();
+  double rate = kTasks / sw.sec();
+  if (snapshot)
+    *snapshot = pool.metrics();
+  return rate;
+}
+
+void Print(const cu::PoolMetrics& m) {
+  std::printf("tasks %llu  steals %llu  utilization %.2f\n",
+              (unsigned long long)m.total.tasks_executed,
+              (unsigned long long)m.total.steals, m.utilization());
+  const cu::Histogram* hists[] = {&m.total.queue_wait, &m.total.exec_time};
+  const char* names[] = {"queue wait", "exec time"};
+  for (int h = 0; h < 2; h++)
+    std::printf("%-10s %s\n", names[h], hists[h]->ToString().c_str());
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t num_workers = std::thread::hardware_concurrency();
+  if (argc > 1)
+    num_workers = std::strtoul(argv[1], nullptr, 10);
+  if (num_workers == 0)
+    num_workers = 1;
+
+  std::printf("workers: %zu\n", num_workers);
+  std::printf("%10s %16s %16s\n", "mode", "off(task/s)", "on(task/s)");
+  const ThreadPool::Scheduling modes[] = {
+    ThreadPool::Scheduling::kSharedQueue,
+    ThreadPool::Scheduling::kWorkStealing,
+    ThreadPool::Scheduling::kLockFree,
+  };
+  const char* names[] = {"shared", "stealing", "lockfree"};
+  cu::PoolMetrics snapshot;
+  for (int i = 0; i < 3; i++) {
+    std::printf("%10s %16.0f %16.0f\n", names[i],
+                Run(modes[i], num_workers, false, nullptr),
+                Run(modes[i], num_workers, true, &snapshot));
+  }
+  Print(snapshot);
+  return 0;
+}
@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+// @file  micro_bench.cc
+//------------------------------------------------------------------------------
+// @brief regression suite: ThreadPool, FutureVector, strutil and GetOpt
+//        cases on the harness. (see harness.h)
+//        usage: micro_bench [--reps N] [--warmup N] [--filter text]
+//                           [--json out.json] [--baseline base.json]
+//                           [--threshold pct]
+//               micro_bench --compare base.json --to new.json
+//                           [--threshold pct]
+//        exits with 1 if a case is more than 'threshold' (5) percent slower
+//        than its baseline, with 2 on bad arguments or files.
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+#include "future_vector.h"
+#include "getopt.h"
+#include "harness.h"
+#include "strutil.h"
+#include "thread_pool.h"
+
+
+namespace {
+
+namespace strutil = cu::strutil;
+using cu::bench::DoNotOptimize;
+using cu::bench::Harness;
+
+const std::size_t kThreads[] = {1, 2, 4};
+const std::size_t kSizes[] = {16, 256, 4096};  // input bytes
+const std::size_t kBytes = 1 << 20;            // input per repetition
+
+
+std::string Name(const char* prefix, std::size_t n) {
+  return prefix + std::to_string(n);
+}
+
+void PoolCases(Harness& h) {
+  for (std::size_t t : kThreads) {
+    cu::ThreadPool pool{t};
+    const std::size_t tasks = 1 << 15;
+    std::vector<std::future<std::size_t>> futures;
+    futures.reserve(tasks);
+    // tasks pushed back to back, then waited for.
+    h.Run(Name("pool/enqueue/throughput/t", t), tasks, [&] {
+      futures.clear();
+      for (std::size_t i = 0; i < tasks; i++)
+        futures.push_back(pool.Enqueue([](std::size_t x) { return x; }, i));
+      for (auto& f : futures)
+        DoNotOptimize(f.get());
+    });
+    // one task at a time: enqueue, run on a worker, result back.
+    const std::size_t trips = 2000;
+    h.Run(Name("pool/enqueue/latency/t", t), trips, [&] {
+      for (std::size_t i = 0; i < trips; i++)
+        DoNotOptimize(pool.Enqueue([](std::size_t x) { return x; }, i).get());
+    });
+  }
+}
+
+void FutureVectorCases(Harness& h) {
+  cu::ThreadPool pool{2};
+  const std::size_t tasks = 1 << 14;
+  h.Run("future_vector/get", tasks, [&] {
+    cu::FutureVector<std::size_t> fv(pool);
+    for (std::size_t i = 0; i < tasks; i++)
+      fv.Enqueue([](std::size_t x) { return x; }, i);
+    DoNotOptimize(fv.get());
+  });
+  h.Run("future_vector/completed", tasks, [&] {
+    cu::FutureVector<std::size_t> fv(pool);
+    for (std::size_t i = 0; i < tasks; i++)
+      fv.Enqueue([](std::size_t x) { return x; }, i);
+    std::size_t sum = 0;
+    fv.ForEachCompleted([&sum](std::size_t x) { sum += x; });
+    DoNotOptimize(sum);
+  });
+}
+
+// comma separated words of 3..10 letters, 'size' bytes.
+std::string Words(std::size_t size) {
+  std::string s;
+  unsigned seed = 1;
+  while (s.size() < size) {
+    seed = seed * 1103515245u + 12345u;
+    if (!s.empty())
+      s += ',';
+    s.append(3 + (seed >> 16) % 8, static_cast<char>('a' + (seed >> 8) % 26));
+  }
+  s.resize(size);
+  return s;
+}
+
+void StrutilCases(Harness& h) {
+  for (std::size_t size : kSizes) {
+    const std::string line = Words(size);
+    const std::string padded = "  \t" + line + " \r\n";
+    const std::vector<std::string> fields = strutil::split(line, ",");
+    const std::size_t calls = kBytes / size;
+    h.Run(Name("strutil/split/", size), calls, [&] {
+      for (std::size_t i = 0; i < calls; i++)
+        DoNotOptimize(strutil::split(line, ","));
+    });
+    h.Run(Name("strutil/join/", size), calls, [&] {
+      for (std::size_t i = 0; i < calls; i++)
+        DoNotOptimize(strutil::join(fields, ", "));
+    });
+    h.Run(Name("strutil/replace/", size), calls, [&] {
+      for (std::size_t i = 0; i < calls; i++)
+        DoNotOptimize(strutil::replace(line, ",", ", "));
+    });
+    h.Run(Name("strutil/trim/", size), calls, [&] {
+      for (std::size_t i = 0; i < calls; i++)
+        DoNotOptimize(strutil::trim(padded));
+    });
+  }
+}
+
+void GetOptCases(Harness& h) {
+  const std::vector<std::string> args = {
+      "--threads", "8", "--name", "worker", "--ratio", "0.75", "-v",
+      "--queue", "4096", "--mode", "steal"};
+  const std::size_t calls = 20000;
+  h.Run("getopt/parse", calls, [&] {
+    for (std::size_t i = 0; i < calls; i++) {
+      cu::GetOpt opt(args);
+      DoNotOptimize(opt.Parse<int>("-t", "--threads"));
+      DoNotOptimize(opt.Parse<std::string>("--name"));
+      DoNotOptimize(opt.Parse<double>("--ratio"));
+      DoNotOptimize(opt.Parse<bool>("-v"));
+      DoNotOptimize(opt.Parse<std::size_t>("--queue"));
+    }
+  });
+}
+
+
+int Main(int argc, char* argv[]) {
+  cu::GetOpt opt(argc, argv);
+  const double threshold =
+      opt.HasOpt("--threshold") ? opt.Parse<double>("--threshold") : 5.0;
+
+  if (opt.HasOpt("--compare")) {
+    std::size_t regressions = cu::bench::Compare(
+        cu::bench::ReadJson(opt.Parse<std::string>("--compare")),
+        cu::bench::ReadJson(opt.Parse<std::string>("--to")), threshold);
+    return regressions > 0 ? 1 : 0;
+  }
+
+  Harness::Options options;
+  if (opt.HasOpt("--reps"))
+    options.reps = opt.Parse<std::size_t>("--reps");
+  if (opt.HasOpt("--warmup"))
+    options.warmup = opt.Parse<std::size_t>("--warmup");
+  options.filter = opt.Parse<std::string>("--filter");
+  Harness h(options);
+  PoolCases(h);
+  FutureVectorCases(h);
+  StrutilCases(h);
+  GetOptCases(h);
+
+  if (opt.HasOpt("--json"))
+    h.WriteJson(opt.Parse<std::string>("--json"));
+  if (opt.HasOpt("--baseline")) {
+    std::printf("\n");
+    std::size_t regressions = cu::bench::Compare(
+        cu::bench::ReadJson(opt.Parse<std::string>("--baseline")),
+        h.results(), threshold);
+    return regressions > 0 ? 1 : 0;
+  }
+  return 0;
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  try {
+    return Main(argc, argv);
+  } catch (const cu::Exception& e) {
+    std::fprintf(stderr, "%s", e.what());
+    return 2;
+  }
+}
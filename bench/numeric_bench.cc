@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// @file  numeric_bench.cc
+//------------------------------------------------------------------------------
+// @brief parsing integers and doubles with std::stringstream / strtoll /
+//        strtod vs strutil::from_chars, and formatting them with
+//        std::to_string / snprintf vs strutil::to_chars.
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "numeric.h"
+#include "stopwatch.h"
+
+
+namespace {
+
+namespace strutil = cu::strutil;
+
+const std::size_t kCount = 1000000;
+
+
+std::vector<std::string> MakeInts(int max_digits) {
+  std::vector<std::string> v;
+  v.reserve(kCount);
+  std::srand(1);
+  for (std::size_t i = 0; i < kCount; i++) {
+    int digits = 1 + std::rand() % max_digits;
+    std::string s = (std::rand() % 4 == 0) ? "-" : "";
+    s += static_cast<char>('1' + std::rand() % 9);
+    for (int d = 1; d < digits; d++)
+      s += static_cast<char>('0' + std::rand() % 10);
+    v.push_back(s);
+  }
+  return v;
+}
+
+std::vector<std::string> MakeDoubles() {
+  std::vector<std::string> v;
+  v.reserve(kCount);
+  std::srand(1);
+  char buf[64];
+  for (std::size_t i = 0; i < kCount; i++) {
+    double d = (std::rand() % 2000000 - 1000000) / 1000.0;
+    if (i % 2)
+      d = static_cast<double>(std::rand()) / RAND_MAX * 1e3;
+    std::snprintf(buf, sizeof(buf), "%.*g", 3 + static_cast<int>(i % 15), d);
+    v.push_back(buf);
+  }
+  return v;
+}
+
+// ns per item of body over all inputs. body returns a checksum.
+template <typename In, typename Body>
+void Measure(const char* name, const std::vector<In>& in, Body body) {
+  cu::Stopwatch sw;
+  double sum = 0;
+  for (const auto& x : in)
+    sum += body(x);
+  double sec = sw.sec();
+  std::printf("  %-26s %8.1f ns  (%g)\n", name, sec * 1e9 / in.size(), sum);
+}
+
+void RunParseInt(const char* title, int max_digits) {
+  std::vector<std::string> in = MakeInts(max_digits);
+  std::printf("\n%s\n", title);
+  Measure("stringstream", in, [](const std::string& s) {
+    std::istringstream is(s);
+    long long v = 0;
+    is >> v;
+    return static_cast<double>(v);
+  });
+  Measure("strtoll", in, [](const std::string& s) {
+    return static_cast<double>(std::strtoll(s.c_str(), nullptr, 10));
+  });
+  Measure("strutil::from_chars", in, [](const std::string& s) {
+    long long v = 0;
+    strutil::from_chars(s.data(), s.data() + s.size(), v);
+    return static_cast<double>(v);
+  });
+}
+
+void RunParseDouble() {
+  std::vector<std::string> in = MakeDoubles();
+  std::printf("\nparse double\n");
+  Measure("stringstream", in, [](const std::string& s) {
+    std::istringstream is(s);
+    double v = 0;
+    is >> v;
+    return v;
+  });
+  Measure("strtod", in, [](const std::string& s) {
+    return std::strtod(s.c_str(), nullptr);
+  });
+  Measure("strutil::from_chars", in, [](const std::string& s) {
+    double v = 0;
+    strutil::from_chars(s.data(), s.data() + s.size(), v);
+    return v;
+  });
+}
+
+void RunFormat() {
+  std::vector<long long> ints;
+  std::vector<double> doubles;
+  for (const auto& s : MakeInts(18))
+    ints.push_back(std::strtoll(s.c_str(), nullptr, 10));
+  for (const auto& s : MakeDoubles())
+    doubles.push_back(std::strtod(s.c_str(), nullptr));
+
+  char buf[64];
+  std::printf("\nformat long long\n");
+  Measure("std::to_string", ints, [](long long v) {
+    return static_cast<double>(std::to_string(v).size());
+  });
+  Measure("snprintf %lld", ints, [&buf](long long v) {
+    return static_cast<double>(std::snprintf(buf, sizeof(buf), "%lld", v));
+  });
+  Measure("strutil::to_chars", ints, [&buf](long long v) {
+    return static_cast<double>(
+        strutil::to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+  });
+
+  std::printf("\nformat double (shortest round trip)\n");
+  Measure("snprintf %.17g", doubles, [&buf](double v) {
+    return static_cast<double>(std::snprintf(buf, sizeof(buf), "%.17g", v));
+  });
+  Measure("strutil::to_chars", doubles, [&buf](double v) {
+    return static_cast<double>(
+        strutil::to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+  });
+}
+
+}  // namespace
+
+
+int main() {
+  RunParseInt("parse int (1-8 digits)", 8);
+  RunParseInt("parse int (1-18 digits)", 18);
+  RunParseDouble();
+  RunFormat();
+  return 0;
+}
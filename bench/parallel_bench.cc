@@ -0,0 +1,47 @@
+//------------------------------------------------------------------------------
+// @file  parallel_bench.cc
+//------------------------------------------------------------------------------
+// @brief per-element overhead of parallel_for/parallel_reduce compared with
+//        one FutureVector<void>::Enqueue() per element.
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "future_vector.h"
+#include "parallel.h"
+#include "stopwatch.h"
+
+
+int main() {
+  const std::size_t n = 1 << 20;
+  std::size_t num_threads = std::thread::hardware_concurrency();
+  if (num_threads == 0)
+    num_threads = 1;
+  cu::ThreadPool pool{num_threads};
+  std::vector<double> v(n, 0.0);
+  const std::size_t zero = 0;
+
+  {
+    cu::Stopwatch sw;
+    cu::FutureVector<void> fv(pool);
+    for (std::size_t i = 0; i < n; i++)
+      fv.Enqueue([&v](std::size_t x) { v[x] = x * 0.5; }, i);
+    fv.get();
+    std::printf("%-16s %10.2f ns/element\n", "FutureVector", sw.nsec() / n);
+  }
+  {
+    cu::Stopwatch sw;
+    cu::parallel_for(pool, zero, n, [&v](std::size_t i) { v[i] = i * 0.5; });
+    std::printf("%-16s %10.2f ns/element\n", "parallel_for", sw.nsec() / n);
+  }
+  {
+    cu::Stopwatch sw;
+    double sum = cu::parallel_reduce(
+        pool, zero, n, 0.0,
+        [&v](std::size_t i) { return v[i]; }, std::plus<double>());
+    std::printf("%-16s %10.2f ns/element (sum=%.0f)\n",
+                "parallel_reduce", sw.nsec() / n, sum);
+  }
+  return 0;
+}
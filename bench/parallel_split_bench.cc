@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// @file  parallel_split_bench.cc
+//------------------------------------------------------------------------------
+// @brief strutil::split / split_view vs parallel_split / parallel_split_view
+//        of one large buffer, by number of workers.
+//        usage: parallel_split_bench [max workers]
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parallel_split.h"
+#include "stopwatch.h"
+#include "strutil.h"
+
+
+namespace {
+
+namespace strutil = cu::strutil;
+
+const std::size_t kSize = 64 << 20;
+
+
+std::string MakeBuffer(const std::string& delim) {
+  std::string buf;
+  buf.reserve(kSize + 64);
+  std::srand(1);
+  while (buf.size() < kSize) {
+    std::size_t len = 1 + std::rand() % 24;
+    for (std::size_t c = 0; c < len; c++)
+      buf += static_cast<char>('a' + std::rand() % 26);
+    buf += delim;
+  }
+  return buf;
+}
+
+void Run(const char* name, const std::string& delim, std::size_t max_workers) {
+  std::string buf = MakeBuffer(delim);
+  std::printf("\n%s: %zu MB\n", name, buf.size() >> 20);
+  std::printf("%-10s %12s %12s\n", "workers", "strings", "views");
+
+  double sec_strings, sec_views;
+  std::size_t n_strings, n_views;
+  {
+    cu::Stopwatch sw;
+    n_strings = strutil::split(buf, delim).size();
+    sec_strings = sw.sec();
+  }
+  {
+    cu::Stopwatch sw;
+    n_views = strutil::split_view(buf, cu::StringView(delim)).to_vector()
+        .size();
+    sec_views = sw.sec();
+  }
+  std::printf("%-10s %9.1f ms %9.1f ms  (%zu pieces)\n", "split",
+              sec_strings * 1e3, sec_views * 1e3, n_strings);
+
+  for (std::size_t w = 1; w <= max_workers; w *= 2) {
+    cu::ThreadPool pool(w);
+    cu::Stopwatch sw;
+    std::size_t a = strutil::parallel_split(pool, buf, delim).size();
+    double t1 = sw.sec();
+    sw.Reset();
+    std::size_t b = strutil::parallel_split_view(pool, buf, delim).size();
+    double t2 = sw.sec();
+    std::printf("%-10zu %9.1f ms %9.1f ms %s\n", w + 1, t1 * 1e3, t2 * 1e3,
+                (a == n_strings && b == n_views) ? "" : "(MISMATCH)");
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t max_workers = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_workers = std::strtoul(argv[1], nullptr, 10);
+  if (max_workers == 0)
+    max_workers = 1;
+  std::printf("(workers: pool threads + the calling thread)\n");
+  Run("'\\t'", "\t", max_workers);
+  Run("\"<|>\"", "<|>", max_workers);
+  return 0;
+}
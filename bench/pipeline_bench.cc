@@ -0,0 +1,159 @@
+//------------------------------------------------------------------------------
+// @file  pipeline_bench.cc
+//------------------------------------------------------------------------------
+// @brief messages per second through SpscRing/MpscRing, one at a time and
+//        in batches, and through a three stage pipeline against the same
+//        stages chained with ThreadPool::Post().
+//        usage: pipeline_bench [messages]
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "pipeline.h"
+#include "stopwatch.h"
+#include "thread_pool.h"
+
+
+namespace {
+
+const std::size_t kCapacity = 4096;
+const std::size_t kBatch = 64;
+
+
+// 'producers' threads push one message at a time, the caller pops.
+template <typename Ring>
+double OneByOne(std::size_t count, std::size_t producers) {
+  Ring ring(kCapacity);
+  std::vector<std::thread> threads;
+  cu::Stopwatch sw;
+  for (std::size_t p = 0; p < producers; p++) {
+    threads.emplace_back([&ring, count, producers]() {
+      for (std::size_t i = 0; i < count / producers; i++) {
+        std::size_t v = i;
+        while (!ring.TryPush(std::move(v)))
+          std::this_thread::yield();
+      }
+    });
+  }
+  std::size_t sum = 0;
+  std::size_t v;
+  for (std::size_t n = 0; n < count / producers * producers;) {
+    if (ring.TryPop(v)) {
+      sum += v;
+      n++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  for (auto& t : threads)
+    t.join();
+  double rate = count / sw.sec();
+  if (sum == 0)
+    std::printf("!");
+  return rate;
+}
+
+// the same in batches of kBatch.
+template <typename Ring>
+double Batched(std::size_t count, std::size_t producers) {
+  Ring ring(kCapacity);
+  std::vector<std::thread> threads;
+  cu::Stopwatch sw;
+  for (std::size_t p = 0; p < producers; p++) {
+    threads.emplace_back([&ring, count, producers]() {
+      std::size_t batch[kBatch];
+      for (std::size_t i = 0; i < count / producers; i += kBatch) {
+        for (std::size_t k = 0; k < kBatch; k++)
+          batch[k] = i + k;
+        std::size_t done = 0;
+        while (done < kBatch) {
+          done += ring.PushBatch(batch + done, kBatch - done);
+          if (done < kBatch)
+            std::this_thread::yield();
+        }
+      }
+    });
+  }
+  std::size_t sum = 0;
+  const std::size_t total = (count / producers + kBatch - 1) / kBatch *
+                            kBatch * producers;
+  for (std::size_t n = 0; n < total;) {
+    std::size_t k = ring.Drain([&sum](std::size_t& v) { sum += v; }, kBatch);
+    if (k == 0)
+      std::this_thread::yield();
+    n += k;
+  }
+  for (auto& t : threads)
+    t.join();
+  double rate = total / sw.sec();
+  if (sum == 0)
+    std::printf("!");
+  return rate;
+}
+
+// source -> x * 3 -> x + 1 -> sum
+double Pipeline(std::size_t count) {
+  cu::ThreadPool pool{3};
+  std::size_t sum = 0;
+  cu::Stopwatch sw;
+  {
+    cu::Pipeline pipeline(pool, kCapacity);
+    auto source = pipeline.Source<std::size_t>();
+    auto a = pipeline.Stage(source, [](std::size_t& x) { return x * 3; });
+    auto b = pipeline.Stage(a, [](std::size_t& x) { return x + 1; });
+    pipeline.Sink(b, [&sum](std::size_t& x) { sum += x; });
+    pipeline.Start();
+    std::size_t batch[kBatch];
+    for (std::size_t i = 0; i < count; i += kBatch) {
+      for (std::size_t k = 0; k < kBatch; k++)
+        batch[k] = i + k;
+      source.PushBatch(batch, kBatch);
+    }
+    pipeline.Finish();
+  }
+  double rate = count / sw.sec();
+  if (sum == 0)
+    std::printf("!");
+  return rate;
+}
+
+// the same stages, each hop a task posted to the pool.
+double Chained(std::size_t count) {
+  cu::ThreadPool pool{3};
+  std::atomic<std::size_t> sum{0};
+  std::atomic<std::size_t> done{0};
+  cu::Stopwatch sw;
+  for (std::size_t i = 0; i < count; i++) {
+    pool.Post([&pool, &sum, &done](std::size_t x) {
+      x = x * 3;
+      pool.Post([&sum, &done](std::size_t y) {
+        sum.fetch_add(y + 1, std::memory_order_relaxed);
+        done.fetch_add(1, std::memory_order_release);
+      }, x);
+    }, i);
+  }
+  while (done.load(std::memory_order_acquire) < count)
+    std::this_thread::yield();
+  return count / sw.sec();
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 22;
+  using Spsc = cu::SpscRing<std::size_t>;
+  using Mpsc = cu::MpscRing<std::size_t>;
+
+  std::printf("%-22s %14s\n", "", "msgs/s");
+  std::printf("%-22s %14.0f\n", "SpscRing", OneByOne<Spsc>(count, 1));
+  std::printf("%-22s %14.0f\n", "SpscRing/batch", Batched<Spsc>(count, 1));
+  std::printf("%-22s %14.0f\n", "MpscRing x2", OneByOne<Mpsc>(count, 2));
+  std::printf("%-22s %14.0f\n", "MpscRing/batch x2", Batched<Mpsc>(count, 2));
+  std::printf("%-22s %14.0f\n", "Pipeline (3 stages)", Pipeline(count));
+  std::printf("%-22s %14.0f\n", "ThreadPool chain",
+              Chained(count / 16));
+  return 0;
+}
@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// @file  queue_bench.cc
+//------------------------------------------------------------------------------
+// @brief submission throughput under producer contention.
+//        N producer threads Post() empty tasks into one pool, for each
+//        scheduling mode. also checks MpscRing with producers mixing
+//        TryPush() and PushBatch(), exits with failure if it loses or
+//        reorders a message.
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "ring_buffer.h"
+#include "thread_pool.h"
+#include "stopwatch.h"
+
+
+namespace {
+
+using cu::ThreadPool;
+
+const std::size_t kTotalTasks = 1 << 20;
+
+
+double Run(ThreadPool::Scheduling scheduling, std::size_t num_workers,
+           std::size_t num_producers) {
+  ThreadPool::Options options;
+  options.num_threads = num_workers;
+  options.scheduling = scheduling;
+  ThreadPool pool{options};
+
+  std::atomic<std::size_t> done{0};
+  const std::size_t per_producer = kTotalTasks / num_producers;
+  const std::size_t total = per_producer * num_producers;
+
+  cu::Stopwatch sw;
+  std::vector<std::thread> producers;
+  for (std::size_t p = 0; p < num_producers; p++) {
+    producers.emplace_back([&pool, &done, per_producer]() {
+        for (std::size_t i = 0; i < per_producer; i++)
+          pool.Post([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+      });
+  }
+  for (auto& t : producers)
+    t.join();
+  while (done.load() < total)
+    std::this_thread::yield();
+  return total / sw.sec();
+}
+
+// TryPush() claims cells freed inside a Drain() before the head moves.
+// a PushBatch() right after must not take the ring for empty.
+bool MpscPushInDrain() {
+  cu::MpscRing<std::size_t> ring(4);
+  std::size_t next = 0;
+  for (std::size_t i = 0; i < 4; i++) {
+    std::size_t v = next++;
+    ring.TryPush(std::move(v));
+  }
+  std::size_t expect = 0;
+  bool ok = true;
+  bool pushed = false;
+  auto check = [&](std::size_t& v) {
+    ok = ok && v == expect++;
+    if (pushed || v != 2)  // two cells behind a head still at 0
+      return;
+    pushed = true;
+    std::size_t one = next;
+    std::size_t batch[3] = {next + 1, next + 2, next + 3};
+    if (ring.TryPush(std::move(one)))
+      next += 1 + ring.PushBatch(batch, 3);
+  };
+  while (expect < next && ring.Drain(check) > 0) { }
+  return ok && expect == next;
+}
+
+// producers alternate single and batch pushes, the caller drains a few at
+// a time. every producer's messages must come out once and in order.
+bool MpscMixedPush(std::size_t num_producers) {
+  const std::size_t per_producer = 1 << 18;
+  const std::size_t kBatch = 5;
+  cu::MpscRing<std::size_t> ring(64);
+  std::vector<std::thread> producers;
+  for (std::size_t p = 0; p < num_producers; p++) {
+    producers.emplace_back([&ring, p, per_producer]() {
+      const std::size_t base = p * per_producer;
+      for (std::size_t i = 0; i < per_producer;) {
+        if (i % 3 == 0) {
+          std::size_t v = base + i;
+          while (!ring.TryPush(std::move(v)))
+            std::this_thread::yield();
+          i++;
+          continue;
+        }
+        std::size_t batch[kBatch];
+        std::size_t n = 0;
+        for (; n < kBatch && i + n < per_producer; n++)
+          batch[n] = base + i + n;
+        for (std::size_t done = 0; done < n;) {
+          done += ring.PushBatch(batch + done, n - done);
+          if (done < n)
+            std::this_thread::yield();
+        }
+        i += n;
+      }
+    });
+  }
+  std::vector<std::size_t> next(num_producers, 0);
+  bool ok = true;
+  std::size_t received = 0;
+  while (received < per_producer * num_producers) {
+    std::size_t n = ring.Drain([&](std::size_t& v) {
+      const std::size_t p = v / per_producer;
+      ok = ok && p < num_producers && v % per_producer == next[p]++;
+    }, 3);
+    if (n == 0)
+      std::this_thread::yield();
+    received += n;
+  }
+  for (auto& t : producers)
+    t.join();
+  return ok && ring.empty();
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t num_workers = std::thread::hardware_concurrency();
+  if (argc > 1)
+    num_workers = std::strtoul(argv[1], nullptr, 10);
+  if (num_workers == 0)
+    num_workers = 1;
+
+  std::printf("workers: %zu\n", num_workers);
+  std::printf("%10s %16s %16s %16s\n",
+              "producers", "shared(task/s)", "stealing(task/s)",
+              "lockfree(task/s)");
+  for (std::size_t p = 1; p <= 64; p *= 2) {
+    std::printf("%10zu %16.0f %16.0f %16.0f\n", p,
+                Run(ThreadPool::Scheduling::kSharedQueue, num_workers, p),
+                Run(ThreadPool::Scheduling::kWorkStealing, num_workers, p),
+                Run(ThreadPool::Scheduling::kLockFree, num_workers, p));
+  }
+
+  const bool ok = MpscPushInDrain() && MpscMixedPush(4);
+  std::printf("MpscRing mixed TryPush/PushBatch: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// @file  record_reader_bench.cc
+//------------------------------------------------------------------------------
+// @brief std::getline + strutil::split vs RecordReader + strutil::split_view
+//        (mmap'ed and streamed), and Partition() on a ThreadPool.
+//        usage: record_reader_bench [file] (default: a generated 64 MB file)
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "parallel.h"
+#include "record_reader.h"
+#include "stopwatch.h"
+#include "strutil.h"
+
+
+namespace {
+
+namespace strutil = cu::strutil;
+
+const std::size_t kFileSize = 64 << 20;
+
+
+std::string MakeFile() {
+  std::string path = "/tmp/record_reader_bench.tsv";
+  std::ofstream out(path, std::ios::binary);
+  std::srand(1);
+  std::size_t written = 0;
+  std::string line;
+  while (written < kFileSize) {
+    line.clear();
+    for (int f = 0; f < 8; f++) {
+      if (f > 0)
+        line += '\t';
+      std::size_t len = 2 + std::rand() % 16;
+      for (std::size_t c = 0; c < len; c++)
+        line += static_cast<char>('a' + std::rand() % 26);
+    }
+    line += '\n';
+    out << line;
+    written += line.size();
+  }
+  return path;
+}
+
+// fields of one line summed up, so nothing is optimized away.
+std::size_t Fields(cu::StringView line) {
+  std::size_t n = 0;
+  for (cu::StringView f : strutil::split_view(line, '\t'))
+    n += f.size();
+  return n;
+}
+
+void Print(const char* name, std::size_t bytes, double sec, std::size_t sum) {
+  std::printf("%-22s %10.1f MB/s  (%zu)\n", name, bytes / sec / 1e6, sum);
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::string path = argc > 1 ? argv[1] : MakeFile();
+  cu::RecordReader probe(path);
+  const std::size_t bytes = probe.data().size();
+  std::printf("%s: %zu bytes\n", path.c_str(), bytes);
+
+  {
+    cu::Stopwatch sw;
+    std::ifstream in(path);
+    std::string line;
+    std::size_t sum = 0;
+    while (std::getline(in, line)) {
+      for (const auto& f : strutil::split(line, "\t"))
+        sum += f.size();
+    }
+    Print("getline + split", bytes, sw.sec(), sum);
+  }
+
+  const bool use_mmap[] = {true, false};
+  const char* names[] = {"RecordReader (mmap)", "RecordReader (read)"};
+  for (int m = 0; m < 2; m++) {
+    cu::Stopwatch sw;
+    cu::RecordReader::Options options;
+    options.use_mmap = use_mmap[m];
+    cu::RecordReader reader(path, options);
+    cu::StringView line;
+    std::size_t sum = 0;
+    while (reader.Next(&line))
+      sum += Fields(line);
+    Print(names[m], bytes, sw.sec(), sum);
+  }
+
+  {
+    std::size_t workers = std::thread::hardware_concurrency();
+    cu::ThreadPool pool(workers > 1 ? workers - 1 : 1);
+    cu::Stopwatch sw;
+    cu::RecordReader::Options options;
+    options.sequential = false;
+    cu::RecordReader reader(path, options);
+    auto ranges = reader.Partition(4 * (pool.num_threads() + 1));
+    std::atomic<std::size_t> sum{0};
+    cu::parallel_for(pool, std::size_t(0), ranges.size(), 1,
+                     [&](std::size_t i) {
+      auto part = cu::RecordReader::FromMemory(ranges[i]);
+      cu::StringView line;
+      std::size_t n = 0;
+      while (part.Next(&line))
+        n += Fields(line);
+      sum += n;
+    });
+    char name[64];
+    std::snprintf(name, sizeof(name), "Partition x%zu", ranges.size());
+    Print(name, bytes, sw.sec(), sum.load());
+  }
+  return 0;
+}
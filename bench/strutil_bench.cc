@@ -0,0 +1,291 @@
+//------------------------------------------------------------------------------
+// @file  strutil_bench.cc
+//------------------------------------------------------------------------------
+// @brief strutil::split (one std::string per field) vs strutil::split_view
+//        (no allocation) on tab separated log lines, and the scan kernels
+//        (scalar / sse2 / avx2) behind split_view, split_any_view and trim.
+//        chained strutil::replace calls vs one strutil::Replacer.
+//        building a mixed string with operator+ / std::to_string vs
+//        strutil::concat vs a reused StringBuilder.
+//        lowercased copies vs to_lower / iequals / ifind by kernel.
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "stopwatch.h"
+#include "strutil.h"
+
+
+namespace {
+
+namespace strutil = cu::strutil;
+
+const std::size_t kLines = 200000;
+const std::size_t kFields = 12;
+
+
+std::vector<std::string> MakeLines(const std::string& delim) {
+  std::vector<std::string> lines;
+  lines.reserve(kLines);
+  std::srand(1);
+  for (std::size_t i = 0; i < kLines; i++) {
+    std::string line;
+    for (std::size_t f = 0; f < kFields; f++) {
+      if (f > 0)
+        line += delim;
+      std::size_t len = 2 + std::rand() % 24;
+      for (std::size_t c = 0; c < len; c++)
+        line += static_cast<char>('a' + std::rand() % 26);
+    }
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+std::size_t TotalSize(const std::vector<std::string>& lines) {
+  std::size_t n = 0;
+  for (const auto& l : lines)
+    n += l.size();
+  return n;
+}
+
+// MB/s of 'body' over all lines. body returns a checksum.
+template <typename Body>
+double Measure(const std::vector<std::string>& lines, Body body,
+               std::size_t* checksum) {
+  cu::Stopwatch sw;
+  std::size_t sum = 0;
+  for (const auto& l : lines)
+    sum += body(l);
+  double sec = sw.sec();
+  *checksum = sum;
+  return TotalSize(lines) / sec / 1e6;
+}
+
+void Run(const char* name, const std::string& delim) {
+  std::vector<std::string> lines = MakeLines(delim);
+  std::size_t c1, c2, c3;
+  double split = Measure(lines, [&](const std::string& l) {
+      std::size_t n = 0;
+      for (const auto& f : strutil::split(l, delim))
+        n += f.size();
+      return n;
+    }, &c1);
+  double view = Measure(lines, [&](const std::string& l) {
+      std::size_t n = 0;
+      for (cu::StringView f : strutil::split_view(l, cu::StringView(delim)))
+        n += f.size();
+      return n;
+    }, &c2);
+  double view_char = 0;
+  c3 = c2;
+  if (delim.size() == 1) {
+    const char d = delim[0];
+    view_char = Measure(lines, [&](const std::string& l) {
+        std::size_t n = 0;
+        for (cu::StringView f : strutil::split_view(l, d))
+          n += f.size();
+        return n;
+      }, &c3);
+  }
+  char column[32] = "-";
+  if (delim.size() == 1)
+    std::snprintf(column, sizeof(column), "%.1f", view_char);
+  std::printf("%-12s %10.1f %12.1f %12s %s\n", name, split, view, column,
+              (c1 == c2 && c2 == c3) ? "" : "(MISMATCH)");
+}
+
+// lines with long fields and whitespace padding, so the scans dominate.
+std::vector<std::string> MakeWideLines() {
+  std::vector<std::string> lines;
+  lines.reserve(kLines / 4);
+  std::srand(2);
+  for (std::size_t i = 0; i < kLines / 4; i++) {
+    std::string line(std::rand() % 48, ' ');
+    for (std::size_t f = 0; f < kFields; f++) {
+      if (f > 0)
+        line += (f % 3 == 0) ? ',' : '\t';
+      std::size_t len = 16 + std::rand() % 96;
+      for (std::size_t c = 0; c < len; c++)
+        line += static_cast<char>('a' + std::rand() % 26);
+    }
+    line.append(std::rand() % 48, ' ');
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+void RunKernels() {
+  std::vector<std::string> lines = MakeWideLines();
+  std::printf("\n%-12s %10s %12s %12s\n", "kernel", "view('\\t')",
+              "split_any", "trim_view");
+  const cu::scan::Kernel kernels[] = {
+    cu::scan::Kernel::kScalar,
+    cu::scan::Kernel::kSse2,
+    cu::scan::Kernel::kAvx2,
+  };
+  std::size_t expect[3] = {0, 0, 0};
+  for (std::size_t k = 0; k < 3; k++) {
+    if (!cu::scan::set_kernel(kernels[k]))
+      continue;
+    std::size_t c[3];
+    double view = Measure(lines, [&](const std::string& l) {
+        std::size_t n = 0;
+        for (cu::StringView f : strutil::split_view(l, '\t'))
+          n += f.size();
+        return n;
+      }, &c[0]);
+    double any = Measure(lines, [&](const std::string& l) {
+        std::size_t n = 0;
+        for (cu::StringView f : strutil::split_any_view(l, "\t,"))
+          n += f.size();
+        return n;
+      }, &c[1]);
+    double trim = Measure(lines, [&](const std::string& l) {
+        return strutil::trim_view(l).size();
+      }, &c[2]);
+    bool same = true;
+    for (std::size_t i = 0; i < 3; i++) {
+      if (k == 0)
+        expect[i] = c[i];
+      same = same && expect[i] == c[i];
+    }
+    std::printf("%-12s %10.1f %12.1f %12.1f %s\n", cu::scan::kernel_name(),
+                view, any, trim, same ? "" : "(MISMATCH)");
+  }
+}
+
+// html escaping: 5 chained replace() calls vs one Replacer pass.
+void RunReplace() {
+  std::vector<std::string> lines = MakeWideLines();
+  for (std::size_t i = 0; i < lines.size(); i++) {
+    for (std::size_t j = i % 7; j < lines[i].size(); j += 13)
+      lines[i][j] = "<>&\"'"[j % 5];
+  }
+  const std::vector<strutil::Replacer::Pair> pairs = {
+    {"&", "&amp;"}, {"<", "&lt;"}, {">", "&gt;"}, {"\"", "&quot;"},
+    {"'", "&#39;"},
+  };
+  std::size_t c1, c2;
+  double chained = Measure(lines, [&](const std::string& l) {
+      std::string s = l;
+      for (const auto& p : pairs)
+        s = strutil::replace(s, p.first, p.second);
+      return s.size();
+    }, &c1);
+  strutil::Replacer replacer(pairs);
+  std::string out;
+  double single = Measure(lines, [&](const std::string& l) {
+      replacer.Apply(l, &out);
+      return out.size();
+    }, &c2);
+  std::printf("\n%-12s %10s %12s\n", "html escape", "chained", "Replacer");
+  std::printf("%-12s %10.1f %12.1f %s\n", "", chained, single,
+              c1 == c2 ? "" : "(MISMATCH)");
+}
+
+// case insensitive matching: comparing lowercased copies (what callers did
+// before) vs the kernels.
+void RunCase() {
+  std::vector<std::string> lines = MakeWideLines();
+  std::vector<std::string> upper(lines);
+  for (auto& l : upper)
+    strutil::to_upper(&l);
+  const std::string needle = "needle";
+  auto lower_copy = [](const std::string& s) {
+    std::string r = s;
+    std::transform(r.begin(), r.end(), r.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return r;
+  };
+  std::size_t i = 0, c0;
+  double copies = Measure(lines, [&](const std::string& l) {
+      const std::string& u = upper[i++ % upper.size()];
+      return static_cast<std::size_t>(lower_copy(l) == lower_copy(u)) +
+             lower_copy(l).find(needle);
+    }, &c0);
+  std::printf("\n%-12s %10s %12s %12s %12s\n", "case", "to_lower",
+              "iequals", "ifind", "(copies)");
+  const cu::scan::Kernel kernels[] = {
+    cu::scan::Kernel::kScalar,
+    cu::scan::Kernel::kSse2,
+    cu::scan::Kernel::kAvx2,
+  };
+  std::vector<char> buf(4096);
+  for (std::size_t k = 0; k < 3; k++) {
+    if (!cu::scan::set_kernel(kernels[k]))
+      continue;
+    std::size_t c[3];
+    double lower = Measure(lines, [&](const std::string& l) {
+        if (buf.size() < l.size())
+          buf.resize(l.size());
+        strutil::to_lower(l, buf.data());
+        return static_cast<std::size_t>(buf[0]);
+      }, &c[0]);
+    i = 0;
+    double eq = Measure(lines, [&](const std::string& l) {
+        return static_cast<std::size_t>(
+            strutil::iequals(l, upper[i++ % upper.size()]));
+      }, &c[1]);
+    double find = Measure(lines, [&](const std::string& l) {
+        return strutil::ifind(l, needle);
+      }, &c[2]);
+    std::printf("%-12s %10.1f %12.1f %12.1f %12.1f %s\n",
+                cu::scan::kernel_name(), lower, eq, find, copies,
+                c[1] + c[2] == c0 ? "" : "(MISMATCH)");
+  }
+}
+
+// ns per built string: "GET <path> <status> <ms>ms <ratio>"
+void RunBuild() {
+  const std::size_t kReps = 1000000;
+  const std::string path = "/api/v1/items/42";
+  std::size_t c1 = 0, c2 = 0, c3 = 0;
+  cu::Stopwatch sw;
+  for (std::size_t i = 0; i < kReps; i++) {
+    std::string s = "GET " + path + " " + std::to_string(200 + i % 300) +
+                    " " + std::to_string(i) + "ms " +
+                    std::to_string(i * 0.25);
+    c1 += s.size();
+  }
+  double plus = sw.nsec() / kReps;
+  sw.Reset();
+  for (std::size_t i = 0; i < kReps; i++) {
+    std::string s = strutil::concat("GET ", path, ' ', 200 + i % 300, ' ', i,
+                                    "ms ", i * 0.25);
+    c2 += s.size();
+  }
+  double concat = sw.nsec() / kReps;
+  sw.Reset();
+  for (std::size_t i = 0; i < kReps; i++) {
+    cu::StringBuilder sb;
+    sb.Append("GET ", path, ' ', 200 + i % 300, ' ', i, "ms ", i * 0.25);
+    c3 += sb.size();
+  }
+  double builder = sw.nsec() / kReps;
+  // (to_string prints 6 decimals, the others the shortest exact form)
+  std::printf("\n%-12s %10s %12s %12s\n", "build (ns)", "operator+",
+              "concat", "StringBuilder");
+  std::printf("%-12s %10.1f %12.1f %12.1f %s\n", "", plus, concat, builder,
+              c2 == c3 ? "" : "(MISMATCH)");
+  (void)c1;
+}
+
+}  // namespace
+
+
+int main() {
+  std::printf("%zu lines x %zu fields, MB/s\n", kLines, kFields);
+  std::printf("%-12s %10s %12s %12s\n", "delim", "split", "split_view",
+              "view(char)");
+  Run("'\\t'", "\t");
+  Run("\" | \"", " | ");
+  RunKernels();
+  RunReplace();
+  RunBuild();
+  RunCase();
+  return 0;
+}
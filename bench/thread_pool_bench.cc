@@ -0,0 +1,97 @@
+//------------------------------------------------------------------------------
+// @file  thread_pool_bench.cc
+//------------------------------------------------------------------------------
+// @brief microtask throughput of ThreadPool for each scheduling mode.
+//        every root task spawns its children from inside the pool, so the
+//        work stealing mode runs them on the local deque.
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include "thread_pool.h"
+#include "stopwatch.h"
+
+
+namespace {
+
+using cu::ThreadPool;
+
+const std::size_t kRootTasks  = 256;
+const std::size_t kChildTasks = 2000;
+const int kSpin = 200;  // work per microtask
+
+
+struct Latch {
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::atomic<std::size_t> remain;
+
+  explicit Latch(std::size_t n) : mtx{}, cond{}, remain{n} { }
+
+  void CountDown() {
+    if (remain.fetch_sub(1) == 1) {
+      std::unique_lock<std::mutex> lock(mtx);
+      cond.notify_all();
+    }
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return remain == 0; });
+  }
+};
+
+
+void Microtask(Latch* latch) {
+  volatile int sink = 0;
+  for (int i = 0; i < kSpin; i++)
+    sink = sink + i;
+  latch->CountDown();
+}
+
+
+double Run(std::size_t num_threads, ThreadPool::Scheduling scheduling) {
+  Latch latch{kRootTasks * kChildTasks};
+  cu::Stopwatch sw;
+  {
+    ThreadPool pool{num_threads, scheduling};
+    for (std::size_t r = 0; r < kRootTasks; r++) {
+      pool.Enqueue([&pool, &latch]() {
+          for (std::size_t c = 0; c < kChildTasks; c++)
+            pool.Enqueue(Microtask, &latch);
+        });
+    }
+    latch.Wait();
+  }
+  return (kRootTasks * kChildTasks) / sw.sec();
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t max_threads = std::thread::hardware_concurrency();
+  if (argc > 1)
+    max_threads = std::strtoul(argv[1], nullptr, 10);
+  if (max_threads == 0)
+    max_threads = 1;
+
+  std::printf("%8s %16s %16s %8s\n",
+              "threads", "shared(task/s)", "stealing(task/s)", "speedup");
+  double base = 0.0;
+  for (std::size_t n = 1; ; n = std::min(n * 2, max_threads)) {
+    double shared = Run(n, ThreadPool::Scheduling::kSharedQueue);
+    double stealing = Run(n, ThreadPool::Scheduling::kWorkStealing);
+    if (n == 1)
+      base = stealing;
+    std::printf("%8zu %16.0f %16.0f %7.2fx\n",
+                n, shared, stealing, stealing / base);
+    if (n == max_threads)
+      break;
+  }
+  return 0;
+}
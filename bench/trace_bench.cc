@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// @file  trace_bench.cc
+//------------------------------------------------------------------------------
+// @brief cost of a TraceSpan with tracing off and on, and of tracing on
+//        ThreadPool throughput. writes a small pool trace if given a path.
+//        usage: trace_bench [trace.json]
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include "stopwatch.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+
+namespace {
+
+using cu::ThreadPool;
+
+const std::size_t kSpans = 1 << 22;
+const std::size_t kTasks = 1 << 20;
+
+
+// ns per span around an (almost) empty body.
+double Spans() {
+  std::atomic<std::size_t> sink{0};
+  cu::Stopwatch sw;
+  for (std::size_t i = 0; i < kSpans; i++) {
+    cu::TraceSpan span("span");
+    sink.store(i, std::memory_order_relaxed);
+  }
+  return sw.nsec() / kSpans;
+}
+
+// tasks per second.
+double Tasks(std::size_t num_workers, std::size_t count) {
+  ThreadPool pool{num_workers};
+  std::atomic<std::size_t> done{0};
+  cu::Stopwatch sw;
+  for (std::size_t i = 0; i < count; i++) {
+    pool.Post([&done]() {
+      cu::TraceSpan span("work");
+      done.fetch_add(1, std::memory_order_relaxed);
+    });
+  }
+  while (done.load() < count)
+    std::this_thread::yield();
+  return count / sw.sec();
+}
+
+}  // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::size_t workers = std::thread::hardware_concurrency();
+  if (workers < 2)
+    workers = 2;
+
+  double off = Spans();
+  cu::Tracer::Enable();
+  double on = Spans();
+  cu::Tracer::Disable();
+  std::printf("TraceSpan: off %.2f ns, on %.2f ns\n", off, on);
+
+  double tasks_off = Tasks(workers, kTasks);
+  cu::Tracer::Enable();
+  double tasks_on = Tasks(workers, kTasks);
+  cu::Tracer::Disable();
+  std::printf("ThreadPool x%zu: tracing off %.0f tasks/s, on %.0f tasks/s\n",
+              workers, tasks_off, tasks_on);
+
+  if (argc > 1) {
+    cu::Tracer::Clear();
+    cu::Tracer::SetThreadName("main");
+    cu::Tracer::Enable();
+    {
+      cu::TraceSpan span("post 1000 tasks");
+      Tasks(workers, 1000);
+    }
+    cu::Tracer::Disable();
+    cu::Tracer::WriteChromeJson(argv[1]);
+    std::printf("trace written to %s\n", argv[1]);
+  }
+  return 0;
+}
@@ -0,0 +1,517 @@
+//------------------------------------------------------------------------------
+// @file  char_scan.h
+//------------------------------------------------------------------------------
+// @brief SIMD byte scanning (one char, or a set of chars) and ascii case
+//        folding for strutil.
+//------------------------------------------------------------------------------
+// every kernel has a scalar, an SSE2 (16 bytes per step) and an AVX2 (32 bytes
+// per step) version. the best one the cpu supports is picked at run time, so
+// the library is still built for plain x86-64 (or any other cpu, where only
+// the scalar version exists). the last partial block is scanned bytewise, the
+// kernels never read past the end of the input.
+// @code
+// cu::CharSet ws(" \r\t\n");
+// std::size_t b = cu::scan::find_first_not_of(line, ws);
+// cu::scan::to_lower(header, buf);             // buf has header.size() chars
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_CHAR_SCAN_H_
+#define CPPUTIL_CHAR_SCAN_H_
+#include <atomic>        // for std::atomic
+#include <cstddef>       // for std::size_t
+#include <cstdint>       // for std::uint64_t
+#include <cstring>       // for std::memchr
+#include "string_view.h"  // for cu::StringView
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__SSE2__)
+#define CPPUTIL_SCAN_X86 1
+#include <immintrin.h>
+#endif
+#endif
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class CharSet
+//------------------------------------------------------------------------------
+// set of bytes. a bitmap answers contains(), the SIMD kernels compare against
+// each member, so they are used for sets of up to kMaxSimd chars. (larger sets
+// fall back to the bitmap)
+//------------------------------------------------------------------------------
+class CharSet {
+ public:
+  static constexpr std::size_t kMaxSimd = 8;
+
+ public:
+  CharSet() : bits_{0, 0, 0, 0}, chars_{}, size_{0} { }
+
+  explicit CharSet(StringView chars) : CharSet() {
+    for (char c : chars)
+      insert(c);
+  }
+
+  void insert(char c) {
+    if (contains(c))
+      return;
+    unsigned char u = static_cast<unsigned char>(c);
+    bits_[u >> 6] |= std::uint64_t(1) << (u & 63);
+    if (size_ < kMaxSimd)
+      chars_[size_] = c;
+    size_++;
+  }
+
+  bool contains(char c) const {
+    unsigned char u = static_cast<unsigned char>(c);
+    return (bits_[u >> 6] >> (u & 63)) & 1;
+  }
+
+  // number of distinct chars.
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool simd() const {
+    return size_ > 0 && size_ <= kMaxSimd;
+  }
+
+  // members, valid if simd().
+  const char* chars() const {
+    return chars_;
+  }
+
+ private:
+  std::uint64_t bits_[4];
+  char chars_[kMaxSimd];
+  std::size_t size_;
+};
+
+
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// scalar kernels. (return n when nothing is found)
+//------------------------------------------------------------------------------
+inline std::size_t ScalarFindChar(const char* p, std::size_t n, char c) {
+  const void* r = std::memchr(p, c, n);
+  return r ? static_cast<const char*>(r) - p : n;
+}
+
+inline std::size_t ScalarFindOf(const char* p, std::size_t n,
+                                const CharSet& set, bool in) {
+  for (std::size_t i = 0; i < n; i++) {
+    if (set.contains(p[i]) == in)
+      return i;
+  }
+  return n;
+}
+
+// (from the back. returns n when nothing is found)
+inline std::size_t ScalarFindLastNotOf(const char* p, std::size_t n,
+                                       const CharSet& set) {
+  for (std::size_t i = n; i > 0; i--) {
+    if (!set.contains(p[i - 1]))
+      return i - 1;
+  }
+  return n;
+}
+
+// ascii letters in [lo, lo + 26) get bit 0x20 flipped, everything else is
+// copied as it is. (lo 'A': to lower case, 'a': to upper case)
+inline char FlipCase(char c, char lo) {
+  unsigned char u = static_cast<unsigned char>(c);
+  unsigned in = static_cast<unsigned char>(u - lo) < 26;
+  return static_cast<char>(u ^ (in << 5));
+}
+
+// (dst may be src)
+inline void ScalarFoldCase(const char* src, char* dst, std::size_t n,
+                           char lo) {
+  for (std::size_t i = 0; i < n; i++)
+    dst[i] = FlipCase(src[i], lo);
+}
+
+inline bool ScalarEqualNoCase(const char* a, const char* b, std::size_t n) {
+  for (std::size_t i = 0; i < n; i++) {
+    if (FlipCase(a[i], 'A') != FlipCase(b[i], 'A'))
+      return false;
+  }
+  return true;
+}
+
+
+#if defined(CPPUTIL_SCAN_X86)
+
+//------------------------------------------------------------------------------
+// SSE2 kernels. (x86-64 baseline, no dispatch needed)
+//------------------------------------------------------------------------------
+inline unsigned Sse2Match(__m128i v, const __m128i* needles, std::size_t k) {
+  __m128i m = _mm_cmpeq_epi8(v, needles[0]);
+  for (std::size_t j = 1; j < k; j++)
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, needles[j]));
+  return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+inline std::size_t Sse2FindChar(const char* p, std::size_t n, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+  return i + ScalarFindChar(p + i, n - i, c);
+}
+
+// in: first byte in the set, otherwise first byte not in the set.
+inline std::size_t Sse2FindOf(const char* p, std::size_t n,
+                              const CharSet& set, bool in) {
+  if (!set.simd())
+    return ScalarFindOf(p, n, set, in);
+  __m128i needles[CharSet::kMaxSimd];
+  const std::size_t k = set.size();
+  for (std::size_t j = 0; j < k; j++)
+    needles[j] = _mm_set1_epi8(set.chars()[j]);
+  const unsigned flip = in ? 0 : 0xffff;
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    unsigned m = Sse2Match(v, needles, k) ^ flip;
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+  return i + ScalarFindOf(p + i, n - i, set, in);
+}
+
+inline std::size_t Sse2FindLastNotOf(const char* p, std::size_t n,
+                                     const CharSet& set) {
+  if (!set.simd())
+    return ScalarFindLastNotOf(p, n, set);
+  __m128i needles[CharSet::kMaxSimd];
+  const std::size_t k = set.size();
+  for (std::size_t j = 0; j < k; j++)
+    needles[j] = _mm_set1_epi8(set.chars()[j]);
+  std::size_t i = n;
+  for (; i >= 16; i -= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 16));
+    unsigned m = Sse2Match(v, needles, k) ^ 0xffff;
+    if (m)
+      return i - 16 + (31 - __builtin_clz(m));
+  }
+  std::size_t r = ScalarFindLastNotOf(p, i, set);
+  return r == i ? n : r;
+}
+
+// (x + 0x80 - lo) < -128 + 26 as signed bytes, for x in [lo, lo + 26).
+inline __m128i Sse2FlipCase(__m128i v, char lo) {
+  __m128i s = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - lo)));
+  __m128i in = _mm_cmplt_epi8(s, _mm_set1_epi8(-128 + 26));
+  return _mm_xor_si128(v, _mm_and_si128(in, _mm_set1_epi8(0x20)));
+}
+
+inline void Sse2FoldCase(const char* src, char* dst, std::size_t n, char lo) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     Sse2FlipCase(v, lo));
+  }
+  ScalarFoldCase(src + i, dst + i, n - i, lo);
+}
+
+inline bool Sse2EqualNoCase(const char* a, const char* b, std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    __m128i eq = _mm_cmpeq_epi8(Sse2FlipCase(va, 'A'), Sse2FlipCase(vb, 'A'));
+    if (_mm_movemask_epi8(eq) != 0xffff)
+      return false;
+  }
+  return ScalarEqualNoCase(a + i, b + i, n - i);
+}
+
+
+//------------------------------------------------------------------------------
+// AVX2 kernels. compiled for avx2 only inside these functions, called only
+// when the cpu has it.
+//------------------------------------------------------------------------------
+#define CPPUTIL_AVX2 __attribute__((target("avx2")))
+
+CPPUTIL_AVX2 inline unsigned Avx2Match(__m256i v, const __m256i* needles,
+                                       std::size_t k) {
+  __m256i m = _mm256_cmpeq_epi8(v, needles[0]);
+  for (std::size_t j = 1; j < k; j++)
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, needles[j]));
+  return static_cast<unsigned>(_mm256_movemask_epi8(m));
+}
+
+CPPUTIL_AVX2 inline std::size_t Avx2FindChar(const char* p, std::size_t n,
+                                             char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+  return i + Sse2FindChar(p + i, n - i, c);
+}
+
+CPPUTIL_AVX2 inline std::size_t Avx2FindOf(const char* p, std::size_t n,
+                                           const CharSet& set, bool in) {
+  if (!set.simd())
+    return ScalarFindOf(p, n, set, in);
+  __m256i needles[CharSet::kMaxSimd];
+  const std::size_t k = set.size();
+  for (std::size_t j = 0; j < k; j++)
+    needles[j] = _mm256_set1_epi8(set.chars()[j]);
+  const unsigned flip = in ? 0 : 0xffffffffu;
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    unsigned m = Avx2Match(v, needles, k) ^ flip;
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+  return i + Sse2FindOf(p + i, n - i, set, in);
+}
+
+CPPUTIL_AVX2 inline std::size_t Avx2FindLastNotOf(const char* p,
+                                                  std::size_t n,
+                                                  const CharSet& set) {
+  if (!set.simd())
+    return ScalarFindLastNotOf(p, n, set);
+  __m256i needles[CharSet::kMaxSimd];
+  const std::size_t k = set.size();
+  for (std::size_t j = 0; j < k; j++)
+    needles[j] = _mm256_set1_epi8(set.chars()[j]);
+  std::size_t i = n;
+  for (; i >= 32; i -= 32) {
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(p + i - 32));
+    unsigned m = Avx2Match(v, needles, k) ^ 0xffffffffu;
+    if (m)
+      return i - 32 + (31 - __builtin_clz(m));
+  }
+  std::size_t r = Sse2FindLastNotOf(p, i, set);
+  return r == i ? n : r;
+}
+
+CPPUTIL_AVX2 inline __m256i Avx2FlipCase(__m256i v, char lo) {
+  __m256i s = _mm256_add_epi8(v,
+                              _mm256_set1_epi8(static_cast<char>(0x80 - lo)));
+  __m256i in = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), s);
+  return _mm256_xor_si256(v, _mm256_and_si256(in, _mm256_set1_epi8(0x20)));
+}
+
+CPPUTIL_AVX2 inline void Avx2FoldCase(const char* src, char* dst,
+                                      std::size_t n, char lo) {
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        Avx2FlipCase(v, lo));
+  }
+  Sse2FoldCase(src + i, dst + i, n - i, lo);
+}
+
+CPPUTIL_AVX2 inline bool Avx2EqualNoCase(const char* a, const char* b,
+                                         std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    __m256i eq = _mm256_cmpeq_epi8(Avx2FlipCase(va, 'A'),
+                                   Avx2FlipCase(vb, 'A'));
+    if (static_cast<unsigned>(_mm256_movemask_epi8(eq)) != 0xffffffffu)
+      return false;
+  }
+  return Sse2EqualNoCase(a + i, b + i, n - i);
+}
+
+#undef CPPUTIL_AVX2
+
+#endif  // CPPUTIL_SCAN_X86
+
+
+// one set of kernels. ScanKernelTable() is indexed by scan::Kernel.
+struct ScanKernels {
+  const char* name;
+  std::size_t (*find_char)(const char*, std::size_t, char);
+  std::size_t (*find_of)(const char*, std::size_t, const CharSet&, bool);
+  std::size_t (*find_last_not_of)(const char*, std::size_t, const CharSet&);
+  void (*fold_case)(const char*, char*, std::size_t, char);
+  bool (*equal_nocase)(const char*, const char*, std::size_t);
+};
+
+inline const ScanKernels* ScanKernelTable() {
+  static const ScanKernels table[] = {
+    {"scalar", &ScalarFindChar, &ScalarFindOf, &ScalarFindLastNotOf,
+     &ScalarFoldCase, &ScalarEqualNoCase},
+#if defined(CPPUTIL_SCAN_X86)
+    {"sse2", &Sse2FindChar, &Sse2FindOf, &Sse2FindLastNotOf,
+     &Sse2FoldCase, &Sse2EqualNoCase},
+    {"avx2", &Avx2FindChar, &Avx2FindOf, &Avx2FindLastNotOf,
+     &Avx2FoldCase, &Avx2EqualNoCase},
+#endif
+  };
+  return table;
+}
+
+inline bool CpuHasAvx2() {
+#if defined(CPPUTIL_SCAN_X86)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+// index of the best kernel the cpu supports.
+inline int BestScanKernel() {
+#if defined(CPPUTIL_SCAN_X86)
+  return CpuHasAvx2() ? 2 : 1;
+#else
+  return 0;
+#endif
+}
+
+// kernels in use. the best supported ones until scan::set_kernel().
+inline std::atomic<const ScanKernels*>& ActiveScanKernels() {
+  static std::atomic<const ScanKernels*> active{
+      ScanKernelTable() + BestScanKernel()};
+  return active;
+}
+
+inline const ScanKernels& ScanKernelsInUse() {
+  return *ActiveScanKernels().load(std::memory_order_relaxed);
+}
+
+
+}  // namespace detail
+
+
+namespace scan {
+
+
+constexpr std::size_t npos = StringView::npos;
+
+enum class Kernel {
+  kScalar,
+  kSse2,
+  kAvx2,
+};
+
+
+//------------------------------------------------------------------------------
+// @brief true if the cpu (and the build) can run the kernel.
+//------------------------------------------------------------------------------
+inline bool supported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::kScalar:
+      return true;
+#if defined(CPPUTIL_SCAN_X86)
+    case Kernel::kSse2:
+      return true;
+    case Kernel::kAvx2:
+      return detail::CpuHasAvx2();
+#endif
+    default:
+      return false;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// @brief use a specific kernel. (for benchmarks and tests)
+// @return false if it isn't supported, the current one is kept then.
+//------------------------------------------------------------------------------
+inline bool set_kernel(Kernel kernel) {
+  if (!supported(kernel))
+    return false;
+  detail::ActiveScanKernels().store(
+      detail::ScanKernelTable() + static_cast<int>(kernel));
+  return true;
+}
+
+// name of the kernel in use. ("scalar", "sse2", "avx2")
+inline const char* kernel_name() {
+  return detail::ScanKernelsInUse().name;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief position of the first c at or after pos. npos if there is none.
+//------------------------------------------------------------------------------
+inline std::size_t find_char(StringView s, char c, std::size_t pos = 0) {
+  if (pos >= s.size())
+    return npos;
+  std::size_t n = s.size() - pos;
+  std::size_t i = detail::ScanKernelsInUse().find_char(s.data() + pos, n, c);
+  return i == n ? npos : pos + i;
+}
+
+inline std::size_t find_first_of(StringView s, const CharSet& set,
+                                 std::size_t pos = 0) {
+  if (pos >= s.size())
+    return npos;
+  std::size_t n = s.size() - pos;
+  std::size_t i = detail::ScanKernelsInUse().find_of(s.data() + pos, n,
+                                                     set, true);
+  return i == n ? npos : pos + i;
+}
+
+inline std::size_t find_first_not_of(StringView s, const CharSet& set,
+                                     std::size_t pos = 0) {
+  if (pos >= s.size())
+    return npos;
+  std::size_t n = s.size() - pos;
+  std::size_t i = detail::ScanKernelsInUse().find_of(s.data() + pos, n,
+                                                     set, false);
+  return i == n ? npos : pos + i;
+}
+
+inline std::size_t find_last_not_of(StringView s, const CharSet& set) {
+  std::size_t i = detail::ScanKernelsInUse().find_last_not_of(s.data(),
+                                                              s.size(), set);
+  return i == s.size() ? npos : i;
+}
+
+
+//------------------------------------------------------------------------------
+// ascii case. bytes other than 'A'-'Z' / 'a'-'z' (utf-8 included) are left
+// as they are, the locale is not used.
+//------------------------------------------------------------------------------
+inline char to_lower(char c) {
+  return detail::FlipCase(c, 'A');
+}
+
+inline char to_upper(char c) {
+  return detail::FlipCase(c, 'a');
+}
+
+// s into dst, which holds s.size() chars. (dst may be s.data())
+inline void to_lower(StringView s, char* dst) {
+  detail::ScanKernelsInUse().fold_case(s.data(), dst, s.size(), 'A');
+}
+
+inline void to_upper(StringView s, char* dst) {
+  detail::ScanKernelsInUse().fold_case(s.data(), dst, s.size(), 'a');
+}
+
+// true if a and b only differ in ascii case.
+inline bool equal_nocase(StringView a, StringView b) {
+  return a.size() == b.size() &&
+         detail::ScanKernelsInUse().equal_nocase(a.data(), b.data(), a.size());
+}
+
+
+}  // namespace scan
+}  // namespace cu
+#endif  // CPPUTIL_CHAR_SCAN_H_
@@ -0,0 +1,377 @@
+//------------------------------------------------------------------------------
+// @file  coroutine.h
+//------------------------------------------------------------------------------
+// @brief c++20 coroutine task type and awaitables for ThreadPool.
+//------------------------------------------------------------------------------
+// Task<T> is a lazy coroutine. it starts when it is awaited (or spawned) and
+// resumes its awaiter when it finishes, without any thread blocking.
+//   co_await pool.schedule()          : continue on a worker of the pool
+//   co_await resume_on(pool, future)  : wait for a cu::Future, then continue
+//                                       on the pool
+//   co_await sleep_for(pool, d)       : continue on the pool after d
+// spawn() starts a task from non-coroutine code and returns a cu::Future.
+// @code
+// cu::Task<int> Load(cu::ThreadPool& pool, std::string path) {
+//   co_await pool.schedule();
+//   Blob b = co_await cu::resume_on(pool, io.Read(path));
+//   co_return Parse(b);
+// }
+// cu::Future<int> f = cu::spawn(Load(pool, "a.txt"));
+// @endcode
+// this header is empty unless it is compiled as c++20. ('make coro')
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_COROUTINE_H_
+#define CPPUTIL_COROUTINE_H_
+#include "future.h"       // for cu::Future
+#include "thread_pool.h"  // for cu::ThreadPool
+#include "timer_queue.h"  // for cu::TimerQueue
+
+#if defined(CPPUTIL_HAS_COROUTINES)
+#include <chrono>     // for std::chrono::duration
+#include <coroutine>  // for std::coroutine_handle
+#include <exception>  // for std::exception_ptr
+#include <utility>    // for std::move
+
+
+namespace cu {
+
+
+template <typename T = void> class Task;
+
+
+namespace detail {
+
+
+// resume a suspended coroutine. (a pool/timer task)
+struct ResumeTask {
+  std::coroutine_handle<> handle;
+  void operator()() { handle.resume(); }
+};
+
+
+// a finished Task transfers control straight to its awaiter.
+struct TaskFinalAwaiter {
+  bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> h) noexcept {
+    std::coroutine_handle<> next = h.promise().continuation;
+    return next ? next : std::noop_coroutine();
+  }
+
+  void await_resume() const noexcept { }
+};
+
+
+class TaskPromiseBase {
+ public:
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  TaskFinalAwaiter final_suspend() const noexcept { return {}; }
+
+  void unhandled_exception() noexcept {
+    error_ = std::current_exception();
+  }
+
+  std::coroutine_handle<> continuation;
+
+ protected:
+  void Rethrow() {
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+ private:
+  std::exception_ptr error_;
+};
+
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object() noexcept;
+
+  template <typename U>
+  void return_value(U&& v) {
+    value_.Set(std::forward<U>(v));
+  }
+
+  T Take() {
+    Rethrow();
+    return value_.Take();
+  }
+
+ private:
+  ValueSlot<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object() noexcept;
+
+  void return_void() noexcept { }
+
+  void Take() {
+    Rethrow();
+  }
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class Task<T>
+//------------------------------------------------------------------------------
+// move-only owner of a coroutine frame. 'co_await std::move(task)' (or
+// 'co_await F()') runs it and returns its result, or rethrows its exception.
+//------------------------------------------------------------------------------
+template <typename T>
+class Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+ public:
+  Task() noexcept : handle_{} { }
+  explicit Task(Handle handle) noexcept : handle_{handle} { }
+  Task(Task&& other) noexcept : handle_{other.handle_} {
+    other.handle_ = nullptr;
+  }
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_)
+        handle_.destroy();
+      handle_ = other.handle_;
+      other.handle_ = nullptr;
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+ public:
+  bool valid() const noexcept {
+    return static_cast<bool>(handle_);
+  }
+
+  bool done() const noexcept {
+    return handle_ && handle_.done();
+  }
+
+  struct Awaiter {
+    Handle handle;
+
+    bool await_ready() const noexcept {
+      return handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> awaiter) noexcept {
+      handle.promise().continuation = awaiter;
+      return handle;
+    }
+
+    T await_resume() {
+      return handle.promise().Take();
+    }
+  };
+
+  Awaiter operator co_await() && noexcept {
+    return Awaiter{handle_};
+  }
+
+ private:
+  Handle handle_;
+};
+
+
+namespace detail {
+
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+
+// coroutine which starts at once and frees itself when it finishes.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() noexcept { }
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+template <typename T>
+inline Detached RunDetached(Task<T> task, Promise<T> promise) {
+  try {
+    promise.set_value(co_await std::move(task));
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+inline Detached RunDetached(Task<void> task, Promise<void> promise) {
+  try {
+    co_await std::move(task);
+    promise.set_value();
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief start a task on this thread. it runs until its first suspension.
+//        the result (or exception) is delivered through cu::Future.
+//------------------------------------------------------------------------------
+template <typename T>
+inline Future<T> spawn(Task<T> task) {
+  Promise<T> promise;
+  Future<T> result = promise.get_future();
+  detail::RunDetached(std::move(task), std::move(promise));
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief run a task and block until it finishes. (for main(), tests)
+//------------------------------------------------------------------------------
+template <typename T>
+inline T sync_wait(Task<T> task) {
+  return spawn(std::move(task)).get();
+}
+
+
+//------------------------------------------------------------------------------
+// @class ThreadPool::ScheduleAwaiter
+// @brief result of pool.schedule(). a stopped pool throws from co_await.
+//------------------------------------------------------------------------------
+class ThreadPool::ScheduleAwaiter {
+ public:
+  explicit ScheduleAwaiter(ThreadPool& pool) noexcept : pool_{&pool} { }
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    pool_->Post(detail::ResumeTask{h});
+  }
+
+  void await_resume() const noexcept { }
+
+ private:
+  ThreadPool* pool_;
+};
+
+inline ThreadPool::ScheduleAwaiter ThreadPool::schedule() {
+  return ScheduleAwaiter(*this);
+}
+
+
+//------------------------------------------------------------------------------
+// @class FutureAwaiter<T, Executor>
+//------------------------------------------------------------------------------
+// result of resume_on(). the coroutine is resumed on the executor once the
+// future is ready (at once, on this thread, if it already is). if the executor
+// refuses the task, it is resumed wherever the future became ready.
+//------------------------------------------------------------------------------
+template <typename T, typename Executor>
+class FutureAwaiter {
+ public:
+  FutureAwaiter(Executor& executor, Future<T>&& future)
+      : executor_{&executor}, future_{std::move(future)} { }
+
+  bool await_ready() const {
+    return future_.is_ready();
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    using Schedule = detail::ScheduleTask<Executor, detail::ResumeTask>;
+    detail::FutureAccess::state(future_)->OnReady(
+        Schedule{executor_, detail::ResumeTask{h}});
+  }
+
+  T await_resume() {
+    return future_.get();
+  }
+
+ private:
+  Executor* executor_;
+  Future<T> future_;
+};
+
+template <typename T, typename Executor>
+inline FutureAwaiter<T, Executor> resume_on(Executor& executor,
+                                            Future<T>&& future) {
+  if (!future.valid())
+    throw std::future_error(std::future_errc::no_state);
+  return FutureAwaiter<T, Executor>(executor, std::move(future));
+}
+
+
+//------------------------------------------------------------------------------
+// @class TimerAwaiter<Executor>
+// @brief result of sleep_until()/sleep_for(). no thread is blocked meanwhile.
+//------------------------------------------------------------------------------
+template <typename Executor>
+class TimerAwaiter {
+ public:
+  TimerAwaiter(Executor& executor, TimerQueue& timers,
+               TimerQueue::TimePoint when)
+      : executor_{&executor}, timers_{&timers}, when_{when} { }
+
+  bool await_ready() const {
+    return TimerQueue::Clock::now() >= when_;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    using Schedule = detail::ScheduleTask<Executor, detail::ResumeTask>;
+    timers_->Schedule(when_, Schedule{executor_, detail::ResumeTask{h}});
+  }
+
+  void await_resume() const noexcept { }
+
+ private:
+  Executor* executor_;
+  TimerQueue* timers_;
+  TimerQueue::TimePoint when_;
+};
+
+template <typename Executor>
+inline TimerAwaiter<Executor> sleep_until(
+    Executor& executor, TimerQueue::TimePoint when,
+    TimerQueue& timers = TimerQueue::Default()) {
+  return TimerAwaiter<Executor>(executor, timers, when);
+}
+
+template <typename Executor, typename Rep, typename Period>
+inline TimerAwaiter<Executor> sleep_for(
+    Executor& executor, const std::chrono::duration<Rep, Period>& delay,
+    TimerQueue& timers = TimerQueue::Default()) {
+  return TimerAwaiter<Executor>(
+      executor, timers,
+      TimerQueue::Clock::now() +
+          std::chrono::duration_cast<TimerQueue::Clock::duration>(delay));
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_HAS_COROUTINES
+#endif  // CPPUTIL_COROUTINE_H_
@@ -0,0 +1,204 @@
+//------------------------------------------------------------------------------
+// @file  cpu_topology.h
+//------------------------------------------------------------------------------
+// @brief cpu/numa node layout and thread pinning.
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_CPU_TOPOLOGY_H_
+#define CPPUTIL_CPU_TOPOLOGY_H_
+#include <algorithm>  // for std::find
+#include <cstdlib>    // for std::strtol
+#include <fstream>    // for std::ifstream
+#include <sstream>    // for std::stringstream
+#include <string>     // for std::string
+#include <thread>     // for std::thread::hardware_concurrency
+#include <utility>    // for std::move
+#include <vector>     // for std::vector
+#ifdef __linux__
+#include <sched.h>    // for sched_setaffinity
+#endif
+//------------------------------------------------------------------------------
+// @code
+// CpuTopology topo = CpuTopology::Detect();
+// for (std::size_t n = 0; n < topo.num_nodes(); n++)
+//   std::cout << "node" << topo.node_id(n) << " : "
+//             << topo.node_cpus(n).size() << " cpus\n";
+// PinCurrentThread(topo.node_cpus(0));
+// @endcode
+//------------------------------------------------------------------------------
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class CpuTopology
+//------------------------------------------------------------------------------
+// numa nodes are read from /sys/devices/system/node. when that isn't
+// available (non-linux, containers without sysfs) every online cpu is put
+// into a single node 0.
+// nodes are indexed [0, num_nodes()). memory-only nodes are skipped, so the
+// index isn't the kernel's node number, node_id() gives that.
+//------------------------------------------------------------------------------
+class CpuTopology {
+ public:
+  CpuTopology() : nodes_{}, ids_{} { }
+  // node ids 0, 1, ...
+  explicit CpuTopology(std::vector<std::vector<int>> nodes)
+      : nodes_{std::move(nodes)}, ids_{} {
+    for (std::size_t n = 0; n < nodes_.size(); n++)
+      ids_.push_back(static_cast<int>(n));
+  }
+  CpuTopology(std::vector<std::vector<int>> nodes, std::vector<int> ids)
+      : nodes_{std::move(nodes)}, ids_{std::move(ids)} { }
+  CpuTopology(const CpuTopology&) = default;
+  CpuTopology(CpuTopology&&) = default;
+  CpuTopology& operator=(const CpuTopology&) = default;
+  CpuTopology& operator=(CpuTopology&&) = default;
+
+ public:
+  static CpuTopology Detect();
+
+  // keep only the given cpus. nodes left without a cpu are dropped, the others
+  // keep their node_id().
+  CpuTopology Restrict(const std::vector<int>& cpus) const;
+
+ public:
+  std::size_t num_nodes() const {
+    return nodes_.size();
+  }
+
+  const std::vector<int>& node_cpus(std::size_t node) const {
+    return nodes_[node];
+  }
+
+  // kernel node number. (as in numa_node_of_cpu() or a device's numa_node)
+  int node_id(std::size_t node) const {
+    return ids_[node];
+  }
+
+  std::vector<int> cpus() const;
+
+ private:
+  std::vector<std::vector<int>> nodes_;
+  std::vector<int> ids_;
+};
+
+
+namespace detail {
+// read the first line of a sysfs file. empty if it doesn't exist.
+inline std::string read_line(const std::string& path) {
+  std::ifstream in(path);
+  std::string line;
+  if (in)
+    std::getline(in, line);
+  return line;
+}
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief parse a kernel cpu list. "0-3,8,10-11" -> { 0, 1, 2, 3, 8, 10, 11 }
+//------------------------------------------------------------------------------
+inline std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty())
+      continue;
+    char* end = nullptr;
+    long first = std::strtol(range.c_str(), &end, 10);
+    long last = first;
+    if (end && *end == '-')
+      last = std::strtol(end + 1, nullptr, 10);
+    for (long cpu = first; cpu <= last; cpu++)
+      cpus.push_back(static_cast<int>(cpu));
+  }
+  return cpus;
+}
+
+//------------------------------------------------------------------------------
+// @brief read numa nodes from sysfs, fall back to one node of all cpus.
+//------------------------------------------------------------------------------
+inline CpuTopology CpuTopology::Detect() {
+  std::vector<std::vector<int>> nodes;
+  std::vector<int> ids;
+  const std::string base = "/sys/devices/system/node/";
+  for (const auto& n : ParseCpuList(detail::read_line(base + "online"))) {
+    std::stringstream path;
+    path << base << "node" << n << "/cpulist";
+    auto cpus = ParseCpuList(detail::read_line(path.str()));
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+      ids.push_back(n);
+    }
+  }
+  if (nodes.empty()) {
+    auto cpus = ParseCpuList(
+        detail::read_line("/sys/devices/system/cpu/online"));
+    if (cpus.empty()) {
+      int n = static_cast<int>(std::thread::hardware_concurrency());
+      for (int i = 0; i < std::max(n, 1); i++)
+        cpus.push_back(i);
+    }
+    nodes.push_back(std::move(cpus));
+    ids.assign(1, 0);
+  }
+  return CpuTopology(std::move(nodes), std::move(ids));
+}
+
+//------------------------------------------------------------------------------
+// @brief keep only the given cpus.
+//------------------------------------------------------------------------------
+inline CpuTopology CpuTopology::Restrict(const std::vector<int>& cpus) const {
+  std::vector<std::vector<int>> nodes;
+  std::vector<int> ids;
+  for (std::size_t n = 0; n < nodes_.size(); n++) {
+    std::vector<int> kept;
+    for (auto cpu : nodes_[n]) {
+      if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+        kept.push_back(cpu);
+    }
+    if (!kept.empty()) {
+      nodes.push_back(std::move(kept));
+      ids.push_back(ids_[n]);
+    }
+  }
+  return CpuTopology(std::move(nodes), std::move(ids));
+}
+
+//------------------------------------------------------------------------------
+// @brief every cpu of every node.
+//------------------------------------------------------------------------------
+inline std::vector<int> CpuTopology::cpus() const {
+  std::vector<int> result;
+  for (const auto& node : nodes_)
+    result.insert(result.end(), node.begin(), node.end());
+  return result;
+}
+
+//------------------------------------------------------------------------------
+// @brief restrict the calling thread to the given cpus.
+// @return false when pinning isn't supported or the kernel refused it.
+//------------------------------------------------------------------------------
+inline bool PinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+  if (cpus.empty())
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_CPU_TOPOLOGY_H_
@@ -0,0 +1,666 @@
+//------------------------------------------------------------------------------
+// @file  future.h
+//------------------------------------------------------------------------------
+// @brief lightweight promise/future pair with pooled shared state.
+//------------------------------------------------------------------------------
+// continuations run on an executor (anything with Post(f), e.g. ThreadPool)
+// once the value is ready, so nobody blocks in get() to chain the next step.
+// @code
+// auto f = pool.Submit(load, path)
+//              .then(pool, [](Blob b) { return parse(b); });
+// auto all = cu::when_all(std::move(futures))
+//                .then(pool, [](std::vector<int> v) { return sum(v); });
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_FUTURE_H_
+#define CPPUTIL_FUTURE_H_
+#include <atomic>              // for std::atomic
+#include <chrono>              // for std::chrono::duration
+#include <condition_variable>  // for std::condition_variable
+#include <exception>           // for std::exception_ptr
+#include <future>              // for std::future_error, std::promise
+#include <memory>              // for std::make_shared
+#include <mutex>               // for std::mutex
+#include <new>                 // for placement new
+#include <type_traits>         // for std::aligned_storage
+#include <utility>             // for std::move
+#include <vector>              // for std::vector
+#include "object_pool.h"       // for cu::ObjectPool
+#include "unique_task.h"       // for cu::UniqueTask
+
+
+namespace cu {
+
+
+template <typename T> class Future;
+template <typename T> class Promise;
+
+
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// @brief storage for the result value (nothing for void)
+//------------------------------------------------------------------------------
+template <typename T>
+class ValueSlot {
+ public:
+  ValueSlot() : has_{false} { }
+  ~ValueSlot() {
+    if (has_)
+      ptr()->~T();
+  }
+
+  template <typename U>
+  void Set(U&& v) {
+    new (&buf_) T(std::forward<U>(v));
+    has_ = true;
+  }
+
+  T Take() {
+    return std::move(*ptr());
+  }
+
+ private:
+  T* ptr() { return reinterpret_cast<T*>(&buf_); }
+
+ private:
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type buf_;
+  bool has_;
+};
+
+template <>
+class ValueSlot<void> {
+ public:
+  void Set() { }
+  void Take() { }
+};
+
+
+//------------------------------------------------------------------------------
+// @class FutureState<T>
+// @brief shared state between Promise<T> and Future<T>. (ref-counted)
+//------------------------------------------------------------------------------
+template <typename T>
+class FutureState {
+ public:
+  static FutureState* Create() {
+    return new (ObjectPool<FutureState>::Allocate()) FutureState();
+  }
+
+  void AddRef() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      this->~FutureState();
+      ObjectPool<FutureState>::Deallocate(this);
+    }
+  }
+
+ public:
+  bool is_ready() const {
+    return ready_.load(std::memory_order_acquire);
+  }
+
+  void Wait() {
+    if (is_ready())
+      return;
+    // waiters_ is raised before ready_ is re-checked. see MarkReady().
+    waiters_.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cond_.wait(lock, [this] { return is_ready(); });
+    }
+    waiters_.fetch_sub(1);
+  }
+
+  template <typename Rep, typename Period>
+  bool WaitFor(const std::chrono::duration<Rep, Period>& timeout) {
+    if (is_ready())
+      return true;
+    waiters_.fetch_add(1);
+    bool ready;
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      ready = cond_.wait_for(lock, timeout, [this] { return is_ready(); });
+    }
+    waiters_.fetch_sub(1);
+    return ready;
+  }
+
+  template <typename... U>
+  void SetValue(U&&... v) {
+    if (is_ready())
+      throw std::future_error(std::future_errc::promise_already_satisfied);
+    value_.Set(std::forward<U>(v)...);
+    MarkReady();
+  }
+
+  void SetException(std::exception_ptr e) {
+    if (is_ready())
+      throw std::future_error(std::future_errc::promise_already_satisfied);
+    error_ = e;
+    MarkReady();
+  }
+
+  T Get() {
+    Wait();
+    if (error_)
+      std::rethrow_exception(error_);
+    return value_.Take();
+  }
+
+  // run callback once ready. (at once, on this thread, if it already is)
+  // only one callback can be attached to a state.
+  void OnReady(UniqueTask&& callback) {
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      callback_ = std::move(callback);
+      has_callback_.store(true);
+      if (!is_ready())
+        return;
+      callback = std::move(callback_);
+    }
+    if (callback)
+      callback();
+  }
+
+  bool retrieved;
+
+ private:
+  FutureState()
+      : retrieved{false}, refs_{1}, ready_{false}, waiters_{0},
+        has_callback_{false}, mtx_{}, cond_{}, error_{}, value_{},
+        callback_{} { }
+  ~FutureState() = default;
+
+  void MarkReady() {
+    ready_.store(true);
+    // only take the lock when somebody is (about to be) blocked or attached
+    // a callback. both raise their flag before re-checking ready_.
+    if (waiters_.load() > 0) {
+      { std::unique_lock<std::mutex> lock(mtx_); }
+      cond_.notify_all();
+    }
+    if (has_callback_.load()) {
+      UniqueTask callback;
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        callback = std::move(callback_);
+      }
+      if (callback)
+        callback();
+    }
+  }
+
+ private:
+  std::atomic<int> refs_;
+  std::atomic<bool> ready_;
+  std::atomic<int> waiters_;
+  std::atomic<bool> has_callback_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  std::exception_ptr error_;
+  ValueSlot<T> value_;
+  UniqueTask callback_;
+};
+
+
+//------------------------------------------------------------------------------
+// @brief owning reference to a FutureState. (move-only)
+//------------------------------------------------------------------------------
+template <typename T>
+class StateRef {
+ public:
+  explicit StateRef(FutureState<T>* state) noexcept : state_{state} { }
+  StateRef(StateRef&& other) noexcept : state_{other.state_} {
+    other.state_ = nullptr;
+  }
+  StateRef(const StateRef&) = delete;
+  StateRef& operator=(const StateRef&) = delete;
+  StateRef& operator=(StateRef&&) = delete;
+  ~StateRef() {
+    if (state_)
+      state_->Release();
+  }
+
+  FutureState<T>* operator->() const { return state_; }
+  FutureState<T>* get() const { return state_; }
+
+ private:
+  FutureState<T>* state_;
+};
+
+
+//------------------------------------------------------------------------------
+// @brief result type of a continuation. (f(T), or f() for void)
+//------------------------------------------------------------------------------
+template <typename T, typename F>
+struct ContinuationResult {
+  using type = typename std::result_of<F(T)>::type;
+};
+
+template <typename F>
+struct ContinuationResult<void, F> {
+  using type = typename std::result_of<F()>::type;
+};
+
+// call f with the value of a ready state. rethrows a stored exception.
+template <typename T, typename F>
+inline auto CallWith(F& f, FutureState<T>* state)
+    -> typename ContinuationResult<T, F>::type {
+  return f(state->Get());
+}
+
+template <typename F>
+inline auto CallWith(F& f, FutureState<void>* state)
+    -> typename ContinuationResult<void, F>::type {
+  state->Get();
+  return f();
+}
+
+
+// access to the shared state of a Future for the combinators below.
+struct FutureAccess {
+  template <typename T>
+  static FutureState<T>* state(const Future<T>& f) { return f.state_; }
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class Future<T>
+//------------------------------------------------------------------------------
+// move-only. get() can be called only once, like std::future.
+//------------------------------------------------------------------------------
+template <typename T>
+class Future {
+ public:
+  Future() noexcept : state_{nullptr} { }
+  Future(Future&& other) noexcept : state_{other.state_} {
+    other.state_ = nullptr;
+  }
+  Future& operator=(Future&& other) noexcept {
+    if (this != &other) {
+      if (state_)
+        state_->Release();
+      state_ = other.state_;
+      other.state_ = nullptr;
+    }
+    return *this;
+  }
+  Future(const Future&) = delete;
+  Future& operator=(const Future&) = delete;
+
+  ~Future() {
+    if (state_)
+      state_->Release();
+  }
+
+ public:
+  bool valid() const noexcept {
+    return state_ != nullptr;
+  }
+
+  bool is_ready() const {
+    return state_ && state_->is_ready();
+  }
+
+  void wait() const {
+    Check();
+    state_->Wait();
+  }
+
+  template <typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period>& timeout) const {
+    Check();
+    return state_->WaitFor(timeout);
+  }
+
+  T get() {
+    Check();
+    Holder holder{state_};
+    state_ = nullptr;
+    return holder.state->Get();
+  }
+
+  // run f(value) on the executor once this future is ready and return the
+  // future of its result. an exception is handed down the chain without
+  // calling f. consumes this future.
+  template <typename Executor, typename F>
+  auto then(Executor& executor, F&& f)
+      -> Future<typename detail::ContinuationResult<T, F>::type>;
+
+ private:
+  friend class Promise<T>;
+  friend struct detail::FutureAccess;
+  explicit Future(detail::FutureState<T>* state) : state_{state} { }
+
+  void Check() const {
+    if (!state_)
+      throw std::future_error(std::future_errc::no_state);
+  }
+
+  // release the state after the value has been moved out.
+  struct Holder {
+    detail::FutureState<T>* state;
+    ~Holder() { state->Release(); }
+  };
+
+ private:
+  detail::FutureState<T>* state_;
+};
+
+
+//------------------------------------------------------------------------------
+// @class Promise<T>
+//------------------------------------------------------------------------------
+// destroying an unsatisfied promise stores a 'broken_promise' future_error.
+//------------------------------------------------------------------------------
+template <typename T>
+class Promise {
+ public:
+  Promise() : state_{detail::FutureState<T>::Create()} { }
+  Promise(Promise&& other) noexcept : state_{other.state_} {
+    other.state_ = nullptr;
+  }
+  Promise& operator=(Promise&& other) noexcept {
+    if (this != &other) {
+      Abandon();
+      state_ = other.state_;
+      other.state_ = nullptr;
+    }
+    return *this;
+  }
+  Promise(const Promise&) = delete;
+  Promise& operator=(const Promise&) = delete;
+
+  ~Promise() {
+    Abandon();
+  }
+
+ public:
+  Future<T> get_future() {
+    Check();
+    if (state_->retrieved)
+      throw std::future_error(std::future_errc::future_already_retrieved);
+    state_->retrieved = true;
+    state_->AddRef();
+    return Future<T>(state_);
+  }
+
+  template <typename... U>
+  void set_value(U&&... v) {
+    Check();
+    state_->SetValue(std::forward<U>(v)...);
+  }
+
+  void set_exception(std::exception_ptr e) {
+    Check();
+    state_->SetException(e);
+  }
+
+ private:
+  void Check() const {
+    if (!state_)
+      throw std::future_error(std::future_errc::no_state);
+  }
+
+  void Abandon() {
+    if (!state_)
+      return;
+    if (!state_->is_ready()) {
+      state_->SetException(std::make_exception_ptr(
+          std::future_error(std::future_errc::broken_promise)));
+    }
+    state_->Release();
+    state_ = nullptr;
+  }
+
+ private:
+  detail::FutureState<T>* state_;
+};
+
+
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// @brief call f() and store its result (or exception) into p.
+//------------------------------------------------------------------------------
+template <typename T, typename F>
+inline void Fulfill(Promise<T>& p, F& f) {
+  try {
+    p.set_value(f());
+  } catch (...) {
+    p.set_exception(std::current_exception());
+  }
+}
+
+template <typename F>
+inline void Fulfill(Promise<void>& p, F& f) {
+  try {
+    f();
+    p.set_value();
+  } catch (...) {
+    p.set_exception(std::current_exception());
+  }
+}
+
+template <typename T, typename F>
+inline void Fulfill(std::promise<T>& p, F& f) {
+  try {
+    p.set_value(f());
+  } catch (...) {
+    p.set_exception(std::current_exception());
+  }
+}
+
+template <typename F>
+inline void Fulfill(std::promise<void>& p, F& f) {
+  try {
+    f();
+    p.set_value();
+  } catch (...) {
+    p.set_exception(std::current_exception());
+  }
+}
+
+
+
+// continuation of Future<T>::then(). runs f with the ready state and fulfills
+// the promise of the returned future.
+template <typename T, typename R, typename F>
+struct ContinuationTask {
+  StateRef<T> state;
+  Promise<R> promise;
+  F func;
+  void operator()() {
+    auto call = [this]() { return CallWith(func, state.get()); };
+    Fulfill(promise, call);
+  }
+};
+
+// attached to the antecedent state. hands the continuation to the executor.
+// if the executor refuses it (e.g. stopped pool), it runs right here.
+template <typename Executor, typename Task>
+struct ScheduleTask {
+  Executor* executor;
+  Task task;
+  void operator()() {
+    try {
+      executor->Post(std::move(task));
+    } catch (...) {
+      task();
+    }
+  }
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief attach a continuation which runs on the executor.
+//------------------------------------------------------------------------------
+template <typename T>
+template <typename Executor, typename F>
+inline auto Future<T>::then(Executor& executor, F&& f)
+    -> Future<typename detail::ContinuationResult<T, F>::type> {
+  using R = typename detail::ContinuationResult<T, F>::type;
+  using Func = typename std::decay<F>::type;
+  using Task = detail::ContinuationTask<T, R, Func>;
+  Check();
+  detail::FutureState<T>* state = state_;
+  state_ = nullptr;
+
+  Promise<R> promise;
+  Future<R> result = promise.get_future();
+  state->OnReady(detail::ScheduleTask<Executor, Task>{
+      &executor,
+      Task{detail::StateRef<T>(state), std::move(promise),
+           std::forward<F>(f)}});
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @struct WhenAnyResult<T>
+// @brief result of when_any(). futures[index] is the one which became ready.
+//------------------------------------------------------------------------------
+template <typename T>
+struct WhenAnyResult {
+  std::size_t index;
+  std::vector<Future<T>> futures;
+};
+
+
+namespace detail {
+
+
+template <typename T>
+struct WhenAllContext {
+  std::vector<Future<T>> futures;
+  std::atomic<std::size_t> remaining;
+  Promise<std::vector<T>> promise;
+
+  void Complete() {
+    std::vector<T> values;
+    values.reserve(futures.size());
+    try {
+      for (auto& f : futures)
+        values.emplace_back(f.get());
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      return;
+    }
+    promise.set_value(std::move(values));
+  }
+};
+
+template <>
+struct WhenAllContext<void> {
+  std::vector<Future<void>> futures;
+  std::atomic<std::size_t> remaining;
+  Promise<void> promise;
+
+  void Complete() {
+    try {
+      for (auto& f : futures)
+        f.get();
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      return;
+    }
+    promise.set_value();
+  }
+};
+
+template <typename T>
+struct WhenAllType {
+  using type = std::vector<T>;
+};
+
+template <>
+struct WhenAllType<void> {
+  using type = void;
+};
+
+template <typename T>
+struct WhenAnyContext {
+  std::vector<Future<T>> futures;
+  std::atomic<bool> fired;
+  Promise<WhenAnyResult<T>> promise;
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief future which becomes ready once all futures are ready.
+//        the values (std::vector<T>, nothing for void) are in input order. the
+//        first exception in input order is handed over instead, if any.
+//------------------------------------------------------------------------------
+template <typename T>
+inline auto when_all(std::vector<Future<T>> futures)
+    -> Future<typename detail::WhenAllType<T>::type> {
+  using Context = detail::WhenAllContext<T>;
+  auto ctx = std::make_shared<Context>();
+  auto result = ctx->promise.get_future();
+  if (futures.empty()) {
+    ctx->Complete();
+    return result;
+  }
+  std::vector<detail::FutureState<T>*> states;
+  for (const auto& f : futures)
+    states.push_back(detail::FutureAccess::state(f));
+  ctx->futures = std::move(futures);
+  ctx->remaining = states.size();
+  for (auto* state : states) {
+    state->OnReady([ctx]() {
+        if (ctx->remaining.fetch_sub(1) == 1)
+          ctx->Complete();
+      });
+  }
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief future which becomes ready once any of the futures is ready.
+//        index is the position of that future. (-1 for an empty input)
+//------------------------------------------------------------------------------
+template <typename T>
+inline Future<WhenAnyResult<T>> when_any(std::vector<Future<T>> futures) {
+  using Context = detail::WhenAnyContext<T>;
+  auto ctx = std::make_shared<Context>();
+  auto result = ctx->promise.get_future();
+  if (futures.empty()) {
+    ctx->promise.set_value(WhenAnyResult<T>{static_cast<std::size_t>(-1), {}});
+    return result;
+  }
+  std::vector<detail::FutureState<T>*> states;
+  for (const auto& f : futures)
+    states.push_back(detail::FutureAccess::state(f));
+  ctx->futures = std::move(futures);
+  ctx->fired = false;
+  // the winner moves the futures out; 'states' keeps them reachable here.
+  for (std::size_t i = 0; i < states.size(); i++) {
+    states[i]->OnReady([ctx, i]() {
+        if (ctx->fired.exchange(true))
+          return;
+        ctx->promise.set_value(
+            WhenAnyResult<T>{i, std::move(ctx->futures)});
+      });
+  }
+  return result;
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_FUTURE_H_
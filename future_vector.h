@@ -3,49 +3,220 @@
 //------------------------------------------------------------------------------
 // @brief manage std::future objects (repetitive tasks with thread pool.)
 //------------------------------------------------------------------------------
+// results can be taken all at once in insertion order (get()), or one by one
+// in completion order (Next()/ForEachCompleted()) while the remaining tasks
+// are still running. set_max_in_flight() bounds the number of running tasks;
+// Enqueue() blocks until a slot is free.
+// @code
+// FutureVector<Row> fv(pool);
+// fv.set_max_in_flight(64);
+// for (const auto& key : keys)
+//   fv.Enqueue(Load, key);
+// fv.ForEachCompleted([](Row row) { Consume(row); });
+// @endcode
+// the futures, their shared states and the vector get() returns are taken
+// from 'Alloc'. with an ArenaAllocator they all go away with the arena, which
+// may be reset once every result has been taken: get(), Next() and
+// ForEachCompleted() return only after the task has let go of its state.
+// (see arena.h)
+//------------------------------------------------------------------------------
 #ifndef CPPUTIL_FUTURE_VECTOR_H_
 #define CPPUTIL_FUTURE_VECTOR_H_
+#include <condition_variable>  // for std::condition_variable
 #include <future>  // for std::future
+#include <functional>  // for std::bind
+#include <memory>  // for std::shared_ptr, std::allocator_traits
+#include <mutex>   // for std::mutex
 #include <vector>  // for std::vector
+#include "exception.h"  // for cu::InvalidParameterError
+#include "future.h"  // for cu::detail::Fulfill
+#include "ring_deque.h"
 #include "thread_pool.h"
 
 
 namespace cu {
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// @class CompletionQueue
+// @brief indices of finished tasks in completion order, and the in-flight
+//        window. shared with the running tasks.
+//------------------------------------------------------------------------------
+class CompletionQueue {
+ public:
+  CompletionQueue() : mtx_{}, cond_{}, done_{}, in_flight_{0} { }
+
+  // wait for a free slot in the window (0 : unbounded) and take it.
+  void Acquire(std::size_t window) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (window > 0)
+      cond_.wait(lock, [this, window] { return in_flight_ < window; });
+    in_flight_++;
+  }
+
+  // give back a slot without reporting a result.
+  void Release() {
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      in_flight_--;
+    }
+    cond_.notify_all();
+  }
+
+  // task 'index' finished. (gives back its slot)
+  void Complete(std::size_t index) {
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      done_.emplace_back(index);
+      in_flight_--;
+    }
+    cond_.notify_all();
+  }
+
+  // a result that is ready without running on the pool.
+  void Ready(std::size_t index) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    done_.emplace_back(index);
+    cond_.notify_all();
+  }
+
+  std::size_t Pop() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this] { return !done_.empty(); });
+    std::size_t index = done_.front();
+    done_.pop_front();
+    return index;
+  }
+
+  std::size_t in_flight() const {
+    std::unique_lock<std::mutex> lock(mtx_);
+    return in_flight_;
+  }
+
+ private:
+  mutable std::mutex mtx_;
+  std::condition_variable cond_;
+  RingDeque<std::size_t> done_;
+  std::size_t in_flight_;
+};
 
 
 //------------------------------------------------------------------------------
-// @class FutureVector<ReturnType>
+// @brief fulfill the promise with func, then report its index as completed.
 //------------------------------------------------------------------------------
-template <typename ReturnType>
+template <typename R, typename Func>
+struct CompletionTask {
+  std::promise<R> promise;
+  Func func;
+  std::shared_ptr<CompletionQueue> done;
+  std::size_t index;
+  void operator()() {
+    {
+      std::promise<R> p(std::move(promise));
+      Fulfill(p, func);
+    }  // the shared state is let go before the completion is reported.
+    done->Complete(index);
+  }
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class FutureVector<ReturnType, Alloc>
+//------------------------------------------------------------------------------
+template <typename ReturnType,
+          typename Alloc = std::allocator<ReturnType>>
 class FutureVector {
   static_assert(!std::is_reference<ReturnType>::value,
                 "can't use reference type in future-vector");
 
+ private:
+  template <typename U>
+  using Rebind =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+  using FutureType = std::future<ReturnType>;
+
+ public:
+  using ResultVector = std::vector<ReturnType, Rebind<ReturnType>>;
+
  private:
   ThreadPool* pool_;
-  std::vector<std::future<ReturnType>> futures_;
-  
+  Alloc alloc_;
+  std::vector<FutureType, Rebind<FutureType>> futures_;
+  std::shared_ptr<detail::CompletionQueue> done_;
+  std::size_t remaining_;  // futures not yet taken
+  std::size_t window_;
+
  public:
-  FutureVector() : pool_{nullptr}, futures_{} { }
-  explicit FutureVector(ThreadPool& pool) : pool_{&pool}, futures_{} { }
+  FutureVector() : FutureVector(nullptr, Alloc()) { }
+  explicit FutureVector(ThreadPool& pool) : FutureVector(&pool, Alloc()) { }
+  FutureVector(ThreadPool& pool, const Alloc& alloc)
+      : FutureVector(&pool, alloc) { }
 
  public:
   FutureVector(const FutureVector&) = delete;
-  FutureVector(FutureVector&&) = default;
   FutureVector& operator=(const FutureVector&) = delete;
-  FutureVector& operator=(FutureVector&&) = default;
+
+  // the moved-from vector is left empty, and usable with the same pool.
+  FutureVector(FutureVector&& other)
+      : pool_{other.pool_}, alloc_{other.alloc_},
+        futures_(std::move(other.futures_)), done_{std::move(other.done_)},
+        remaining_{other.remaining_}, window_{other.window_} {
+    other.Reset();
+  }
+
+  // tasks of this vector still running report into its old queue.
+  FutureVector& operator=(FutureVector&& other) {
+    if (this != &other) {
+      pool_ = other.pool_;
+      alloc_ = other.alloc_;
+      futures_ = std::move(other.futures_);
+      done_ = std::move(other.done_);
+      remaining_ = other.remaining_;
+      window_ = other.window_;
+      other.Reset();
+    }
+    return *this;
+  }
 
  public:
-  std::vector<ReturnType> get() {
-    std::vector<ReturnType> result;
-    result.reserve(futures_.size());
-    for(auto& fut : futures_)
-      result.emplace_back(fut.get());
+  ResultVector get() {
+    ResultVector result(alloc_);
+    result.reserve(remaining_);
+    while (NextReady()) { }  // every task reported
+    for(auto& fut : futures_) {
+      if (fut.valid())
+        result.emplace_back(fut.get());
+    }
     clear();
     return result;
   }
-  
+
+  // take the next finished result in completion order.
+  // @return false if every result has been taken.
+  bool Next(ReturnType& value) {
+    std::future<ReturnType>* fut = NextReady();
+    if (!fut)
+      return false;
+    value = fut->get();
+    return true;
+  }
+
+  // call f(result) for every remaining result in completion order.
+  template <typename F>
+  void ForEachCompleted(F&& f) {
+    while (std::future<ReturnType>* fut = NextReady())
+      f(fut->get());
+    clear();
+  }
+
+  // drops the results not yet taken. waits for the tasks still running, so
+  // they count against set_max_in_flight() until they are done.
   void clear() {
+    while (NextReady()) { }
     futures_.clear();
   }
 
@@ -53,8 +224,23 @@ class FutureVector {
     return futures_.empty();
   }
 
+  // max number of tasks running at once. (0 : unbounded)
+  void set_max_in_flight(std::size_t n) {
+    window_ = n;
+  }
+
+  std::size_t in_flight() const {
+    return done_->in_flight();
+  }
+
+  // completion of 'f' isn't tracked, Next() reports it in insertion order.
+  // @throw InvalidParameterError if 'f' has no shared state.
   void Enqueue(std::future<ReturnType>&& f) {
+    if (!f.valid())
+      throw InvalidParameterError("FutureVector: invalid future");
     futures_.emplace_back(std::move(f));
+    remaining_++;
+    done_->Ready(futures_.size() - 1);
   }
 
   template<typename F, typename... Args>
@@ -63,50 +249,139 @@ class FutureVector {
     static_assert(std::is_same<FuncRetType, ReturnType>::value,
                   "Invalid 'func()' return type.");
     if (pool_) {
-      auto f = pool_->Enqueue(std::forward<F>(func),
-                              std::forward<Args>(args)...);
-      Enqueue(std::move(f));
+      using Func = decltype(std::bind(std::forward<F>(func),
+                                      std::forward<Args>(args)...));
+      std::promise<ReturnType> p(std::allocator_arg, alloc_);
+      std::future<ReturnType> fut = p.get_future();
+      done_->Acquire(window_);
+      try {
+        pool_->Post(detail::CompletionTask<ReturnType, Func>{
+            std::move(p),
+            std::bind(std::forward<F>(func), std::forward<Args>(args)...),
+            done_, futures_.size()});
+      } catch (...) {
+        done_->Release();
+        throw;
+      }
+      futures_.emplace_back(std::move(fut));
+      remaining_++;
     }
     else {
       auto bf = std::bind(std::forward<F>(func),
                           std::forward<Args>(args)...);
-      std::promise<ReturnType> p;
+      std::promise<ReturnType> p(std::allocator_arg, alloc_);
       p.set_value(bf());
       Enqueue(p.get_future());
     }
   }
+
+ private:
+  FutureVector(ThreadPool* pool, const Alloc& alloc)
+      : pool_{pool}, alloc_{alloc}, futures_(Rebind<FutureType>(alloc)),
+        done_{std::make_shared<detail::CompletionQueue>()},
+        remaining_{0}, window_{0} { }
+
+  // after a move. (the queue is shared with tasks still running)
+  void Reset() {
+    futures_.clear();
+    done_ = std::make_shared<detail::CompletionQueue>();
+    remaining_ = 0;
+  }
+
+  // future of the next finished task, nullptr if every result has been taken.
+  std::future<ReturnType>* NextReady() {
+    if (remaining_ == 0)
+      return nullptr;
+    remaining_--;
+    return &futures_[done_->Pop()];
+  }
 };
 
 
 //------------------------------------------------------------------------------
-// @class FutureVector<void>
+// @class FutureVector<void, Alloc>
 // @brief specialized template class for non-return type function
 //------------------------------------------------------------------------------
-template <>
-class FutureVector<void> {
+template <typename Alloc>
+class FutureVector<void, Alloc> {
+ private:
+  template <typename U>
+  using Rebind =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+  using FutureType = std::future<void>;
+
  private:
   ThreadPool* pool_;
-  std::vector<std::future<void>> futures_;
-  
+  Alloc alloc_;
+  std::vector<FutureType, Rebind<FutureType>> futures_;
+  std::shared_ptr<detail::CompletionQueue> done_;
+  std::size_t remaining_;  // futures not yet taken
+  std::size_t window_;
+
  public:
-  FutureVector() : pool_{nullptr}, futures_{} { }
-  
-  explicit FutureVector(ThreadPool& pool) : pool_{&pool}, futures_{} { }
+  FutureVector() : FutureVector(nullptr, Alloc()) { }
+  explicit FutureVector(ThreadPool& pool) : FutureVector(&pool, Alloc()) { }
+  FutureVector(ThreadPool& pool, const Alloc& alloc)
+      : FutureVector(&pool, alloc) { }
 
  public:
   FutureVector(const FutureVector&) = delete;
-  FutureVector(FutureVector&&) = default;
   FutureVector& operator=(const FutureVector&) = delete;
-  FutureVector& operator=(FutureVector&&) = default;
-  
+
+  // the moved-from vector is left empty, and usable with the same pool.
+  FutureVector(FutureVector&& other)
+      : pool_{other.pool_}, alloc_{other.alloc_},
+        futures_(std::move(other.futures_)), done_{std::move(other.done_)},
+        remaining_{other.remaining_}, window_{other.window_} {
+    other.Reset();
+  }
+
+  // tasks of this vector still running report into its old queue.
+  FutureVector& operator=(FutureVector&& other) {
+    if (this != &other) {
+      pool_ = other.pool_;
+      alloc_ = other.alloc_;
+      futures_ = std::move(other.futures_);
+      done_ = std::move(other.done_);
+      remaining_ = other.remaining_;
+      window_ = other.window_;
+      other.Reset();
+    }
+    return *this;
+  }
+
  public:
   void get() {
-    for(auto& fut : futures_)
-      fut.get();
+    while (NextReady()) { }  // every task reported
+    for(auto& fut : futures_) {
+      if (fut.valid())
+        fut.get();
+    }
     clear();
   }
-  
+
+  // wait for the next task to finish in completion order.
+  // @return false if every task has been taken.
+  bool Next() {
+    std::future<void>* fut = NextReady();
+    if (!fut)
+      return false;
+    fut->get();
+    return true;
+  }
+
+  // call f() each time a remaining task finishes.
+  template <typename F>
+  void ForEachCompleted(F&& f) {
+    while (Next())
+      f();
+    clear();
+  }
+
+  // drops the results not yet taken. waits for the tasks still running, so
+  // they count against set_max_in_flight() until they are done.
   void clear() {
+    while (NextReady()) { }
     futures_.clear();
   }
 
@@ -114,28 +389,78 @@ class FutureVector<void> {
     return futures_.empty();
   }
 
+  // max number of tasks running at once. (0 : unbounded)
+  void set_max_in_flight(std::size_t n) {
+    window_ = n;
+  }
+
+  std::size_t in_flight() const {
+    return done_->in_flight();
+  }
+
+  // completion of 'f' isn't tracked, Next() reports it in insertion order.
+  // @throw InvalidParameterError if 'f' has no shared state.
   void Enqueue(std::future<void>&& f) {
+    if (!f.valid())
+      throw InvalidParameterError("FutureVector: invalid future");
     futures_.emplace_back(std::move(f));
+    remaining_++;
+    done_->Ready(futures_.size() - 1);
   }
 
-  template<class F, class... Args>    
+  template<class F, class... Args>
   void Enqueue(F&& func, Args&&... args) {
     using RetType = typename std::result_of<F(Args...)>::type;
     static_assert(std::is_void<RetType>::value,
                   "Invalid func() return type. (use 'void')");
     if (pool_) {
-      auto f = pool_->Enqueue(std::forward<F>(func),
-                              std::forward<Args>(args)...);
-      Enqueue(std::move(f));
+      using Func = decltype(std::bind(std::forward<F>(func),
+                                      std::forward<Args>(args)...));
+      std::promise<void> p(std::allocator_arg, alloc_);
+      std::future<void> fut = p.get_future();
+      done_->Acquire(window_);
+      try {
+        pool_->Post(detail::CompletionTask<void, Func>{
+            std::move(p),
+            std::bind(std::forward<F>(func), std::forward<Args>(args)...),
+            done_, futures_.size()});
+      } catch (...) {
+        done_->Release();
+        throw;
+      }
+      futures_.emplace_back(std::move(fut));
+      remaining_++;
     }
     else {
-      using TaskType = std::packaged_task<void()>;
       auto df = std::bind(std::forward<F>(func),
                           std::forward<Args>(args)...);
-      auto task = std::make_shared<TaskType>(std::move(df));
-      futures_.emplace_back(task->get_future());
+      std::promise<void> p(std::allocator_arg, alloc_);
+      df();
+      p.set_value();
+      Enqueue(p.get_future());
     }
   }
+
+ private:
+  FutureVector(ThreadPool* pool, const Alloc& alloc)
+      : pool_{pool}, alloc_{alloc}, futures_(Rebind<FutureType>(alloc)),
+        done_{std::make_shared<detail::CompletionQueue>()},
+        remaining_{0}, window_{0} { }
+
+  // after a move. (the queue is shared with tasks still running)
+  void Reset() {
+    futures_.clear();
+    done_ = std::make_shared<detail::CompletionQueue>();
+    remaining_ = 0;
+  }
+
+  // future of the next finished task, nullptr if every result has been taken.
+  std::future<void>* NextReady() {
+    if (remaining_ == 0)
+      return nullptr;
+    remaining_--;
+    return &futures_[done_->Pop()];
+  }
 };
 
 
@@ -10,14 +10,21 @@ namespace cu {
 
 
 namespace {
-// check '-' or '--' character from prefix.
+bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// check '-' or '--' character from prefix. a negative number ("-3",
+// "-0.5", "-.5") is a value, not an option.
 bool is_opt(const std::string& opt) {
   auto sz = opt.size();
   if (sz < 2)
     return false;
-  if (opt[0] == '-')
-    return true;
-  return false;
+  if (opt[0] != '-')
+    return false;
+  if (is_digit(opt[1]) || (opt[1] == '.' && sz > 2 && is_digit(opt[2])))
+    return false;
+  return true;
 }
 
 }  // namespace
@@ -67,6 +74,9 @@ void GetOpt::Init(const std::vector<std::string>& args) {
       cmd = "";
     }
   }
+  // a flag given last.
+  if (!cmd.empty())
+    opt_[cmd] = "";
 }
 
 //------------------------------------------------------------------------------
@@ -9,18 +9,59 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
-#include "variadic.h"  // for array_cast
+#include "exception.h"  // for cu::InvalidParameterError
+#include "numeric.h"    // for cu::strutil::parse
+#include "variadic.h"   // for array_cast
 //------------------------------------------------------------------------------
 // @code
 // GetOpt opt(argc, argv);
-// std::string w = opt.Parse("-w", "--worker");
-// int i = opt.ParseInt("-t", "--thread", "--thread_num");
-// double j = opt.ParseDouble("-j");
+// std::string w = opt.Parse<std::string>("-w", "--worker");
+// int i = opt.Parse<int>("-t", "--thread", "--thread_num");
+// double j = opt.Parse<double>("-j");
+// bool v = opt.Parse<bool>("-v");   // "-v", "-v 1", "-v true", "-v yes"
+// @endcode
+// numbers are read without locale. a malformed one throws
+// InvalidParameterError, a missing option gives T(). an argument like "-3"
+// or "-.5" is a negative value ("-n -3"), never an option name.
 //------------------------------------------------------------------------------
 
 
 namespace cu {
+namespace detail {
+
+
+// option value -> T.
+template <typename T>
+inline typename std::enable_if<!std::is_arithmetic<T>::value, T>::type
+OptCast(const std::string&, const std::string& value) {
+  return static_cast<T>(value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value &&
+                               !std::is_same<T, bool>::value, T>::type
+OptCast(const std::string& opt, const std::string& value) {
+  T result;
+  if (!strutil::parse(value, &result))
+    throw InvalidParameterError(opt + ": bad number '" + value + "'");
+  return result;
+}
+
+// a flag without a value is true.
+template <typename T>
+inline typename std::enable_if<std::is_same<T, bool>::value, T>::type
+OptCast(const std::string& opt, const std::string& value) {
+  if (value.empty() || value == "1" || value == "true" || value == "yes")
+    return true;
+  if (value == "0" || value == "false" || value == "no")
+    return false;
+  throw InvalidParameterError(opt + ": bad bool '" + value + "'");
+}
+
+
+}  // namespace detail
 
 
 //------------------------------------------------------------------------------
@@ -68,7 +109,8 @@ class GetOpt {
 
 
 //------------------------------------------------------------------------------
-// @code auto val = opts.Parse
+// @code auto val = opts.Parse<int>("-n", "--num");
+// the value of the first of opts given. (T() if none is)
 //------------------------------------------------------------------------------
 template <typename T, typename... Args>
 inline T GetOpt::Parse(Args&&... opts) const {
@@ -76,7 +118,7 @@ inline T GetOpt::Parse(Args&&... opts) const {
   for(const auto& cmd : cmds) {
     auto cursor = opt_.find(cmd);
     if (cursor != opt_.end()) {
-      return static_cast<T>(cursor->second);
+      return detail::OptCast<T>(cmd, cursor->second);
     }
   }
   return T();
@@ -0,0 +1,461 @@
+//------------------------------------------------------------------------------
+// @file  histogram.h
+//------------------------------------------------------------------------------
+// @brief log-linear (HDR style) latency histograms, a per-thread sharded one
+//        for hot paths, and ScopedTimer recording into a named histogram.
+//------------------------------------------------------------------------------
+// every power of two is cut into 2^kSubBits linear sub-buckets, so a value is
+// known to within 1/32 (3.2%) over the whole range, with a fixed number of
+// buckets. values below 32 are exact.
+// ConcurrentHistogram gives each thread a shard of its own, written with
+// plain relaxed stores (no read-modify-write, no shared cache line). shards
+// are only merged when a snapshot is taken.
+// @code
+// cu::ConcurrentHistogram& h = cu::Histograms().Get("parse");  // keep it
+// while (...) {
+//   cu::ScopedTimer t(h);             // records the elapsed ns at scope exit
+//   Parse(line);
+// }
+// cu::Histogram s = h.Snapshot();
+// printf("%s\n", s.ToString().c_str());  // n=... p50=... p99=... max=...
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_HISTOGRAM_H_
+#define CPPUTIL_HISTOGRAM_H_
+#include <atomic>         // for std::atomic
+#include <cstdint>        // for std::int64_t, std::uint64_t
+#include <cstdio>         // for std::snprintf
+#include <limits>         // for std::numeric_limits
+#include <map>            // for std::map
+#include <memory>         // for std::unique_ptr
+#include <mutex>          // for std::mutex
+#include <string>         // for std::string
+#include <utility>        // for std::pair
+#include <vector>         // for std::vector
+#include "mpmc_queue.h"   // for cu::kCacheLineSize
+#include "stopwatch.h"    // for cu::TscStopwatch
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class Histogram
+//------------------------------------------------------------------------------
+// counts of non-negative values (usually nanoseconds). values over
+// kMaxValue go to the last bucket, negative ones to the first. count, sum,
+// min and max are exact, percentiles are the upper bound of their bucket.
+// (but never more than max())
+//------------------------------------------------------------------------------
+class Histogram {
+ public:
+  static constexpr int kSubBits = 5;
+  static constexpr int kMaxBits = 44;  // ~4.9 hours in ns
+  static constexpr std::int64_t kMaxValue = (std::int64_t(1) << kMaxBits) - 1;
+  static constexpr std::size_t kBuckets =
+      std::size_t(kMaxBits - kSubBits + 1) << kSubBits;
+
+ public:
+  Histogram()
+      : counts_(kBuckets, 0), count_{0}, sum_{0},
+        min_{std::numeric_limits<std::int64_t>::max()}, max_{0} { }
+
+  static std::size_t BucketOf(std::int64_t v) {
+    if (v < (std::int64_t(1) << kSubBits))
+      return v > 0 ? static_cast<std::size_t>(v) : 0;
+    if (v > kMaxValue)
+      v = kMaxValue;
+    const int shift = 63 - __builtin_clzll(static_cast<std::uint64_t>(v)) -
+                      kSubBits;
+    return (static_cast<std::size_t>(shift + 1) << kSubBits) +
+           static_cast<std::size_t>((v >> shift) - (1 << kSubBits));
+  }
+
+  // smallest and largest value of a bucket.
+  static std::int64_t LowerBound(std::size_t b) {
+    if (b < (std::size_t(1) << kSubBits))
+      return static_cast<std::int64_t>(b);
+    const int shift = static_cast<int>(b >> kSubBits) - 1;
+    const std::int64_t sub = static_cast<std::int64_t>(
+        b & ((std::size_t(1) << kSubBits) - 1));
+    return ((std::int64_t(1) << kSubBits) + sub) << shift;
+  }
+
+  static std::int64_t UpperBound(std::size_t b) {
+    if (b < (std::size_t(1) << kSubBits))
+      return static_cast<std::int64_t>(b);
+    const int shift = static_cast<int>(b >> kSubBits) - 1;
+    return LowerBound(b) + (std::int64_t(1) << shift) - 1;
+  }
+
+ public:
+  void Record(std::int64_t v, std::uint64_t n = 1) {
+    counts_[BucketOf(v)] += n;
+    count_ += n;
+    if (v < 0)
+      v = 0;
+    sum_ += v * static_cast<std::int64_t>(n);
+    if (v < min_)
+      min_ = v;
+    if (v > max_)
+      max_ = v;
+  }
+
+  // n values of bucket b, without their sum / min / max. (see AddTotals)
+  void Add(std::size_t b, std::uint64_t n) {
+    counts_[b] += n;
+    count_ += n;
+  }
+
+  void AddTotals(std::int64_t sum, std::int64_t min, std::int64_t max) {
+    sum_ += sum;
+    if (min < min_)
+      min_ = min;
+    if (max > max_)
+      max_ = max;
+  }
+
+  void Merge(const Histogram& other) {
+    for (std::size_t i = 0; i < kBuckets; i++)
+      counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.count_ > 0 && other.min_ < min_)
+      min_ = other.min_;
+    if (other.max_ > max_)
+      max_ = other.max_;
+  }
+
+  void clear() {
+    *this = Histogram();
+  }
+
+ public:
+  std::uint64_t count() const {
+    return count_;
+  }
+
+  std::uint64_t bucket(std::size_t i) const {
+    return counts_[i];
+  }
+
+  std::int64_t sum() const {
+    return sum_;
+  }
+
+  // 0 if nothing was recorded. (as are max() and percentiles)
+  std::int64_t min() const {
+    return count_ ? min_ : 0;
+  }
+
+  std::int64_t max() const {
+    return max_;
+  }
+
+  double mean() const {
+    return count_ ? static_cast<double>(sum_) / count_ : 0.0;
+  }
+
+  // p in [0, 1].
+  std::int64_t Percentile(double p) const {
+    if (count_ == 0)
+      return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(p * count_);
+    if (rank >= count_)
+      rank = count_ - 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; i++) {
+      seen += counts_[i];
+      if (seen > rank)
+        return UpperBound(i) < max_ ? UpperBound(i) : max_;
+    }
+    return max_;
+  }
+
+  std::int64_t p50() const { return Percentile(0.5); }
+  std::int64_t p99() const { return Percentile(0.99); }
+  std::int64_t p999() const { return Percentile(0.999); }
+
+  // "n=1000 mean=1520.3 p50=1472 p99=3071 p999=8191 max=9012"
+  std::string ToString() const {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf),
+                  "n=%llu mean=%.1f p50=%lld p99=%lld p999=%lld max=%lld",
+                  static_cast<unsigned long long>(count_), mean(),
+                  static_cast<long long>(p50()),
+                  static_cast<long long>(p99()),
+                  static_cast<long long>(p999()),
+                  static_cast<long long>(max_));
+    return buf;
+  }
+
+ private:
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t count_;
+  std::int64_t sum_;
+  std::int64_t min_;
+  std::int64_t max_;
+};
+
+
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// small index of the calling thread, reused after the thread exits. (so a
+// long running process with short lived threads keeps few shards)
+//------------------------------------------------------------------------------
+class ThreadIndices {
+ public:
+  // (never destroyed, threads may outlive static objects)
+  static ThreadIndices& Get() {
+    static ThreadIndices* indices = new ThreadIndices;
+    return *indices;
+  }
+
+  std::size_t Acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty())
+      return next_++;
+    std::size_t i = free_.back();
+    free_.pop_back();
+    return i;
+  }
+
+  void Release(std::size_t i) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(i);
+  }
+
+ private:
+  ThreadIndices() : next_{0} { }
+
+  std::mutex mutex_;
+  std::vector<std::size_t> free_;
+  std::size_t next_;
+};
+
+struct ThreadIndex {
+  ThreadIndex() : index{ThreadIndices::Get().Acquire()} { }
+  ~ThreadIndex() { ThreadIndices::Get().Release(index); }
+  std::size_t index;
+};
+
+inline std::size_t CurrentThreadIndex() {
+  static thread_local ThreadIndex index;
+  return index.index;
+}
+
+
+//------------------------------------------------------------------------------
+// @class HistogramShard
+//------------------------------------------------------------------------------
+// the counters of one thread. single writer (load + store) unless shared,
+// then read-modify-write. read by snapshots from any thread.
+//------------------------------------------------------------------------------
+class HistogramShard {
+ public:
+  using Counter = std::atomic<std::uint64_t>;
+  using Value = std::atomic<std::int64_t>;
+
+  explicit HistogramShard(bool shared)
+      : shared_{shared}, counts_{new Counter[Histogram::kBuckets]},
+        count_{0}, sum_{0}, min_{std::numeric_limits<std::int64_t>::max()},
+        max_{0} {
+    for (std::size_t i = 0; i < Histogram::kBuckets; i++)
+      counts_[i].store(0, std::memory_order_relaxed);
+  }
+
+  HistogramShard(const HistogramShard&) = delete;
+  HistogramShard& operator=(const HistogramShard&) = delete;
+
+ public:
+  void Record(std::int64_t v) {
+    if (v < 0)
+      v = 0;
+    if (shared_) {
+      counts_[Histogram::BucketOf(v)].fetch_add(1, std::memory_order_relaxed);
+      count_.fetch_add(1, std::memory_order_relaxed);
+      sum_.fetch_add(v, std::memory_order_relaxed);
+      std::int64_t m = min_.load(std::memory_order_relaxed);
+      while (v < m && !min_.compare_exchange_weak(m, v)) { }
+      m = max_.load(std::memory_order_relaxed);
+      while (v > m && !max_.compare_exchange_weak(m, v)) { }
+      return;
+    }
+    Bump(counts_[Histogram::BucketOf(v)], 1);
+    Bump(count_, 1);
+    sum_.store(sum_.load(std::memory_order_relaxed) + v,
+               std::memory_order_relaxed);
+    if (v < min_.load(std::memory_order_relaxed))
+      min_.store(v, std::memory_order_relaxed);
+    if (v > max_.load(std::memory_order_relaxed))
+      max_.store(v, std::memory_order_relaxed);
+  }
+
+  // adds the shard to h.
+  void Snapshot(Histogram& h) const {
+    if (count_.load(std::memory_order_relaxed) == 0)
+      return;
+    for (std::size_t i = 0; i < Histogram::kBuckets; i++)
+      h.Add(i, counts_[i].load(std::memory_order_relaxed));
+    h.AddTotals(sum_.load(std::memory_order_relaxed),
+                min_.load(std::memory_order_relaxed),
+                max_.load(std::memory_order_relaxed));
+  }
+
+ private:
+  static void Bump(Counter& c, std::uint64_t n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+ private:
+  const bool shared_;
+  std::unique_ptr<Counter[]> counts_;
+  Counter count_;
+  Value sum_;
+  Value min_;
+  Value max_;
+  char padding_[kCacheLineSize];
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class ConcurrentHistogram
+//------------------------------------------------------------------------------
+// Record() from any number of threads. the first kMaxShards threads (by
+// detail::CurrentThreadIndex) write shards of their own, any further ones
+// share one more shard with atomic adds.
+//------------------------------------------------------------------------------
+class ConcurrentHistogram {
+ public:
+  static constexpr std::size_t kMaxShards = 128;
+
+ public:
+  ConcurrentHistogram() {
+    for (auto& s : shards_)
+      s.store(nullptr, std::memory_order_relaxed);
+  }
+
+  ~ConcurrentHistogram() {
+    for (auto& s : shards_)
+      delete s.load(std::memory_order_relaxed);
+  }
+
+  ConcurrentHistogram(const ConcurrentHistogram&) = delete;
+  ConcurrentHistogram& operator=(const ConcurrentHistogram&) = delete;
+
+ public:
+  void Record(std::int64_t v) {
+    Shard().Record(v);
+  }
+
+  // all shards merged. (a consistent view only once recording stopped)
+  Histogram Snapshot() const {
+    Histogram h;
+    for (const auto& s : shards_) {
+      const detail::HistogramShard* shard = s.load(std::memory_order_acquire);
+      if (shard)
+        shard->Snapshot(h);
+    }
+    return h;
+  }
+
+ private:
+  // the shard of the calling thread, made on its first Record().
+  detail::HistogramShard& Shard() {
+    std::size_t i = detail::CurrentThreadIndex();
+    if (i > kMaxShards)
+      i = kMaxShards;
+    detail::HistogramShard* s = shards_[i].load(std::memory_order_acquire);
+    if (s == nullptr) {
+      detail::HistogramShard* fresh =
+          new detail::HistogramShard(i == kMaxShards);
+      if (shards_[i].compare_exchange_strong(s, fresh,
+                                             std::memory_order_acq_rel))
+        s = fresh;
+      else
+        delete fresh;
+    }
+    return *s;
+  }
+
+ private:
+  std::atomic<detail::HistogramShard*> shards_[kMaxShards + 1];
+};
+
+
+//------------------------------------------------------------------------------
+// @class HistogramRegistry
+// @brief histograms by name. they live as long as the registry.
+//------------------------------------------------------------------------------
+class HistogramRegistry {
+ public:
+  HistogramRegistry() = default;
+  HistogramRegistry(const HistogramRegistry&) = delete;
+  HistogramRegistry& operator=(const HistogramRegistry&) = delete;
+
+  // made on first use. (a lookup under a lock: keep the reference for hot
+  // paths)
+  ConcurrentHistogram& Get(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<ConcurrentHistogram>& h = histograms_[name];
+    if (!h)
+      h.reset(new ConcurrentHistogram);
+    return *h;
+  }
+
+  // snapshots of all histograms, by name.
+  std::vector<std::pair<std::string, Histogram>> Snapshot() const {
+    std::vector<std::pair<std::string, Histogram>> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& h : histograms_)
+      result.emplace_back(h.first, h.second->Snapshot());
+    return result;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<ConcurrentHistogram>> histograms_;
+};
+
+// the process wide registry. (never destroyed, threads may still record
+// while static objects go away)
+inline HistogramRegistry& Histograms() {
+  static HistogramRegistry* registry = new HistogramRegistry;
+  return *registry;
+}
+
+
+//------------------------------------------------------------------------------
+// @class ScopedTimer
+// @brief records the ns from construction to destruction into a histogram.
+//        (timed with the tsc, a few ns per timer. see tsc_clock.h)
+//------------------------------------------------------------------------------
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(ConcurrentHistogram& histogram)
+      : histogram_(histogram) { }
+
+  // histogram of the global registry. (the lookup is not timed)
+  explicit ScopedTimer(const std::string& name)
+      : histogram_(Histograms().Get(name)) { }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  ~ScopedTimer() {
+    histogram_.Record(static_cast<std::int64_t>(sw_.nsec()));
+  }
+
+ private:
+  ConcurrentHistogram& histogram_;
+  TscStopwatch sw_;  // (started after the lookup above)
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_HISTOGRAM_H_
@@ -0,0 +1,318 @@
+//------------------------------------------------------------------------------
+// @file  interner.h
+//------------------------------------------------------------------------------
+// @brief concurrent string interner. maps each distinct string to a 32 bit id
+//        and a StringView which stays valid as long as the interner.
+//------------------------------------------------------------------------------
+// strings are hashed to one of several shards. a shard is an open addressing
+// table of (hash tag, id) words which is read without locking. only inserting
+// a new string takes the shard's mutex, so once the vocabulary is known,
+// interning costs one hash and one probe and never allocates.
+// the characters live in append-only blocks of the shard, an id leads to them
+// through a directory of chunks that never move. (so view(id) is lock-free
+// too)
+// @code
+// cu::StringInterner names;
+// for (cu::StringView field : cu::strutil::split_view(line, '\t')) {
+//   cu::StringInterner::Id id = names.Intern(field);  // same field, same id
+//   ...
+// }
+// cu::StringView s = names.view(id);
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_INTERNER_H_
+#define CPPUTIL_INTERNER_H_
+#include <atomic>         // for std::atomic
+#include <cstdint>        // for std::uint32_t, std::uint64_t
+#include <cstring>        // for std::memcpy
+#include <memory>         // for std::unique_ptr
+#include <mutex>          // for std::mutex
+#include <vector>         // for std::vector
+#include "exception.h"    // for cu::RuntimeError
+#include "mpmc_queue.h"   // for cu::kCacheLineSize
+#include "string_view.h"  // for cu::StringView
+
+
+namespace cu {
+namespace detail {
+
+
+inline std::uint64_t MixBits(std::uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// 8 bytes per step. (not meant to resist collision attacks)
+inline std::uint64_t HashBytes(const char* p, std::size_t n) {
+  const std::uint64_t k = 0x9e3779b97f4a7c15ull;
+  std::uint64_t h = k ^ n;
+  for (; n >= 8; p += 8, n -= 8) {
+    std::uint64_t w;
+    std::memcpy(&w, p, 8);
+    h = (h ^ w) * k;
+    h ^= h >> 29;
+  }
+  // the last 0-7 bytes, without a variable length memcpy.
+  std::uint64_t w = 0;
+  if (n >= 4) {
+    std::uint32_t lo, hi;
+    std::memcpy(&lo, p, 4);
+    std::memcpy(&hi, p + n - 4, 4);
+    w = std::uint64_t(hi) << 32 | lo;
+  } else if (n > 0) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    w = std::uint64_t(u[0]) << 16 | std::uint64_t(u[n / 2]) << 8 | u[n - 1];
+  }
+  return MixBits(h ^ w);
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class StringInterner
+//------------------------------------------------------------------------------
+// ids are dense, 0, 1, 2, ... in the order strings were first seen. (across
+// all threads) all methods may be called from any thread at the same time.
+//------------------------------------------------------------------------------
+class StringInterner {
+ public:
+  using Id = std::uint32_t;
+  static constexpr Id kNoId = 0xffffffffu;
+
+ public:
+  // shards is rounded up to a power of two.
+  explicit StringInterner(std::size_t shards = 64)
+      : shard_bits_{0}, next_id_{0} {
+    while ((std::size_t(1) << shard_bits_) < shards)
+      shard_bits_++;
+    shards_.reset(new Shard[std::size_t(1) << shard_bits_]);
+    for (auto& c : chunks_)
+      c.store(nullptr, std::memory_order_relaxed);
+  }
+
+  ~StringInterner() {
+    for (auto& c : chunks_)
+      delete[] c.load(std::memory_order_relaxed);
+  }
+
+  StringInterner(const StringInterner&) = delete;
+  StringInterner& operator=(const StringInterner&) = delete;
+
+ public:
+  // id of s, added if it is new.
+  Id Intern(StringView s) {
+    const std::uint64_t h = detail::HashBytes(s.data(), s.size());
+    Shard& shard = shards_[h & ShardMask()];
+    Id id = Lookup(shard, s, h);
+    if (id != kNoId)
+      return id;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    id = Lookup(shard, s, h);  // (someone else may just have added it)
+    if (id != kNoId)
+      return id;
+    return Insert(shard, s, h);
+  }
+
+  // the stored copy of s, valid as long as the interner.
+  StringView InternView(StringView s) {
+    return view(Intern(s));
+  }
+
+  // id of every piece of a range of StringViews. (e.g. strutil::split_view)
+  template <typename Range>
+  void InternAll(const Range& pieces, std::vector<Id>* ids) {
+    for (StringView s : pieces)
+      ids->push_back(Intern(s));
+  }
+
+  // id of s, kNoId if it was never interned. (never inserts)
+  Id Find(StringView s) const {
+    const std::uint64_t h = detail::HashBytes(s.data(), s.size());
+    return Lookup(shards_[h & ShardMask()], s, h);
+  }
+
+  // the string of an id returned by this interner. (nul terminated)
+  StringView view(Id id) const {
+    std::size_t chunk, offset;
+    Locate(id, &chunk, &offset);
+    const Entry& e = chunks_[chunk].load(std::memory_order_acquire)[offset];
+    return StringView(e.data, e.size);
+  }
+
+  // number of distinct strings. (ids handed out so far)
+  std::size_t size() const {
+    return next_id_.load(std::memory_order_acquire);
+  }
+
+  std::size_t num_shards() const {
+    return std::size_t(1) << shard_bits_;
+  }
+
+ private:
+  static constexpr std::size_t kFirstChunkBits = 10;
+  static constexpr std::size_t kNumChunks = 33 - kFirstChunkBits;
+  static constexpr std::size_t kBlockSize = 64 << 10;
+
+  struct Entry {
+    const char* data;
+    std::size_t size;
+  };
+
+  // a table is its mask followed by the slots, in one array. (one load less
+  // per lookup) a slot is 0 (empty) or (upper 32 bits of the hash, id + 1).
+  using Slot = std::atomic<std::uint64_t>;
+  using Table = std::unique_ptr<Slot[]>;
+
+  static Table NewTable(std::size_t capacity) {
+    Table t(new Slot[capacity + 1]);
+    t[0].store(capacity - 1, std::memory_order_relaxed);
+    for (std::size_t i = 1; i <= capacity; i++)
+      t[i].store(0, std::memory_order_relaxed);
+    return t;
+  }
+
+  // readers only look at 'table'. the rest is guarded by 'mutex'.
+  struct Shard {
+    Shard() : table{nullptr}, count{0}, free{nullptr}, left{0} {
+      tables.push_back(NewTable(16));
+      table.store(tables.back().get(), std::memory_order_relaxed);
+    }
+    std::mutex mutex;
+    std::atomic<Slot*> table;
+    // the table in use and the ones it replaced. (readers may still be on
+    // them, so they are kept until the interner goes away)
+    std::vector<Table> tables;
+    std::size_t count;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* free;
+    std::size_t left;
+    char padding_[kCacheLineSize];
+  };
+
+ private:
+  // chunk k holds ids [2^10 (2^k - 1), 2^10 (2^(k+1) - 1)). (2^(k+10) entries)
+  static void Locate(Id id, std::size_t* chunk, std::size_t* offset) {
+    const std::uint64_t v = std::uint64_t(id) + (1u << kFirstChunkBits);
+    const std::size_t bit = 63 - __builtin_clzll(v);
+    *chunk = bit - kFirstChunkBits;
+    *offset = v - (std::uint64_t(1) << bit);
+  }
+
+  std::size_t ShardMask() const {
+    return (std::size_t(1) << shard_bits_) - 1;
+  }
+
+  Id Lookup(const Shard& shard, StringView s, std::uint64_t h) const {
+    const Slot* t = shard.table.load(std::memory_order_acquire);
+    const std::size_t mask = t[0].load(std::memory_order_relaxed);
+    const std::uint64_t tag = h >> 32;
+    for (std::size_t i = (h >> shard_bits_) & mask;; i = (i + 1) & mask) {
+      const std::uint64_t slot = t[i + 1].load(std::memory_order_acquire);
+      if (slot == 0)
+        return kNoId;
+      if ((slot >> 32) == tag) {
+        const Id id = static_cast<Id>(slot) - 1;
+        if (view(id) == s)
+          return id;
+      }
+    }
+  }
+
+  // (with the shard locked)
+  Id Insert(Shard& shard, StringView s, std::uint64_t h) {
+    const std::size_t n = next_id_.fetch_add(1);
+    if (n >= kNoId)
+      throw RuntimeError("StringInterner: out of ids");
+    const Id id = static_cast<Id>(n);
+    Entry& e = EntryOf(id);
+    e.data = Store(shard, s);
+    e.size = s.size();
+
+    Slot* t = shard.table.load(std::memory_order_relaxed);
+    if (2 * (shard.count + 1) > t[0].load(std::memory_order_relaxed) + 1)
+      t = Grow(shard);
+    Put(t, (h >> 32) << 32 | (std::uint64_t(id) + 1), h);
+    shard.count++;
+    return id;
+  }
+
+  void Put(Slot* t, std::uint64_t slot, std::uint64_t h) const {
+    const std::size_t mask = t[0].load(std::memory_order_relaxed);
+    std::size_t i = (h >> shard_bits_) & mask;
+    while (t[i + 1].load(std::memory_order_relaxed) != 0)
+      i = (i + 1) & mask;
+    t[i + 1].store(slot, std::memory_order_release);
+  }
+
+  // a table twice as large, filled before readers see it.
+  Slot* Grow(Shard& shard) {
+    const Slot* old = shard.table.load(std::memory_order_relaxed);
+    const std::size_t capacity = old[0].load(std::memory_order_relaxed) + 1;
+    Table t = NewTable(2 * capacity);
+    for (std::size_t i = 1; i <= capacity; i++) {
+      const std::uint64_t slot = old[i].load(std::memory_order_relaxed);
+      if (slot != 0) {
+        StringView s = view(static_cast<Id>(slot) - 1);
+        Put(t.get(), slot, detail::HashBytes(s.data(), s.size()));
+      }
+    }
+    shard.tables.push_back(std::move(t));
+    shard.table.store(shard.tables.back().get(), std::memory_order_release);
+    return shard.tables.back().get();
+  }
+
+  // copies s (and a '\0') into the shard's current block.
+  static const char* Store(Shard& shard, StringView s) {
+    const std::size_t n = s.size() + 1;
+    char* p;
+    if (n > kBlockSize / 4) {
+      shard.blocks.emplace_back(new char[n]);
+      p = shard.blocks.back().get();
+    } else {
+      if (n > shard.left) {
+        shard.blocks.emplace_back(new char[kBlockSize]);
+        shard.free = shard.blocks.back().get();
+        shard.left = kBlockSize;
+      }
+      p = shard.free;
+      shard.free += n;
+      shard.left -= n;
+    }
+    if (!s.empty())
+      std::memcpy(p, s.data(), s.size());
+    p[s.size()] = '\0';
+    return p;
+  }
+
+  // the entry of a new id. its chunk is made by whoever gets there first.
+  Entry& EntryOf(Id id) {
+    std::size_t chunk, offset;
+    Locate(id, &chunk, &offset);
+    Entry* entries = chunks_[chunk].load(std::memory_order_acquire);
+    if (entries == nullptr) {
+      Entry* fresh = new Entry[std::size_t(1) << (chunk + kFirstChunkBits)];
+      if (chunks_[chunk].compare_exchange_strong(entries, fresh,
+                                                 std::memory_order_acq_rel))
+        entries = fresh;
+      else
+        delete[] fresh;
+    }
+    return entries[offset];
+  }
+
+ private:
+  std::size_t shard_bits_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<Entry*> chunks_[kNumChunks];
+  std::atomic<std::size_t> next_id_;
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_INTERNER_H_
@@ -0,0 +1,141 @@
+//------------------------------------------------------------------------------
+// @file  mpmc_queue.h
+//------------------------------------------------------------------------------
+// @brief bounded lock-free multi-producer/multi-consumer queue.
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_MPMC_QUEUE_H_
+#define CPPUTIL_MPMC_QUEUE_H_
+#include <atomic>       // for std::atomic
+#include <cstddef>      // for std::size_t
+#include <memory>       // for std::allocator
+#include <new>          // for placement new
+#include <type_traits>  // for std::aligned_storage
+#include <utility>      // for std::move
+
+
+namespace cu {
+
+
+constexpr std::size_t kCacheLineSize = 64;
+
+
+//------------------------------------------------------------------------------
+// @brief hint to the cpu that we are in a spin-wait loop.
+//------------------------------------------------------------------------------
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// @class MpmcQueue<T>
+//------------------------------------------------------------------------------
+// ring of cells, each with a sequence number telling whether it is ready to be
+// written (seq == pos) or read (seq == pos + 1) for the lap 'pos'. producers
+// and consumers claim a position with one CAS on their own counter; the two
+// counters sit on separate cache lines. (D. Vyukov's bounded MPMC queue)
+// TryPush()/TryPop() never block. they fail when the queue is full/empty.
+//------------------------------------------------------------------------------
+template <typename T>
+class MpmcQueue {
+ public:
+  // capacity is rounded up to a power of two.
+  explicit MpmcQueue(std::size_t capacity)
+      : cells_{nullptr}, mask_{0}, enqueue_pos_{0}, dequeue_pos_{0} {
+    std::size_t cap = 2;
+    while (cap < capacity)
+      cap *= 2;
+    cells_ = std::allocator<Cell>().allocate(cap);
+    for (std::size_t i = 0; i < cap; i++)
+      new (&cells_[i].seq) std::atomic<std::size_t>(i);
+    mask_ = cap - 1;
+  }
+
+  ~MpmcQueue() {
+    T v;
+    while (TryPop(v)) { }
+    std::allocator<Cell>().deallocate(cells_, mask_ + 1);
+  }
+
+ public:
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue(MpmcQueue&&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(MpmcQueue&&) = delete;
+
+ public:
+  std::size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  // v is left untouched when the queue is full.
+  bool TryPush(T&& v) {
+    Cell* cell;
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      std::size_t seq = cell->seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::move(v));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T& v) {
+    Cell* cell;
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      std::size_t seq = cell->seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* p = reinterpret_cast<T*>(&cell->storage);
+    v = std::move(*p);
+    p->~T();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+ private:
+  char pad0_[kCacheLineSize];
+  Cell* cells_;
+  std::size_t mask_;
+  char pad1_[kCacheLineSize - sizeof(Cell*) - sizeof(std::size_t)];
+  std::atomic<std::size_t> enqueue_pos_;
+  char pad2_[kCacheLineSize - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> dequeue_pos_;
+  char pad3_[kCacheLineSize - sizeof(std::atomic<std::size_t>)];
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_MPMC_QUEUE_H_
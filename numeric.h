@@ -0,0 +1,561 @@
+//------------------------------------------------------------------------------
+// @file  numeric.h
+//------------------------------------------------------------------------------
+// @brief locale free, non allocating number <-> text conversion for strutil.
+//        (std::from_chars / std::to_chars of c++17, base 10)
+//------------------------------------------------------------------------------
+// integers are parsed 16 digits at a time with SSE2 and 8 at a time with SWAR
+// (eight digits in one 64 bit word), the rest one by one.
+// doubles whose digits fit into 2^53 with a power of ten up to 1e22 are
+// computed exactly with one multiplication or division, everything else goes
+// to strtod in the "C" locale.
+// doubles are formatted with the fewest digits that read back exactly.
+// @code
+// int port = 0;
+// auto r = cu::strutil::from_chars(s.data(), s.data() + s.size(), port);
+// if (r.ec != std::errc()) ...
+//
+// double d;
+// if (cu::strutil::parse(field, &d)) ...   // the whole field must be a number
+//
+// char buf[cu::strutil::kMaxDoubleChars];
+// std::size_t n = cu::strutil::to_chars(buf, buf + sizeof(buf), 0.1).ptr - buf;
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_NUMERIC_H_
+#define CPPUTIL_NUMERIC_H_
+#include <cmath>          // for std::isfinite, std::signbit
+#include <cstdint>        // for std::uint64_t
+#include <cstdio>         // for std::snprintf
+#include <cstdlib>        // for std::strtod
+#include <cstring>        // for std::memcpy
+#include <limits>         // for std::numeric_limits
+#include <string>         // for std::string
+#include <system_error>   // for std::errc
+#include <type_traits>    // for std::enable_if
+#include "string_view.h"  // for cu::StringView
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define CPPUTIL_HAS_STRTOD_L 1
+#include <locale.h>       // for newlocale
+#if defined(__APPLE__)
+#include <xlocale.h>      // for strtod_l
+#endif
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CPPUTIL_NUMERIC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CPPUTIL_NUMERIC_SWAR 1
+#endif
+
+
+namespace cu {
+namespace strutil {
+
+
+// buffer sizes which always suffice for to_chars.
+constexpr std::size_t kMaxIntChars = 20;     // -9223372036854775808
+constexpr std::size_t kMaxDoubleChars = 32;  // -1.2345678901234567e-308
+
+
+struct from_chars_result {
+  const char* ptr;
+  std::errc ec;
+};
+
+struct to_chars_result {
+  char* ptr;
+  std::errc ec;
+};
+
+
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// digit runs.
+//------------------------------------------------------------------------------
+inline bool IsDigit(char c) {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+#if defined(CPPUTIL_NUMERIC_SWAR)
+
+inline std::uint64_t Load8(const char* p) {
+  std::uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+// every byte in '0' - '9'.
+inline bool IsEightDigits(std::uint64_t v) {
+  return ((v & 0xF0F0F0F0F0F0F0F0ULL) |
+          (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+         0x3333333333333333ULL;
+}
+
+// 8 digits in 3 multiplications: pairs, then quads, then the whole.
+inline std::uint32_t ParseEightDigits(std::uint64_t v) {
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  return static_cast<std::uint32_t>(v);
+}
+
+#endif  // CPPUTIL_NUMERIC_SWAR
+
+#if defined(CPPUTIL_NUMERIC_SSE2)
+
+inline bool IsSixteenDigits(__m128i v) {
+  __m128i ge = _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1));
+  __m128i le = _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1));
+  return _mm_movemask_epi8(_mm_and_si128(ge, le)) == 0xFFFF;
+}
+
+// SSE2 only: digits widened to 16 bits, then pairs, quads and octets
+// combined by multiply-add.
+inline std::uint64_t ParseSixteenDigits(__m128i v) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+  const __m128i m10 = _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1);
+  __m128i pairs =
+      _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(d, zero), m10),
+                      _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), m10));
+  const __m128i m100 = _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1);
+  __m128i quads = _mm_madd_epi16(pairs, m100);
+  quads = _mm_packs_epi32(quads, quads);
+  const __m128i m1e4 = _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1);
+  __m128i octets = _mm_madd_epi16(quads, m1e4);
+  std::uint64_t hi = static_cast<std::uint32_t>(_mm_cvtsi128_si32(octets));
+  std::uint64_t lo = static_cast<std::uint32_t>(
+      _mm_cvtsi128_si32(_mm_srli_si128(octets, 4)));
+  return hi * 100000000ULL + lo;
+}
+
+#endif  // CPPUTIL_NUMERIC_SSE2
+
+
+//------------------------------------------------------------------------------
+// unsigned 64 bit value of the digits at p. p is left after the digits.
+// false on overflow. (p is still moved to the end of the digits then)
+//------------------------------------------------------------------------------
+inline bool ParseUint64(const char*& p, const char* last, std::uint64_t& out) {
+  std::uint64_t acc = 0;
+  bool ok = true;
+#if defined(CPPUTIL_NUMERIC_SSE2)
+  if (last - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    if (IsSixteenDigits(v)) {
+      acc = ParseSixteenDigits(v);
+      p += 16;
+    }
+  }
+#endif
+#if defined(CPPUTIL_NUMERIC_SWAR)
+  while (last - p >= 8) {
+    std::uint64_t v = Load8(p);
+    if (!IsEightDigits(v))
+      break;
+    std::uint64_t next;
+    if (__builtin_mul_overflow(acc, 100000000ULL, &next) ||
+        __builtin_add_overflow(next, ParseEightDigits(v), &next))
+      ok = false;
+    acc = next;
+    p += 8;
+  }
+#endif
+  for (; p != last && IsDigit(*p); p++) {
+    std::uint64_t next;
+    if (__builtin_mul_overflow(acc, 10ULL, &next) ||
+        __builtin_add_overflow(next, static_cast<std::uint64_t>(*p - '0'),
+                               &next))
+      ok = false;
+    acc = next;
+  }
+  out = acc;
+  return ok;
+}
+
+
+//------------------------------------------------------------------------------
+// integer formatting: two digits per division, from the back.
+//------------------------------------------------------------------------------
+inline const char* DigitPairs() {
+  static const char pairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233"
+      "34353637383940414243444546474849505152535455565758596061626364656667"
+      "6869707172737475767778798081828384858687888990919293949596979899";
+  return pairs;
+}
+
+inline std::size_t CountDigits(std::uint64_t v) {
+  std::size_t n = 1;
+  while (true) {
+    if (v < 10) return n;
+    if (v < 100) return n + 1;
+    if (v < 1000) return n + 2;
+    if (v < 10000) return n + 3;
+    v /= 10000;
+    n += 4;
+  }
+}
+
+// writes exactly CountDigits(v) chars.
+inline void FormatUint(std::uint64_t v, char* end) {
+  char* p = end;
+  while (v >= 100) {
+    const char* d = DigitPairs() + (v % 100) * 2;
+    v /= 100;
+    *--p = d[1];
+    *--p = d[0];
+  }
+  if (v >= 10) {
+    const char* d = DigitPairs() + v * 2;
+    *--p = d[1];
+    *--p = d[0];
+  } else {
+    *--p = static_cast<char>('0' + v);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// doubles.
+//------------------------------------------------------------------------------
+inline const double* ExactPowersOf10() {
+  static const double p[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  return p;
+}
+
+// strtod in the "C" locale, of [first, last). (copied to get a terminator)
+inline double StrtodC(const char* first, const char* last) {
+  char small[64];
+  std::string large;
+  const std::size_t n = static_cast<std::size_t>(last - first);
+  char* s = small;
+  if (n >= sizeof(small)) {
+    large.assign(first, n);
+    s = &large[0];
+  } else {
+    std::memcpy(small, first, n);
+    small[n] = '\0';
+  }
+#if defined(CPPUTIL_HAS_STRTOD_L)
+  static locale_t c_locale =
+      newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+  return strtod_l(s, nullptr, c_locale);
+#else
+  return std::strtod(s, nullptr);
+#endif
+}
+
+inline bool MatchNoCase(const char* p, const char* last, const char* word) {
+  for (; *word; word++, p++) {
+    if (p == last || (*p | 0x20) != *word)
+      return false;
+  }
+  return true;
+}
+
+inline strutil::from_chars_result ParseDouble(const char* first,
+                                              const char* last, double& out) {
+  const char* p = first;
+  const bool neg = (p != last && *p == '-');
+  if (neg)
+    p++;
+  // inf, infinity, nan
+  if (p != last && !IsDigit(*p) && *p != '.') {
+    const double inf = std::numeric_limits<double>::infinity();
+    if (MatchNoCase(p, last, "infinity")) {
+      out = neg ? -inf : inf;
+      return {p + 8, std::errc()};
+    }
+    if (MatchNoCase(p, last, "inf")) {
+      out = neg ? -inf : inf;
+      return {p + 3, std::errc()};
+    }
+    if (MatchNoCase(p, last, "nan")) {
+      out = neg ? -std::numeric_limits<double>::quiet_NaN()
+                : std::numeric_limits<double>::quiet_NaN();
+      return {p + 3, std::errc()};
+    }
+    return {first, std::errc::invalid_argument};
+  }
+
+  // mantissa: up to 19 significant digits go to m, the rest only count.
+  std::uint64_t m = 0;
+  int digits = 0;      // significant digits seen
+  int exp10 = 0;
+  bool any = false;
+  for (; p != last && IsDigit(*p); p++) {
+    any = true;
+    if (m == 0 && *p == '0')
+      continue;
+    if (digits < 19)
+      m = m * 10 + (*p - '0');
+    else
+      exp10++;
+    digits++;
+  }
+  if (p != last && *p == '.') {
+    p++;
+    for (; p != last && IsDigit(*p); p++) {
+      any = true;
+      if (m == 0 && *p == '0') {
+        exp10--;
+        continue;
+      }
+      if (digits < 19) {
+        m = m * 10 + (*p - '0');
+        exp10--;
+      }
+      digits++;
+    }
+  }
+  if (!any)
+    return {first, std::errc::invalid_argument};
+  if (p != last && (*p == 'e' || *p == 'E')) {
+    const char* e = p + 1;
+    bool eneg = false;
+    if (e != last && (*e == '-' || *e == '+')) {
+      eneg = (*e == '-');
+      e++;
+    }
+    if (e != last && IsDigit(*e)) {
+      int x = 0;
+      for (; e != last && IsDigit(*e); e++) {
+        if (x < 100000)
+          x = x * 10 + (*e - '0');
+      }
+      exp10 += eneg ? -x : x;
+      p = e;
+    }
+  }
+
+  double value;
+  if (m == 0) {
+    value = 0.0;
+  } else if (digits <= 19 && m <= (1ULL << 53) && exp10 >= -22 &&
+             exp10 <= 22) {
+    // both operands exact, so the one rounding is the correct one.
+    value = static_cast<double>(m);
+    value = exp10 < 0 ? value / ExactPowersOf10()[-exp10]
+                      : value * ExactPowersOf10()[exp10];
+  } else {
+    value = StrtodC(neg ? first + 1 : first, p);
+    if (std::isinf(value) || value == 0.0)
+      return {p, std::errc::result_out_of_range};
+  }
+  out = neg ? -value : value;
+  return {p, std::errc()};
+}
+
+// %.<min>g ... %.<max>g, the first which reads back as v. (v is a double or
+// a float) with 'min' at DBL_DIG / FLT_DIG that is also the shortest: every
+// decimal of that many digits reads back unchanged, so if a shorter one
+// reads back as v, it is the %.<min>g one with its trailing zeros dropped.
+// that doesn't hold for subnormals, they start at 1 digit.
+template <typename T>
+inline char* FormatShortest(T v, int min, int max, char* out) {
+  int n = 0;
+  for (int precision = min; precision <= max; precision++) {
+    n = std::snprintf(out, strutil::kMaxDoubleChars - 1, "%.*g", precision,
+                      static_cast<double>(v));
+    for (int i = 0; i < n; i++) {
+      if (out[i] == ',')
+        out[i] = '.';  // the decimal point of the current locale
+    }
+    if (static_cast<T>(StrtodC(out, out + n)) == v)
+      break;
+  }
+  return out + n;
+}
+
+// fewest digits which read back as v. fixed notation for 1e-5 <= |v| < 1e15
+// when a few decimals are enough, otherwise %.15g / %.16g / %.17g.
+// (subnormals from %.1g up)
+inline char* FormatDouble(double v, char* out) {
+  if (std::isnan(v)) {
+    std::memcpy(out, "nan", 3);
+    return out + 3;
+  }
+  char* p = out;
+  if (std::signbit(v)) {
+    *p++ = '-';
+    v = -v;
+  }
+  if (std::isinf(v)) {
+    std::memcpy(p, "inf", 3);
+    return p + 3;
+  }
+  if (v == 0) {
+    *p = '0';
+    return p + 1;
+  }
+  if (v >= 1e-5 && v < 1e15) {
+    // v == m / 10^k exactly as a double for the smallest k, then m with k
+    // decimals reads back as v. (m and 10^k are exact, so is the division)
+    for (int k = 0; k <= 8; k++) {
+      double scaled = v * ExactPowersOf10()[k];
+      if (scaled >= 9007199254740992.0)  // 2^53
+        break;
+      double m = std::nearbyint(scaled);
+      if (m / ExactPowersOf10()[k] != v)
+        continue;
+      std::uint64_t mi = static_cast<std::uint64_t>(m);
+      std::uint64_t whole = mi;
+      std::uint64_t frac = 0;
+      if (k > 0) {
+        whole = mi / static_cast<std::uint64_t>(ExactPowersOf10()[k]);
+        frac = mi % static_cast<std::uint64_t>(ExactPowersOf10()[k]);
+      }
+      std::size_t n = CountDigits(whole);
+      FormatUint(whole, p + n);
+      p += n;
+      if (k > 0) {
+        *p++ = '.';
+        // frac has k digits with leading zeros, trailing zeros can't occur.
+        // (k would have been smaller)
+        for (int i = k - 1; i >= 0; i--) {
+          p[i] = static_cast<char>('0' + frac % 10);
+          frac /= 10;
+        }
+        p += k;
+      }
+      return p;
+    }
+  }
+  return FormatShortest(v, v < std::numeric_limits<double>::min() ? 1 : 15,
+                        17, p);
+}
+
+// float: the same with 6 - 9 digits.
+inline char* FormatFloat(float v, char* out) {
+  if (!std::isfinite(v) || v == 0)
+    return FormatDouble(v, out);
+  const float min = std::numeric_limits<float>::min();
+  return FormatShortest(v, v > -min && v < min ? 1 : 6, 9, out);
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// [-]digits into an integer of any width. no '+', no spaces, no base prefix.
+// ec is invalid_argument if there are no digits (ptr == first), or
+// result_out_of_range if they don't fit into T. (ptr after the digits)
+// value is only changed on success.
+//------------------------------------------------------------------------------
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                               !std::is_same<T, bool>::value,
+                               from_chars_result>::type
+from_chars(const char* first, const char* last, T& value) {
+  const char* p = first;
+  bool neg = false;
+  if (std::is_signed<T>::value && p != last && *p == '-') {
+    neg = true;
+    p++;
+  }
+  if (p == last || !detail::IsDigit(*p))
+    return {first, std::errc::invalid_argument};
+  std::uint64_t u;
+  bool ok = detail::ParseUint64(p, last, u);
+  using U = typename std::make_unsigned<T>::type;
+  const std::uint64_t max = static_cast<U>(std::numeric_limits<T>::max());
+  if (!ok || u > max + (neg ? 1 : 0))
+    return {p, std::errc::result_out_of_range};
+  value = neg ? static_cast<T>(0 - static_cast<U>(u)) : static_cast<T>(u);
+  return {p, std::errc()};
+}
+
+//------------------------------------------------------------------------------
+// [-](digits[.digits] | .digits)[(e|E)[+|-]digits], inf, infinity or nan.
+// (case insensitive) errors as for integers.
+//------------------------------------------------------------------------------
+inline from_chars_result from_chars(const char* first, const char* last,
+                                    double& value) {
+  return detail::ParseDouble(first, last, value);
+}
+
+inline from_chars_result from_chars(const char* first, const char* last,
+                                    float& value) {
+  double d;
+  from_chars_result r = detail::ParseDouble(first, last, d);
+  if (r.ec == std::errc()) {
+    if (std::isfinite(d) && std::fabs(d) > std::numeric_limits<float>::max())
+      return {r.ptr, std::errc::result_out_of_range};
+    value = static_cast<float>(d);
+  }
+  return r;
+}
+
+//------------------------------------------------------------------------------
+// formats value at first. ec is value_too_large (ptr == last) if it doesn't
+// fit, kMaxIntChars / kMaxDoubleChars always do.
+//------------------------------------------------------------------------------
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                               !std::is_same<T, bool>::value,
+                               to_chars_result>::type
+to_chars(char* first, char* last, T value) {
+  using U = typename std::make_unsigned<T>::type;
+  U u = static_cast<U>(value);
+  bool neg = value < 0;
+  if (neg)
+    u = static_cast<U>(0 - u);
+  const std::size_t n = detail::CountDigits(u) + (neg ? 1 : 0);
+  if (static_cast<std::size_t>(last - first) < n)
+    return {last, std::errc::value_too_large};
+  if (neg)
+    *first = '-';
+  detail::FormatUint(u, first + n);
+  return {first + n, std::errc()};
+}
+
+inline to_chars_result to_chars(char* first, char* last, double value) {
+  char buf[kMaxDoubleChars];
+  char* end = detail::FormatDouble(value, buf);
+  const std::size_t n = static_cast<std::size_t>(end - buf);
+  if (static_cast<std::size_t>(last - first) < n)
+    return {last, std::errc::value_too_large};
+  std::memcpy(first, buf, n);
+  return {first + n, std::errc()};
+}
+
+inline to_chars_result to_chars(char* first, char* last, float value) {
+  char buf[kMaxDoubleChars];
+  char* end = detail::FormatFloat(value, buf);
+  const std::size_t n = static_cast<std::size_t>(end - buf);
+  if (static_cast<std::size_t>(last - first) < n)
+    return {last, std::errc::value_too_large};
+  std::memcpy(first, buf, n);
+  return {first + n, std::errc()};
+}
+
+//------------------------------------------------------------------------------
+// true if all of s is a number, which is stored into *value.
+//------------------------------------------------------------------------------
+template <typename T>
+inline bool parse(StringView s, T* value) {
+  T v;
+  from_chars_result r = from_chars(s.data(), s.data() + s.size(), v);
+  if (r.ec != std::errc() || r.ptr != s.data() + s.size())
+    return false;
+  *value = v;
+  return true;
+}
+
+
+}  // namespace strutil
+}  // namespace cu
+#endif  // CPPUTIL_NUMERIC_H_
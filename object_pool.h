@@ -0,0 +1,235 @@
+//------------------------------------------------------------------------------
+// @file  object_pool.h
+//------------------------------------------------------------------------------
+// @brief thread-caching pool of fixed-size objects, and an STL allocator
+//        on top of it.
+//------------------------------------------------------------------------------
+// objects of the same size and alignment share one pool. a thread allocates
+// from and frees into a free list of its own, so an object freed on another
+// thread than it was made on costs no more than a local one. batches move
+// through a shared list only when a thread runs dry or has cached too many.
+// memory is never given back to the system. objects over kMaxPooledSize
+// bytes (or over-aligned ones) go to operator new.
+// @code
+// Node* n = cu::ObjectPool<Node>::New(key, value);
+// cu::ObjectPool<Node>::Delete(n);
+// std::map<int, int, std::less<int>,
+//          cu::PoolAllocator<std::pair<const int, int>>> m;  // pooled nodes
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_OBJECT_POOL_H_
+#define CPPUTIL_OBJECT_POOL_H_
+#include <cstddef>      // for std::max_align_t
+#include <limits>       // for std::numeric_limits
+#include <mutex>        // for std::mutex
+#include <new>          // for operator new, std::bad_alloc
+#include <type_traits>  // for std::aligned_storage
+#include <utility>      // for std::forward
+
+
+namespace cu {
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// @class SlabPool<Size, Align>
+//------------------------------------------------------------------------------
+// fixed-size free list. memory is carved out of slabs of kBatch objects and
+// is never given back to the system. each thread keeps its own free list,
+// batches move through a shared list only when a thread runs dry or has
+// cached too many.
+//------------------------------------------------------------------------------
+template <std::size_t Size, std::size_t Align>
+class SlabPool {
+  static_assert(Align <= alignof(std::max_align_t),
+                "over-aligned objects can't be pooled");
+
+ public:
+  static void* Allocate() {
+    Cache& c = Local();
+    if (c.head == nullptr)
+      Refill(c);
+    Node* n = c.head;
+    c.head = n->next;
+    c.count--;
+    return n;
+  }
+
+  static void Deallocate(void* p) {
+    Cache& c = Local();
+    Node* n = static_cast<Node*>(p);
+    n->next = c.head;
+    c.head = n;
+    c.count++;
+    if (c.count >= 2 * kBatch)
+      Flush(c, kBatch);
+  }
+
+ private:
+  static constexpr std::size_t kBatch = 64;
+
+  union Node {
+    Node* next;
+    typename std::aligned_storage<Size, Align>::type storage;
+  };
+
+  struct Cache {
+    Node* head;
+    std::size_t count;
+    ~Cache() { Flush(*this, count); }
+  };
+
+  struct Shared {
+    std::mutex mtx;
+    Node* head;
+  };
+
+  static Cache& Local() {
+    static thread_local Cache cache{nullptr, 0};
+    return cache;
+  }
+
+  // never destroyed, thread caches may flush into it at any time.
+  static Shared& Global() {
+    static Shared* shared = new Shared{{}, nullptr};
+    return *shared;
+  }
+
+  static void Refill(Cache& c) {
+    {
+      Shared& g = Global();
+      std::unique_lock<std::mutex> lock(g.mtx);
+      while (g.head && c.count < kBatch) {
+        Node* n = g.head;
+        g.head = n->next;
+        n->next = c.head;
+        c.head = n;
+        c.count++;
+      }
+    }
+    if (c.head)
+      return;
+    Node* slab = static_cast<Node*>(::operator new(sizeof(Node) * kBatch));
+    for (std::size_t i = 0; i < kBatch; i++) {
+      slab[i].next = c.head;
+      c.head = &slab[i];
+    }
+    c.count = kBatch;
+  }
+
+  static void Flush(Cache& c, std::size_t n) {
+    if (n == 0)
+      return;
+    Node* first = c.head;
+    Node* last = first;
+    for (std::size_t i = 1; i < n; i++)
+      last = last->next;
+    c.head = last->next;
+    c.count -= n;
+    Shared& g = Global();
+    std::unique_lock<std::mutex> lock(g.mtx);
+    last->next = g.head;
+    g.head = first;
+  }
+};
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class ObjectPool<T>
+// @brief memory for single objects of type T, from the pool of its size.
+//------------------------------------------------------------------------------
+template <typename T>
+class ObjectPool {
+ public:
+  static constexpr std::size_t kMaxPooledSize = 512;
+  static constexpr bool kPooled =
+      sizeof(T) <= kMaxPooledSize && alignof(T) <= alignof(std::max_align_t);
+
+ public:
+  static void* Allocate() {
+    return kPooled ? Slabs::Allocate() : ::operator new(sizeof(T));
+  }
+
+  static void Deallocate(void* p) {
+    if (kPooled)
+      Slabs::Deallocate(p);
+    else
+      ::operator delete(p);
+  }
+
+  template <typename... Args>
+  static T* New(Args&&... args) {
+    void* p = Allocate();
+    try {
+      return new (p) T(std::forward<Args>(args)...);
+    } catch (...) {
+      Deallocate(p);
+      throw;
+    }
+  }
+
+  static void Delete(T* p) {
+    if (p) {
+      p->~T();
+      Deallocate(p);
+    }
+  }
+
+ private:
+  // (rounded up, so that nearby sizes share a pool)
+  using Slabs = detail::SlabPool<
+      (sizeof(T) + 15) / 16 * 16,
+      kPooled ? alignof(T) : alignof(std::max_align_t)>;
+};
+
+
+//------------------------------------------------------------------------------
+// @class PoolAllocator<T>
+//------------------------------------------------------------------------------
+// STL allocator taking single objects from ObjectPool<T>: meant for node
+// based containers (list, map, set, unordered_* nodes) and shared states
+// (std::allocate_shared, std::promise). arrays go to operator new. stateless,
+// so any two compare equal.
+//------------------------------------------------------------------------------
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+ public:
+  PoolAllocator() noexcept = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept { }  // NOLINT (rebind)
+
+  T* allocate(std::size_t n) {
+    if (n == 1)
+      return static_cast<T*>(ObjectPool<T>::Allocate());
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      throw std::bad_alloc();
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    if (n == 1)
+      ObjectPool<T>::Deallocate(p);
+    else
+      ::operator delete(p);
+  }
+};
+
+template <typename T, typename U>
+inline bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return false;
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_OBJECT_POOL_H_
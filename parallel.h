@@ -0,0 +1,193 @@
+//------------------------------------------------------------------------------
+// @file  parallel.h
+//------------------------------------------------------------------------------
+// @brief parallel_for / parallel_reduce on top of ThreadPool.
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_PARALLEL_H_
+#define CPPUTIL_PARALLEL_H_
+#include <algorithm>           // for std::min
+#include <atomic>              // for std::atomic
+#include <condition_variable>  // for std::condition_variable
+#include <exception>           // for std::exception_ptr
+#include <memory>              // for std::shared_ptr
+#include <mutex>               // for std::mutex
+#include <vector>              // for std::vector
+#include "thread_pool.h"
+//------------------------------------------------------------------------------
+// @code
+// std::vector<double> v(n);
+// std::size_t zero = 0;
+// cu::parallel_for(pool, zero, n, [&](std::size_t i) { v[i] = f(i); });
+// double sum = cu::parallel_reduce(pool, zero, n, 0.0,
+//                                  [&](std::size_t i) { return v[i]; },
+//                                  std::plus<double>());
+// @endcode
+//------------------------------------------------------------------------------
+
+
+namespace cu {
+namespace detail {
+
+
+// chunks per worker when the grain size is chosen automatically.
+// more chunks than workers lets fast workers pick up the slack of slow ones.
+constexpr std::size_t kChunksPerThread = 8;
+
+
+//------------------------------------------------------------------------------
+// @brief grain size for [0, n) on the pool. (grain == 0 means automatic)
+//------------------------------------------------------------------------------
+inline std::size_t GrainSize(const ThreadPool& pool, std::size_t n,
+                             std::size_t grain) {
+  if (grain > 0)
+    return grain;
+  std::size_t chunks = (pool.num_threads() + 1) * kChunksPerThread;
+  return std::max<std::size_t>(1, n / chunks);
+}
+
+
+//------------------------------------------------------------------------------
+// @class ChunkRunner
+//------------------------------------------------------------------------------
+// chunks are claimed through one atomic counter by the caller and by helper
+// tasks posted in one batch. the caller only waits for claimed chunks, so a
+// helper which starts late (or never, because every worker is blocked in
+// another parallel_for) finds nothing left and quits without touching 'body'.
+//------------------------------------------------------------------------------
+class ChunkRunner {
+ public:
+  explicit ChunkRunner(std::size_t chunks)
+      : chunks_{chunks}, next_{0}, done_{0}, failed_{false},
+        mtx_{}, cond_{}, error_{} { }
+
+  template <typename Body>
+  void Work(Body& body) {
+    while (true) {
+      std::size_t c = next_.fetch_add(1, std::memory_order_relaxed);
+      if (c >= chunks_)
+        return;
+      if (!failed_.load(std::memory_order_relaxed)) {
+        try {
+          body(c);
+        } catch (...) {
+          std::unique_lock<std::mutex> lock(mtx_);
+          if (!failed_)
+            error_ = std::current_exception();
+          failed_ = true;
+        }
+      }
+      if (done_.fetch_add(1) + 1 == chunks_) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.notify_all();
+      }
+    }
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this] { return done_ == chunks_; });
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+ private:
+  const std::size_t chunks_;
+  std::atomic<std::size_t> next_;
+  std::atomic<std::size_t> done_;
+  std::atomic<bool> failed_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  std::exception_ptr error_;
+};
+
+
+//------------------------------------------------------------------------------
+// @brief run body(0) ... body(chunks - 1) on the pool and the calling thread.
+//------------------------------------------------------------------------------
+template <typename Body>
+inline void RunChunks(ThreadPool& pool, std::size_t chunks, Body& body) {
+  if (chunks == 0)
+    return;
+  auto runner = std::make_shared<ChunkRunner>(chunks);
+  std::size_t helpers = std::min(pool.num_threads(), chunks - 1);
+  if (helpers > 0) {
+    Body* b = &body;
+    pool.PostBulk(helpers, [runner, b](std::size_t) { runner->Work(*b); });
+  }
+  runner->Work(body);
+  runner->Wait();
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief call fn(i) for every i in [begin, end).
+// @param grain number of indices per chunk. 0 chooses it from the pool size.
+//------------------------------------------------------------------------------
+template <typename Index, typename F>
+inline void parallel_for(ThreadPool& pool, Index begin, Index end,
+                         std::size_t grain, F fn) {
+  if (!(begin < end))
+    return;
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  grain = detail::GrainSize(pool, n, grain);
+  const std::size_t chunks = (n + grain - 1) / grain;
+  auto body = [&](std::size_t c) {
+    Index first = begin + static_cast<Index>(c * grain);
+    Index last = begin + static_cast<Index>(std::min(n, (c + 1) * grain));
+    for (Index i = first; i < last; ++i)
+      fn(i);
+  };
+  detail::RunChunks(pool, chunks, body);
+}
+
+template <typename Index, typename F>
+inline void parallel_for(ThreadPool& pool, Index begin, Index end, F fn) {
+  parallel_for(pool, begin, end, 0, std::move(fn));
+}
+
+
+//------------------------------------------------------------------------------
+// @brief reduce(... reduce(reduce(identity, map(begin)), map(begin + 1)) ...)
+//        reduce must be associative. partial results are combined in index
+//        order, so it doesn't need to be commutative.
+// @param grain number of indices per chunk. 0 chooses it from the pool size.
+//------------------------------------------------------------------------------
+template <typename Index, typename T, typename Map, typename Reduce>
+inline T parallel_reduce(ThreadPool& pool, Index begin, Index end,
+                         std::size_t grain, T identity,
+                         Map map, Reduce reduce) {
+  if (!(begin < end))
+    return identity;
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  grain = detail::GrainSize(pool, n, grain);
+  const std::size_t chunks = (n + grain - 1) / grain;
+  std::vector<T> partials(chunks, identity);
+  auto body = [&](std::size_t c) {
+    Index first = begin + static_cast<Index>(c * grain);
+    Index last = begin + static_cast<Index>(std::min(n, (c + 1) * grain));
+    T acc = identity;
+    for (Index i = first; i < last; ++i)
+      acc = reduce(std::move(acc), map(i));
+    partials[c] = std::move(acc);
+  };
+  detail::RunChunks(pool, chunks, body);
+
+  T result = std::move(identity);
+  for (auto& p : partials)
+    result = reduce(std::move(result), std::move(p));
+  return result;
+}
+
+template <typename Index, typename T, typename Map, typename Reduce>
+inline T parallel_reduce(ThreadPool& pool, Index begin, Index end,
+                         T identity, Map map, Reduce reduce) {
+  return parallel_reduce(pool, begin, end, 0, std::move(identity),
+                         std::move(map), std::move(reduce));
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_PARALLEL_H_
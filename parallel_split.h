@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// @file  parallel_split.h
+//------------------------------------------------------------------------------
+// @brief strutil::split of one large buffer on a ThreadPool.
+//------------------------------------------------------------------------------
+// the buffer is cut into chunks which are searched for the delimiter in
+// parallel, each from its own start. a delimiter can straddle a chunk
+// boundary, and with a self-overlapping delimiter ("aa" in "aaa") where the
+// scan starts decides which occurrences count. so the chunks are stitched in
+// order: each starts where the last delimiter of the previous one ends, and
+// is rescanned from there until it meets one of its own occurrences again
+// (right away unless the delimiter overlaps itself). the pieces are then
+// built in parallel, in the original order.
+// results are the same as strutil::split(str, delim, accept_empty).
+// @code
+// cu::ThreadPool pool;
+// cu::RecordReader file("dump.tsv");
+// std::vector<cu::StringView> fields =
+//     cu::strutil::parallel_split_view(pool, file.data(), "\t");
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_PARALLEL_SPLIT_H_
+#define CPPUTIL_PARALLEL_SPLIT_H_
+#include <algorithm>      // for std::lower_bound, std::max
+#include <cstddef>        // for std::size_t
+#include <string>         // for std::string
+#include <vector>         // for std::vector
+#include "char_scan.h"    // for cu::scan::find_char
+#include "parallel.h"     // for cu::parallel_for
+#include "string_view.h"  // for cu::StringView
+#include "thread_pool.h"  // for cu::ThreadPool
+
+
+namespace cu {
+namespace strutil {
+
+
+//------------------------------------------------------------------------------
+// @struct Span
+// @brief one piece as an offset into the split buffer.
+//------------------------------------------------------------------------------
+struct Span {
+  std::size_t offset;
+  std::size_t size;
+};
+
+
+namespace detail {
+
+
+// chunks smaller than this are not worth a task.
+constexpr std::size_t kMinSplitChunk = 256 << 10;
+
+
+//------------------------------------------------------------------------------
+// @class ParallelSplitter
+//------------------------------------------------------------------------------
+// finds the delimiters of str (phase 1 and 2 above), then Build() makes the
+// pieces with make(begin, end).
+//------------------------------------------------------------------------------
+class ParallelSplitter {
+ public:
+  ParallelSplitter(ThreadPool& pool, StringView str, StringView delim,
+                   bool accept_empty, std::size_t grain)
+      : pool_(pool), str_{str}, delim_{delim}, accept_empty_{accept_empty} {
+    if (grain == 0)
+      grain = std::max(kMinSplitChunk,
+                       str.size() / (4 * (pool.num_threads() + 1)));
+    const std::size_t chunks = (str.size() + grain - 1) / grain;
+    bounds_.resize(chunks + 1);
+    for (std::size_t k = 0; k < chunks; k++)
+      bounds_[k] = k * grain;
+    bounds_[chunks] = str.size();
+    matches_.resize(chunks);
+    Scan();
+    Stitch();
+  }
+
+  // pieces in order. T is built by make(begin, end).
+  template <typename T, typename Make>
+  std::vector<T> Build(Make make) const {
+    const std::size_t chunks = matches_.size();
+    // piece i of chunk k ends at its i-th delimiter. the piece after the last
+    // delimiter comes at the very end.
+    std::vector<std::size_t> first(chunks + 1, 0);
+    for (std::size_t k = 0; k < chunks; k++)
+      first[k + 1] = first[k] + counts_[k];
+    const std::size_t tail = last_end_ < str_.size() ? 1 : 0;
+    std::vector<T> result(first[chunks] + tail);
+    parallel_for(pool_, std::size_t(0), chunks, 1, [&](std::size_t k) {
+      std::size_t prev = prev_end_[k];
+      std::size_t out = first[k];
+      for (std::size_t m : matches_[k]) {
+        if (accept_empty_ || prev < m)
+          result[out++] = make(prev, m);
+        prev = m + delim_.size();
+      }
+    });
+    if (tail)
+      result.back() = make(last_end_, str_.size());
+    return result;
+  }
+
+ private:
+  std::size_t Find(std::size_t pos) const {
+    if (delim_.size() == 1)
+      return scan::find_char(str_, delim_[0], pos);
+    return str_.find(delim_, pos);
+  }
+
+  // phase 1: the delimiters starting in each chunk, scanning from its start.
+  void Scan() {
+    parallel_for(pool_, std::size_t(0), matches_.size(), 1,
+                 [this](std::size_t k) {
+      std::vector<std::size_t>& found = matches_[k];
+      std::size_t pos = bounds_[k];
+      while (true) {
+        pos = Find(pos);
+        if (pos == StringView::npos || pos >= bounds_[k + 1])
+          break;
+        found.push_back(pos);
+        pos += delim_.size();
+      }
+    });
+  }
+
+  // phase 2: in order, drop what the previous chunk's last delimiter
+  // covers and rescan until both scans meet. counts pieces per chunk.
+  void Stitch() {
+    const std::size_t chunks = matches_.size();
+    counts_.resize(chunks);
+    prev_end_.resize(chunks);
+    std::size_t end = 0;  // end of the last delimiter so far
+    for (std::size_t k = 0; k < chunks; k++) {
+      std::vector<std::size_t>& found = matches_[k];
+      if (end > bounds_[k]) {
+        std::vector<std::size_t> fixed;
+        std::size_t pos = end;
+        while (true) {
+          pos = Find(pos);
+          if (pos == StringView::npos || pos >= bounds_[k + 1])
+            break;
+          auto it = std::lower_bound(found.begin(), found.end(), pos);
+          if (it != found.end() && *it == pos) {
+            fixed.insert(fixed.end(), it, found.end());
+            break;
+          }
+          fixed.push_back(pos);
+          pos += delim_.size();
+        }
+        found.swap(fixed);
+      }
+      prev_end_[k] = end;
+      std::size_t count = 0;
+      for (std::size_t m : found) {
+        if (accept_empty_ || end < m)
+          count++;
+        end = m + delim_.size();
+      }
+      counts_[k] = count;
+    }
+    last_end_ = end;
+  }
+
+ private:
+  ThreadPool& pool_;
+  StringView str_;
+  StringView delim_;
+  bool accept_empty_;
+  // chunk k is [bounds_[k], bounds_[k + 1]). matches_[k] are the offsets of
+  // its delimiters, prev_end_[k] where its first piece starts.
+  std::vector<std::size_t> bounds_;
+  std::vector<std::vector<std::size_t>> matches_;
+  std::vector<std::size_t> counts_;  // pieces per chunk
+  std::vector<std::size_t> prev_end_;
+  std::size_t last_end_;
+};
+
+
+// the cases split() answers without searching.
+template <typename T, typename Make>
+inline bool SplitTrivially(StringView str, StringView delim,
+                           std::vector<T>* result, Make make) {
+  if (str.empty())
+    return true;
+  if (delim.empty() || delim.size() > str.size()) {
+    result->push_back(make(0, str.size()));
+    return true;
+  }
+  return false;
+}
+
+
+template <typename T, typename Make>
+inline std::vector<T> ParallelSplit(ThreadPool& pool, StringView str,
+                                    StringView delim, bool accept_empty,
+                                    std::size_t grain, Make make) {
+  std::vector<T> result;
+  if (SplitTrivially(str, delim, &result, make))
+    return result;
+  return ParallelSplitter(pool, str, delim, accept_empty, grain)
+      .Build<T>(make);
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// split(str, delim, accept_empty) on the pool, as views into str.
+// @param grain bytes per chunk. 0 chooses it from the pool size.
+//------------------------------------------------------------------------------
+inline std::vector<StringView>
+parallel_split_view(ThreadPool& pool, StringView str, StringView delim,
+                    bool accept_empty = false, std::size_t grain = 0) {
+  return detail::ParallelSplit<StringView>(
+      pool, str, delim, accept_empty, grain,
+      [str](std::size_t b, std::size_t e) {
+        return StringView(str.data() + b, e - b);
+      });
+}
+
+//------------------------------------------------------------------------------
+// the same as (offset, size) pairs, e.g. to keep after str is gone.
+//------------------------------------------------------------------------------
+inline std::vector<Span>
+parallel_split_offsets(ThreadPool& pool, StringView str, StringView delim,
+                       bool accept_empty = false, std::size_t grain = 0) {
+  return detail::ParallelSplit<Span>(
+      pool, str, delim, accept_empty, grain,
+      [](std::size_t b, std::size_t e) { return Span{b, e - b}; });
+}
+
+//------------------------------------------------------------------------------
+// the same as owned strings, like split(). (strings are built in parallel)
+//------------------------------------------------------------------------------
+inline std::vector<std::string>
+parallel_split(ThreadPool& pool, const std::string& str,
+               const std::string& delim, bool accept_empty = false,
+               std::size_t grain = 0) {
+  return detail::ParallelSplit<std::string>(
+      pool, str, delim, accept_empty, grain,
+      [&str](std::size_t b, std::size_t e) { return str.substr(b, e - b); });
+}
+
+
+}  // namespace strutil
+}  // namespace cu
+#endif  // CPPUTIL_PARALLEL_SPLIT_H_
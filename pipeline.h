@@ -0,0 +1,486 @@
+//------------------------------------------------------------------------------
+// @file  pipeline.h
+//------------------------------------------------------------------------------
+// @brief streaming pipeline: stages on dedicated ThreadPool workers,
+//        connected by lock-free rings.
+//------------------------------------------------------------------------------
+// a source is an MpscRing any thread can push into. every stage occupies one
+// pool worker for as long as the pipeline runs: it drains its input ring in
+// batches, calls its function on each element in place and pushes the result
+// into an SpscRing read by the next stage. once started, an element goes
+// from the source to the sink without a lock or an allocation. (as long as
+// the stage functions don't allocate)
+// the element type of a source needs a noexcept move constructor.
+//
+// a full ring holds its producer back. an idle stage spins for a while,
+// then yields, then naps for 50us at a time until input arrives.
+// if a stage function throws, the pipeline stops: every stage returns,
+// Push() returns false and Finish() rethrows the first exception.
+// @code
+// cu::ThreadPool pool{2};
+// cu::Pipeline pipeline(pool, 4096);  // capacity of each ring
+// auto lines = pipeline.Source<std::string>();
+// auto counts = pipeline.Stage(lines, [](std::string& s) { return Count(s); });
+// pipeline.Sink(counts, [&total](std::size_t& n) { total += n; });
+// pipeline.Start();
+// for (auto& line : input)
+//   lines.Push(std::move(line));
+// pipeline.Finish();  // everything pushed has gone through the sink
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_PIPELINE_H_
+#define CPPUTIL_PIPELINE_H_
+#include <atomic>              // for std::atomic
+#include <chrono>              // for std::chrono::microseconds
+#include <condition_variable>  // for std::condition_variable
+#include <cstddef>             // for std::size_t
+#include <exception>           // for std::exception_ptr
+#include <memory>              // for std::unique_ptr
+#include <mutex>               // for std::mutex
+#include <string>              // for std::to_string
+#include <thread>              // for std::this_thread::yield
+#include <type_traits>         // for std::result_of, std::decay
+#include <utility>             // for std::move
+#include <vector>              // for std::vector
+#include "exception.h"         // for cu::LogicError
+#include "mpmc_queue.h"        // for cu::CpuRelax
+#include "ring_buffer.h"       // for cu::SpscRing, cu::MpscRing
+#include "thread_pool.h"       // for cu::ThreadPool
+
+
+namespace cu {
+
+
+class Pipeline;
+
+namespace detail {
+
+// elements a stage takes from its input ring at once.
+constexpr std::size_t kPipeBatch = 64;
+
+// waiting on a ring: spin, then yield, then sleep.
+class PipeBackoff {
+ public:
+  void Pause() {
+    if (n_ < kSpins) {
+      CpuRelax();
+      n_++;
+    } else if (n_ < kSpins + kYields) {
+      std::this_thread::yield();
+      n_++;
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  void Reset() {
+    n_ = 0;
+  }
+
+ private:
+  static constexpr unsigned kSpins = 64;
+  static constexpr unsigned kYields = 64;
+  unsigned n_ = 0;
+};
+
+// a ring between two stages. 'closed' is raised by the producing side after
+// its last push.
+struct PipeChannelBase {
+  virtual ~PipeChannelBase() = default;
+  std::atomic<bool> closed{false};
+  bool consumed = false;
+};
+
+template <typename T, typename Ring>
+struct PipeChannel : PipeChannelBase {
+  explicit PipeChannel(std::size_t capacity) : ring(capacity) { }
+  Ring ring;
+};
+
+struct PipeStageBase {
+  virtual ~PipeStageBase() = default;
+  // returns when the input is closed and drained, or on 'abort'.
+  virtual void Run(const std::atomic<bool>& abort) = 0;
+  PipeChannelBase* output = nullptr;
+};
+
+template <typename F, typename T>
+using PipeResult =
+    typename std::decay<typename std::result_of<F&(T&)>::type>::type;
+
+// moves v into the ring, waiting for room. false on abort.
+template <typename Ring, typename T>
+bool PipePush(Ring& ring, T& v, const std::atomic<bool>& abort) {
+  if (ring.TryPush(std::move(v)))
+    return true;
+  PipeBackoff backoff;
+  while (!ring.TryPush(std::move(v))) {
+    if (abort.load(std::memory_order_relaxed))
+      return false;
+    backoff.Pause();
+  }
+  return true;
+}
+
+// calls f(T&) on every element of 'in' until it is closed and empty.
+template <typename T, typename Ring, typename F>
+void PipePump(PipeChannel<T, Ring>& in, const std::atomic<bool>& abort,
+              F& f) {
+  PipeBackoff backoff;
+  while (!abort.load(std::memory_order_relaxed)) {
+    if (in.ring.Drain(f, kPipeBatch) > 0) {
+      backoff.Reset();
+      continue;
+    }
+    // everything pushed before 'closed' is visible once it is seen.
+    if (in.closed.load(std::memory_order_acquire) && in.ring.empty())
+      return;
+    backoff.Pause();
+  }
+}
+
+template <typename In, typename Ring, typename Out, typename F>
+class PipeStage : public PipeStageBase {
+ public:
+  PipeStage(PipeChannel<In, Ring>* in, PipeChannel<Out, SpscRing<Out>>* out,
+            F f)
+      : in_{in}, out_{out}, f_(std::move(f)) {
+    output = out;
+  }
+
+  void Run(const std::atomic<bool>& abort) override {
+    auto body = [this, &abort](In& v) {
+      Out result = f_(v);
+      PipePush(out_->ring, result, abort);
+    };
+    PipePump(*in_, abort, body);
+  }
+
+ private:
+  PipeChannel<In, Ring>* in_;
+  PipeChannel<Out, SpscRing<Out>>* out_;
+  F f_;
+};
+
+template <typename In, typename Ring, typename F>
+class PipeSink : public PipeStageBase {
+ public:
+  PipeSink(PipeChannel<In, Ring>* in, F f) : in_{in}, f_(std::move(f)) { }
+
+  void Run(const std::atomic<bool>& abort) override {
+    PipePump(*in_, abort, f_);
+  }
+
+ private:
+  PipeChannel<In, Ring>* in_;
+  F f_;
+};
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class Pipe<T, Ring>
+// @brief handle of the ring a stage writes to. (owned by the Pipeline)
+//------------------------------------------------------------------------------
+template <typename T, typename Ring = SpscRing<T>>
+class Pipe {
+ public:
+  Pipe() : owner_{nullptr}, channel_{nullptr} { }
+
+ protected:
+  Pipe(const Pipeline* owner, detail::PipeChannel<T, Ring>* channel)
+      : owner_{owner}, channel_{channel} { }
+
+ protected:
+  friend class Pipeline;
+  const Pipeline* owner_;
+  detail::PipeChannel<T, Ring>* channel_;
+};
+
+
+//------------------------------------------------------------------------------
+// @class PipeSource<T>
+//------------------------------------------------------------------------------
+// entry of a pipeline. Push() may be called from any number of threads,
+// before or after Pipeline::Start(), but not after Pipeline::Finish(). it
+// waits while the ring is full. (forever, if the pipeline is not started)
+//------------------------------------------------------------------------------
+template <typename T>
+class PipeSource : public Pipe<T, MpscRing<T>> {
+ public:
+  PipeSource() : abort_{nullptr} { }
+
+  // false if the pipeline has failed. (v is left untouched then)
+  bool Push(T&& v) {
+    return detail::PipePush(this->channel_->ring, v, *abort_);
+  }
+
+  bool Push(const T& v) {
+    T copy(v);
+    return Push(std::move(copy));
+  }
+
+  // moves items[0, n) in order, as few batches as the ring allows.
+  // @return number of items pushed. (less than n if the pipeline failed)
+  std::size_t PushBatch(T* items, std::size_t n) {
+    std::size_t done = this->channel_->ring.PushBatch(items, n);
+    detail::PipeBackoff backoff;
+    while (done < n) {
+      if (abort_->load(std::memory_order_relaxed))
+        break;
+      std::size_t k = this->channel_->ring.PushBatch(items + done, n - done);
+      if (k > 0)
+        backoff.Reset();
+      else
+        backoff.Pause();
+      done += k;
+    }
+    return done;
+  }
+
+ private:
+  friend class Pipeline;
+  PipeSource(const Pipeline* owner,
+             detail::PipeChannel<T, MpscRing<T>>* channel,
+             const std::atomic<bool>* abort)
+      : Pipe<T, MpscRing<T>>(owner, channel), abort_{abort} { }
+
+ private:
+  const std::atomic<bool>* abort_;
+};
+
+
+//------------------------------------------------------------------------------
+// @class Pipeline
+//------------------------------------------------------------------------------
+// sources, stages and sinks are added before Start(). every pipe must be
+// consumed by exactly one stage or sink, and the pool needs a worker per
+// stage and sink. (the workers are held until Finish()) don't call Finish()
+// from a worker of the same pool.
+//------------------------------------------------------------------------------
+class Pipeline {
+ public:
+  // 'capacity' : elements per ring. (rounded up to a power of two)
+  explicit Pipeline(ThreadPool& pool, std::size_t capacity = 1024)
+      : pool_(pool), capacity_{capacity}, abort_{false}, running_{0},
+        started_{false}, finished_{false} { }
+
+  // stops a pipeline which wasn't finished. (without rethrowing)
+  ~Pipeline() {
+    if (started_ && !finished_) {
+      Close();
+      Wait();
+    }
+  }
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+ public:
+  template <typename T>
+  PipeSource<T> Source();
+
+  // a stage calling f(T&) on every element of 'in'. its results go down
+  // the returned pipe.
+  template <typename T, typename Ring, typename F>
+  Pipe<detail::PipeResult<typename std::decay<F>::type, T>>
+  Stage(const Pipe<T, Ring>& in, F&& f);
+
+  // the last stage: calls f(T&) on every element of 'in'.
+  template <typename T, typename Ring, typename F>
+  void Sink(const Pipe<T, Ring>& in, F&& f);
+
+  // posts every stage to the pool.
+  // throws LogicError if called twice or if a pipe has no consumer,
+  // InvalidParameterError if the pool has fewer workers than stages.
+  void Start();
+
+  // closes the sources and waits until every stage has drained its input.
+  // starts the pipeline first if needed. rethrows the exception of a failed
+  // stage.
+  void Finish();
+
+  // stages and sinks.
+  std::size_t num_stages() const {
+    return stages_.size();
+  }
+
+ private:
+  template <typename T, typename Ring>
+  detail::PipeChannel<T, Ring>* Consume(const Pipe<T, Ring>& in);
+
+  template <typename T, typename Ring>
+  detail::PipeChannel<T, Ring>* NewChannel();
+
+  void RunStage(detail::PipeStageBase* stage);
+  void Close();
+  void Wait();
+
+ private:
+  ThreadPool& pool_;
+  std::size_t capacity_;
+  std::vector<std::unique_ptr<detail::PipeChannelBase>> channels_;
+  std::vector<detail::PipeChannelBase*> sources_;
+  std::vector<std::unique_ptr<detail::PipeStageBase>> stages_;
+  std::atomic<bool> abort_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  std::size_t running_;
+  std::exception_ptr error_;
+  bool started_;
+  bool finished_;
+};
+
+
+//------------------------------------------------------------------------------
+// @brief new ring any thread can push into.
+//------------------------------------------------------------------------------
+template <typename T>
+inline PipeSource<T> Pipeline::Source() {
+  auto* channel = NewChannel<T, MpscRing<T>>();
+  sources_.push_back(channel);
+  return PipeSource<T>(this, channel, &abort_);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief add a stage.
+//------------------------------------------------------------------------------
+template <typename T, typename Ring, typename F>
+inline auto Pipeline::Stage(const Pipe<T, Ring>& in, F&& f)
+    -> Pipe<detail::PipeResult<typename std::decay<F>::type, T>> {
+  using Func = typename std::decay<F>::type;
+  using Out = detail::PipeResult<Func, T>;
+  static_assert(!std::is_void<Out>::value,
+                "a stage without result is a Sink()");
+  auto* input = Consume(in);
+  auto* output = NewChannel<Out, SpscRing<Out>>();
+  stages_.emplace_back(new detail::PipeStage<T, Ring, Out, Func>(
+      input, output, std::forward<F>(f)));
+  return Pipe<Out>(this, output);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief add a sink.
+//------------------------------------------------------------------------------
+template <typename T, typename Ring, typename F>
+inline void Pipeline::Sink(const Pipe<T, Ring>& in, F&& f) {
+  using Func = typename std::decay<F>::type;
+  auto* input = Consume(in);
+  stages_.emplace_back(
+      new detail::PipeSink<T, Ring, Func>(input, std::forward<F>(f)));
+}
+
+
+template <typename T, typename Ring>
+inline detail::PipeChannel<T, Ring>* Pipeline::Consume(
+    const Pipe<T, Ring>& in) {
+  if (started_)
+    throw LogicError("Pipeline: stage added after Start()");
+  if (in.owner_ != this)
+    throw LogicError("Pipeline: pipe of another pipeline");
+  if (in.channel_->consumed)
+    throw LogicError("Pipeline: pipe consumed twice");
+  in.channel_->consumed = true;
+  return in.channel_;
+}
+
+
+template <typename T, typename Ring>
+inline detail::PipeChannel<T, Ring>* Pipeline::NewChannel() {
+  if (started_)
+    throw LogicError("Pipeline: pipe added after Start()");
+  auto* channel = new detail::PipeChannel<T, Ring>(capacity_);
+  channels_.emplace_back(channel);
+  return channel;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief start the stages.
+//------------------------------------------------------------------------------
+inline void Pipeline::Start() {
+  if (started_)
+    throw LogicError("Pipeline: Start() called twice");
+  for (const auto& channel : channels_) {
+    if (!channel->consumed)
+      throw LogicError("Pipeline: pipe without consumer");
+  }
+  if (stages_.size() > pool_.num_threads())
+    throw InvalidParameterError(
+        "Pipeline: " + std::to_string(stages_.size()) +
+        " stages need as many workers, the pool has " +
+        std::to_string(pool_.num_threads()));
+  started_ = true;
+  running_ = stages_.size();
+  for (std::size_t i = 0; i < stages_.size(); i++) {
+    detail::PipeStageBase* stage = stages_[i].get();
+    try {
+      pool_.Post([this, stage]() { RunStage(stage); });
+    } catch (...) {
+      // stopped pool. take down the stages already posted.
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        running_ -= stages_.size() - i;
+      }
+      abort_.store(true);
+      Wait();
+      finished_ = true;
+      throw;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// @brief drain and stop.
+//------------------------------------------------------------------------------
+inline void Pipeline::Finish() {
+  if (finished_)
+    return;
+  if (!started_)
+    Start();
+  Close();
+  Wait();
+  finished_ = true;
+  // Push() after this point must not wait for stages which are gone.
+  abort_.store(true);
+  if (error_)
+    std::rethrow_exception(error_);
+}
+
+
+inline void Pipeline::RunStage(detail::PipeStageBase* stage) {
+  try {
+    stage->Run(abort_);
+  } catch (...) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (!error_)
+      error_ = std::current_exception();
+    abort_.store(true);
+  }
+  if (stage->output)
+    stage->output->closed.store(true, std::memory_order_release);
+  // notified under the lock: Wait() may destroy the pipeline right after.
+  std::unique_lock<std::mutex> lock(mtx_);
+  if (--running_ == 0)
+    cond_.notify_all();
+}
+
+
+inline void Pipeline::Close() {
+  for (auto* source : sources_)
+    source->closed.store(true, std::memory_order_release);
+}
+
+
+inline void Pipeline::Wait() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  cond_.wait(lock, [this]() { return running_ == 0; });
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_PIPELINE_H_
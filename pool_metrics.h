@@ -0,0 +1,159 @@
+//------------------------------------------------------------------------------
+// @file  pool_metrics.h
+//------------------------------------------------------------------------------
+// @brief runtime metrics of ThreadPool. (see ThreadPool::Options::metrics)
+//------------------------------------------------------------------------------
+// every worker counts into a shard of its own with plain relaxed stores, so
+// measuring costs a few clock reads per task and no shared cache line.
+// shards are only summed up when a snapshot is taken.
+// queue wait and run time go into the same log-linear cu::Histogram as
+// ScopedTimer, so they read the same way. (see histogram.h)
+// @code
+// cu::ThreadPool::Options options;
+// options.num_threads = 8;
+// options.metrics = true;
+// cu::ThreadPool pool(options);
+// ...
+// cu::PoolMetrics m = pool.metrics();
+// printf("util %.2f  wait p99 %lld ns\n", m.utilization(),
+//        (long long)m.total.queue_wait.p99());
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_POOL_METRICS_H_
+#define CPPUTIL_POOL_METRICS_H_
+#include <atomic>    // for std::atomic
+#include <chrono>    // for std::chrono::nanoseconds
+#include <cstddef>   // for std::size_t
+#include <cstdint>   // for std::uint64_t
+#include <vector>    // for std::vector
+#include "histogram.h"   // for cu::Histogram
+#include "mpmc_queue.h"  // for cu::kCacheLineSize
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @struct WorkerMetrics
+// @brief what one worker (or all of them, summed up) did so far.
+//------------------------------------------------------------------------------
+struct WorkerMetrics {
+  std::uint64_t tasks_executed = 0;
+  std::uint64_t steals = 0;              // tasks taken from other queues
+  std::chrono::nanoseconds busy_time{0};  // running tasks
+  std::chrono::nanoseconds idle_time{0};  // looking for tasks or parked
+  Histogram queue_wait;                  // push -> start of the task, ns
+  Histogram exec_time;                   // start -> end of the task, ns
+
+  void Merge(const WorkerMetrics& m) {
+    tasks_executed += m.tasks_executed;
+    steals += m.steals;
+    busy_time += m.busy_time;
+    idle_time += m.idle_time;
+    queue_wait.Merge(m.queue_wait);
+    exec_time.Merge(m.exec_time);
+  }
+};
+
+
+//------------------------------------------------------------------------------
+// @struct PoolMetrics
+// @brief snapshot of ThreadPool::metrics(). queue depths are filled in even
+//        when metrics are off.
+//------------------------------------------------------------------------------
+struct PoolMetrics {
+  bool enabled = false;
+  std::size_t num_threads = 0;
+  std::size_t parked_workers = 0;
+  std::size_t queued_high = 0;
+  std::size_t queued_normal = 0;
+  std::size_t queued_low = 0;
+  WorkerMetrics total;
+  std::vector<WorkerMetrics> workers;
+
+  std::size_t queued() const {
+    return queued_high + queued_normal + queued_low;
+  }
+
+  // share of worker time spent running tasks. (0 - 1)
+  double utilization() const {
+    auto all = total.busy_time + total.idle_time;
+    return all.count() ? double(total.busy_time.count()) / all.count() : 0.0;
+  }
+};
+
+
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// @class WorkerStats
+//------------------------------------------------------------------------------
+// counters of one worker. written by that worker only (load + store, no
+// read-modify-write), read by snapshots from any thread.
+//------------------------------------------------------------------------------
+class WorkerStats {
+ public:
+  using Counter = std::atomic<std::uint64_t>;
+
+  WorkerStats()
+      : tasks_{0}, steals_{0}, busy_ns_{0}, idle_ns_{0},
+        wait_{false}, exec_{false} { }
+
+  WorkerStats(const WorkerStats&) = delete;
+  WorkerStats& operator=(const WorkerStats&) = delete;
+
+ public:
+  // one task: queued at 'enqueued', ran from 'start' to 'end'. 'idle' is the
+  // time since the previous task ended.
+  void Task(std::int64_t enqueued, std::int64_t start, std::int64_t end,
+            std::int64_t idle) {
+    Bump(tasks_, 1);
+    Bump(busy_ns_, end - start);
+    Bump(idle_ns_, idle);
+    wait_.Record(start - enqueued);
+    exec_.Record(end - start);
+  }
+
+  void Steal() {
+    Bump(steals_, 1);
+  }
+
+  void Snapshot(WorkerMetrics& m) const {
+    m.tasks_executed = Get(tasks_);
+    m.steals = Get(steals_);
+    m.busy_time = std::chrono::nanoseconds(
+        static_cast<std::int64_t>(Get(busy_ns_)));
+    m.idle_time = std::chrono::nanoseconds(
+        static_cast<std::int64_t>(Get(idle_ns_)));
+    wait_.Snapshot(m.queue_wait);
+    exec_.Snapshot(m.exec_time);
+  }
+
+ private:
+  static void Bump(Counter& c, std::int64_t n) {
+    if (n > 0)
+      c.store(c.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+  }
+
+  static std::uint64_t Get(const Counter& c) {
+    return c.load(std::memory_order_relaxed);
+  }
+
+ private:
+  Counter tasks_;
+  Counter steals_;
+  Counter busy_ns_;
+  Counter idle_ns_;
+  HistogramShard wait_;  // (single writer: plain stores)
+  HistogramShard exec_;
+  char padding_[kCacheLineSize];
+};
+
+
+}  // namespace detail
+
+
+}  // namespace cu
+#endif  // CPPUTIL_POOL_METRICS_H_
@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// @file  record_reader.h
+//------------------------------------------------------------------------------
+// @brief zero copy reader of delimited records (lines by default). (POSIX)
+//------------------------------------------------------------------------------
+// regular files are mmap'ed and every record is a StringView into the
+// mapping, valid as long as the reader lives. pipes, ttys and stdin ("-") are
+// read in large page aligned chunks instead. then a record is a view into the
+// reader's buffer and valid until the next call to Next().
+// records don't include the delimiter. an empty record is returned as an empty
+// view (like std::getline), a delimiter at the very end adds no empty record.
+// @code
+// cu::RecordReader reader("access.log");
+// cu::StringView line;
+// while (reader.Next(&line)) {
+//   for (cu::StringView field : cu::strutil::split_view(line, '\t'))
+//     ...
+// }
+//
+// // the same in parallel: line aligned ranges of a mapped file.
+// cu::RecordReader reader("access.log");
+// auto ranges = reader.Partition(4 * pool.num_threads());
+// cu::parallel_for(pool, std::size_t(0), ranges.size(), 1, [&](std::size_t i) {
+//   auto part = cu::RecordReader::FromMemory(ranges[i]);
+//   cu::StringView line;
+//   while (part.Next(&line))
+//     ...
+// });
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_RECORD_READER_H_
+#define CPPUTIL_RECORD_READER_H_
+#include <cerrno>         // for errno
+#include <cstddef>        // for std::size_t
+#include <cstdlib>        // for posix_memalign, std::free
+#include <cstring>        // for std::memcpy, std::memmove, std::strerror
+#include <new>            // for std::bad_alloc
+#include <string>         // for std::string
+#include <utility>        // for std::swap
+#include <vector>         // for std::vector
+#include <fcntl.h>        // for open, posix_fadvise
+#include <sys/mman.h>     // for mmap, madvise
+#include <sys/stat.h>     // for fstat
+#include <sys/types.h>    // for ssize_t
+#include <unistd.h>       // for read, close
+#include "char_scan.h"    // for cu::scan::find_char
+#include "exception.h"    // for cu::SystemError, cu::LogicError
+#include "string_view.h"  // for cu::StringView
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class RecordReader
+//------------------------------------------------------------------------------
+// not thread safe. to read one file from several threads, Partition() it and
+// give every thread a reader of its own range.
+//------------------------------------------------------------------------------
+class RecordReader {
+ public:
+  struct Options {
+    char delim = '\n';
+    // read() size for streams. the buffer grows if one record is longer.
+    std::size_t chunk_size = 1 << 20;
+    // madvise(MADV_SEQUENTIAL) (or posix_fadvise for streams). turn it off
+    // when the ranges of a file are read in parallel.
+    bool sequential = true;
+    // false reads regular files as streams, too.
+    bool use_mmap = true;
+
+    Options() { }
+  };
+
+ public:
+  // "-" reads stdin. throws SystemError if the file can't be opened or read.
+  explicit RecordReader(const std::string& path, Options options = Options())
+      : RecordReader(options) {
+    if (path == "-") {
+      fd_ = 0;
+    } else {
+      fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd_ < 0)
+        Fail("open(" + path + ")");
+      owns_fd_ = true;
+    }
+    Open();
+  }
+
+  // reads from fd, which must stay open. (it is not closed by the reader)
+  RecordReader(int fd, Options options) : RecordReader(options) {
+    fd_ = fd;
+    Open();
+  }
+
+  // records of memory owned by the caller, e.g. one range of Partition().
+  static RecordReader FromMemory(StringView data,
+                                 Options options = Options()) {
+    RecordReader reader(options);
+    reader.data_ = data;
+    reader.in_memory_ = true;
+    return reader;
+  }
+
+  RecordReader(RecordReader&& other) noexcept : RecordReader(other.options_) {
+    Swap(other);
+  }
+
+  RecordReader& operator=(RecordReader&& other) noexcept {
+    Swap(other);
+    return *this;
+  }
+
+  RecordReader(const RecordReader&) = delete;
+  RecordReader& operator=(const RecordReader&) = delete;
+
+  ~RecordReader() {
+    if (map_ != nullptr)
+      ::munmap(map_, map_size_);
+    if (owns_fd_)
+      ::close(fd_);
+    std::free(buf_);
+  }
+
+ public:
+  // next record into *record. false at the end of the input.
+  bool Next(StringView* record) {
+    if (!streaming())
+      return NextInMemory(record);
+    while (true) {
+      std::size_t i = scan::find_char(StringView(buf_ + begin_, end_ - begin_),
+                                      options_.delim, scanned_ - begin_);
+      if (i != scan::npos) {
+        *record = StringView(buf_ + begin_, i);
+        begin_ += i + 1;
+        scanned_ = begin_;
+        return true;
+      }
+      scanned_ = end_;
+      if (eof_) {
+        if (begin_ == end_)
+          return false;
+        *record = StringView(buf_ + begin_, end_ - begin_);
+        begin_ = scanned_ = end_;
+        return true;
+      }
+      Fill();
+    }
+  }
+
+  // false if the input is read through a buffer. (data() is empty then)
+  bool in_memory() const {
+    return !streaming();
+  }
+
+  // the whole input when in_memory().
+  StringView data() const {
+    return data_;
+  }
+
+  // offset of the next record in data().
+  std::size_t position() const {
+    return pos_;
+  }
+
+  // splits data() into at most n ranges of about the same size. every range
+  // but the last ends with a delimiter, so no record is cut.
+  // throws LogicError for streams.
+  std::vector<StringView> Partition(std::size_t n) const {
+    if (streaming())
+      throw LogicError("RecordReader::Partition() needs mmap'ed input");
+    std::vector<StringView> ranges;
+    const std::size_t size = data_.size();
+    if (n == 0)
+      n = 1;
+    std::size_t begin = 0;
+    for (std::size_t k = 1; k <= n && begin < size; k++) {
+      std::size_t end = size;
+      if (k < n) {
+        end = size / n * k + (size % n) * k / n;
+        if (end < begin)
+          end = begin;
+        end = scan::find_char(data_, options_.delim, end);
+        end = (end == scan::npos) ? size : end + 1;
+      }
+      if (end > begin)
+        ranges.push_back(data_.substr(begin, end - begin));
+      begin = end;
+    }
+    return ranges;
+  }
+
+ private:
+  explicit RecordReader(const Options& options)
+      : options_{options}, fd_{-1}, owns_fd_{false},
+        map_{nullptr}, map_size_{0}, data_{}, pos_{0},
+        buf_{nullptr}, cap_{0}, begin_{0}, end_{0}, scanned_{0}, eof_{false},
+        in_memory_{false} {
+    if (options_.chunk_size == 0)
+      options_.chunk_size = 1 << 20;
+  }
+
+  bool streaming() const {
+    return !in_memory_;
+  }
+
+  void Open() {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0)
+      Fail("fstat");
+    const bool regular = S_ISREG(st.st_mode);
+    if (regular && st.st_size == 0 && options_.use_mmap) {
+      // empty, or a file in /proc which only claims to be. read it all.
+      Grow(options_.chunk_size);
+      while (!eof_)
+        Fill();
+      data_ = StringView(buf_, end_);
+      in_memory_ = true;
+      return;
+    }
+    if (regular && options_.use_mmap) {
+      map_size_ = static_cast<std::size_t>(st.st_size);
+      void* p = ::mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (p == MAP_FAILED) {
+        map_size_ = 0;
+        Fail("mmap");
+      }
+      map_ = p;
+      if (options_.sequential)
+        ::madvise(map_, map_size_, MADV_SEQUENTIAL);
+      data_ = StringView(static_cast<const char*>(map_), map_size_);
+      in_memory_ = true;
+      return;
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (regular && options_.sequential)
+      ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    Grow(2 * options_.chunk_size);
+  }
+
+  bool NextInMemory(StringView* record) {
+    if (pos_ >= data_.size())
+      return false;
+    std::size_t i = scan::find_char(data_, options_.delim, pos_);
+    if (i == scan::npos)
+      i = data_.size();
+    *record = StringView(data_.data() + pos_, i - pos_);
+    pos_ = i + 1;
+    return true;
+  }
+
+  // moves the unread part to the front and reads at least one chunk.
+  void Fill() {
+    if (begin_ > 0) {
+      std::memmove(buf_, buf_ + begin_, end_ - begin_);
+      end_ -= begin_;
+      scanned_ -= begin_;
+      begin_ = 0;
+    }
+    if (cap_ - end_ < options_.chunk_size)
+      Grow(2 * cap_);
+    while (true) {
+      ssize_t n = ::read(fd_, buf_ + end_, options_.chunk_size);
+      if (n > 0) {
+        end_ += static_cast<std::size_t>(n);
+        return;
+      }
+      if (n == 0) {
+        eof_ = true;
+        return;
+      }
+      if (errno != EINTR)
+        Fail("read");
+    }
+  }
+
+  void Grow(std::size_t cap) {
+    void* p = nullptr;
+    if (::posix_memalign(&p, 4096, cap) != 0)
+      throw std::bad_alloc();
+    if (buf_ != nullptr)
+      std::memcpy(p, buf_, end_);
+    std::free(buf_);
+    buf_ = static_cast<char*>(p);
+    cap_ = cap;
+  }
+
+  void Swap(RecordReader& other) noexcept {
+    std::swap(options_, other.options_);
+    std::swap(fd_, other.fd_);
+    std::swap(owns_fd_, other.owns_fd_);
+    std::swap(map_, other.map_);
+    std::swap(map_size_, other.map_size_);
+    std::swap(data_, other.data_);
+    std::swap(pos_, other.pos_);
+    std::swap(buf_, other.buf_);
+    std::swap(cap_, other.cap_);
+    std::swap(begin_, other.begin_);
+    std::swap(end_, other.end_);
+    std::swap(scanned_, other.scanned_);
+    std::swap(eof_, other.eof_);
+    std::swap(in_memory_, other.in_memory_);
+  }
+
+  static void Fail(const std::string& what) {
+    throw SystemError("RecordReader: " + what + ": " + std::strerror(errno));
+  }
+
+ private:
+  Options options_;
+  int fd_;
+  bool owns_fd_;
+  // in memory: mmap'ed file, caller's data or a small file read at once.
+  void* map_;
+  std::size_t map_size_;
+  StringView data_;
+  std::size_t pos_;
+  // streams: buf_[begin_, end_) is read but not returned yet, the delimiter
+  // was already searched for up to scanned_.
+  char* buf_;
+  std::size_t cap_;
+  std::size_t begin_;
+  std::size_t end_;
+  std::size_t scanned_;
+  bool eof_;
+  bool in_memory_;
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_RECORD_READER_H_
@@ -0,0 +1,265 @@
+//------------------------------------------------------------------------------
+// @file  replacer.h
+//------------------------------------------------------------------------------
+// @brief many (from, to) substitutions in one pass. (Aho-Corasick)
+//------------------------------------------------------------------------------
+// the table is compiled once into a DFA over byte classes (bytes that occur in
+// no pattern share one class), then every Apply() is a single left to right
+// pass with one table lookup per byte, appending to one output buffer.
+// while nothing is partially matched, the scan jumps to the next byte that
+// can start a pattern with the SIMD kernels of char_scan.h.
+//
+// matches are leftmost-longest and never overlap: at each position the
+// longest pattern wins, scanning continues after the replaced text. (so the
+// replacement itself is never rescanned)
+// @code
+// cu::strutil::Replacer esc({{"&", "&amp;"}, {"<", "&lt;"}, {">", "&gt;"}});
+// std::string out;
+// for (const auto& line : lines) {
+//   esc.Apply(line, &out);  // reuses out's buffer
+//   ...
+// }
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_REPLACER_H_
+#define CPPUTIL_REPLACER_H_
+#include <cstddef>           // for std::size_t
+#include <cstdint>           // for std::int32_t
+#include <cstring>           // for std::memcpy
+#include <initializer_list>  // for std::initializer_list
+#include <string>            // for std::string
+#include <utility>           // for std::pair
+#include <vector>            // for std::vector
+#include "char_scan.h"       // for cu::CharSet, cu::scan
+#include "string_view.h"     // for cu::StringView
+
+
+namespace cu {
+namespace strutil {
+
+
+//------------------------------------------------------------------------------
+// @class Replacer
+//------------------------------------------------------------------------------
+// immutable after construction, so one Replacer can be shared by any number of
+// threads. empty 'from' strings are ignored. if the same 'from' appears twice,
+// the first pair wins.
+//------------------------------------------------------------------------------
+class Replacer {
+ public:
+  using Pair = std::pair<std::string, std::string>;
+
+ public:
+  explicit Replacer(const std::vector<Pair>& pairs) {
+    Build(pairs);
+  }
+
+  Replacer(std::initializer_list<Pair> pairs) {
+    Build(std::vector<Pair>(pairs));
+  }
+
+ public:
+  // replaces into *out. (overwritten, its capacity is reused)
+  void Apply(StringView str, std::string* out) const {
+    Writer w(out, str.size());
+    const char* p = str.data();
+    const std::size_t n = str.size();
+    const std::int32_t* delta = delta_.data();
+    const std::size_t classes = classes_;
+    std::size_t copied = 0;  // str[0, copied) is already written
+    std::size_t i = 0;
+    while (i < n) {
+      // leftmost-longest candidate. kept until no later match can start at or
+      // before it.
+      std::int32_t cand = -1;
+      std::size_t cand_pos = 0;
+      std::size_t state = 0;
+      for (; i < n; i++) {
+        if (state == 0 && cand < 0 && prefilter_) {
+          i = scan::find_first_of(str, first_, i);
+          if (i == scan::npos) {
+            i = n;
+            break;
+          }
+        }
+        state = static_cast<std::size_t>(
+            delta[state * classes + class_[static_cast<unsigned char>(p[i])]]);
+        const State& st = states_[state];
+        if (st.out >= 0) {
+          std::size_t pos = i + 1 - from_len_[st.out];
+          if (cand < 0 || pos < cand_pos ||
+              (pos == cand_pos && from_len_[st.out] > from_len_[cand])) {
+            cand = st.out;
+            cand_pos = pos;
+          }
+        }
+        if (cand >= 0 && cand_pos + st.hold <= i + 1)
+          break;
+      }
+      if (cand < 0)
+        break;
+      w.Write(p + copied, cand_pos - copied);
+      w.Write(to_[cand].data(), to_[cand].size());
+      copied = cand_pos + from_len_[cand];
+      i = copied;
+    }
+    w.Write(p + copied, n - copied);
+    w.Finish();
+  }
+
+  std::string Apply(StringView str) const {
+    std::string out;
+    Apply(str, &out);
+    return out;
+  }
+
+  std::string operator()(StringView str) const {
+    return Apply(str);
+  }
+
+  // number of (distinct, non empty) patterns.
+  std::size_t size() const {
+    return to_.size();
+  }
+
+  // number of DFA states. (memory is states() * byte classes * 4 bytes)
+  std::size_t states() const {
+    return states_.size();
+  }
+
+ private:
+  // writes straight into the string's buffer, which is sized up front (and
+  // doubled when the replacements make the text grow) and cut to the written
+  // length at the end.
+  class Writer {
+   public:
+    Writer(std::string* out, std::size_t hint) : out_{out}, size_{0} {
+      out_->resize(hint + hint / 8 + 16);
+    }
+
+    void Write(const char* s, std::size_t n) {
+      if (size_ + n > out_->size())
+        out_->resize(2 * (size_ + n));
+      std::memcpy(&(*out_)[size_], s, n);
+      size_ += n;
+    }
+
+    void Finish() {
+      out_->resize(size_);
+    }
+
+   private:
+    std::string* out_;
+    std::size_t size_;
+  };
+
+  struct State {
+    std::int32_t out;    // longest pattern ending here, or -1
+    std::uint32_t hold;  // see Build()
+  };
+
+ private:
+  void Build(const std::vector<Pair>& pairs) {
+    // byte classes.
+    bool used[256] = {};
+    for (const auto& pr : pairs) {
+      for (char c : pr.first)
+        used[static_cast<unsigned char>(c)] = true;
+    }
+    classes_ = 1;
+    for (int b = 0; b < 256; b++)
+      class_[b] = used[b] ? classes_++ : 0;
+
+    // trie. (delta_ holds -1 for missing edges until the failure pass)
+    std::vector<bool> leaf;
+    AddState(0);
+    for (const auto& pr : pairs) {
+      if (pr.first.empty())
+        continue;
+      std::int32_t s = 0;
+      for (char c : pr.first) {
+        std::size_t e = Edge(s, c);
+        if (delta_[e] < 0) {
+          std::int32_t t = AddState(states_[s].hold + 1);
+          delta_[Edge(s, c)] = t;
+          leaf.resize(states(), true);
+          leaf[s] = false;
+        }
+        s = delta_[Edge(s, c)];
+        if (states_[s].hold == 1)
+          first_.insert(c);
+      }
+      if (states_[s].out >= 0)
+        continue;  // duplicate 'from', the first one wins
+      states_[s].out = static_cast<std::int32_t>(to_.size());
+      from_len_.push_back(pr.first.size());
+      to_.push_back(pr.second);
+    }
+
+    // a candidate match at p is final once no match starting at or before p
+    // can still come: the current state stands for its last 'depth' bytes and
+    // matches can only grow from there, so hold is the depth of the state,
+    // +1 unless it is a leaf of the trie. (nothing longer starts there)
+    leaf.resize(states(), true);
+    for (std::size_t s = 0; s < states(); s++)
+      states_[s].hold += leaf[s] ? 0 : 1;
+
+    // failure links in bfs order, turning the trie into a DFA. out of a
+    // state becomes the longest pattern that ends there.
+    std::vector<std::int32_t> fail(states(), 0);
+    std::vector<std::int32_t> queue;
+    queue.reserve(states());
+    for (std::size_t c = 0; c < classes_; c++) {
+      std::int32_t& t = delta_[c];
+      if (t < 0) {
+        t = 0;
+      } else {
+        fail[t] = 0;
+        queue.push_back(t);
+      }
+    }
+    for (std::size_t q = 0; q < queue.size(); q++) {
+      std::int32_t s = queue[q];
+      if (states_[s].out < 0)
+        states_[s].out = states_[fail[s]].out;
+      for (std::size_t c = 0; c < classes_; c++) {
+        std::size_t e = static_cast<std::size_t>(s) * classes_ + c;
+        std::int32_t fe =
+            delta_[static_cast<std::size_t>(fail[s]) * classes_ + c];
+        if (delta_[e] < 0) {
+          delta_[e] = fe;
+        } else {
+          fail[delta_[e]] = fe;
+          queue.push_back(delta_[e]);
+        }
+      }
+    }
+    prefilter_ = first_.simd();
+  }
+
+  std::int32_t AddState(std::size_t depth) {
+    delta_.resize(delta_.size() + classes_, -1);
+    states_.push_back(State{-1, static_cast<std::uint32_t>(depth)});
+    return static_cast<std::int32_t>(states_.size() - 1);
+  }
+
+  std::size_t Edge(std::int32_t s, char c) const {
+    return static_cast<std::size_t>(s) * classes_ +
+           class_[static_cast<unsigned char>(c)];
+  }
+
+ private:
+  std::size_t classes_;
+  std::uint16_t class_[256];
+  std::vector<std::int32_t> delta_;   // states x classes
+  std::vector<State> states_;
+  std::vector<std::size_t> from_len_;
+  std::vector<std::string> to_;
+  CharSet first_;                     // first bytes of the patterns
+  bool prefilter_;
+};
+
+
+}  // namespace strutil
+}  // namespace cu
+#endif  // CPPUTIL_REPLACER_H_
@@ -0,0 +1,356 @@
+//------------------------------------------------------------------------------
+// @file  ring_buffer.h
+//------------------------------------------------------------------------------
+// @brief bounded lock-free single-producer/single-consumer and
+//        multi-producer/single-consumer ring buffers.
+//------------------------------------------------------------------------------
+// both rings hand elements over in place: a slot is constructed by the
+// producer and moved out (or consumed by Drain()) by the consumer, the ring
+// never allocates after construction. the producer and consumer indices sit
+// on cache lines of their own.
+// batch calls publish their whole batch with one store, so the other side
+// sees one cache line transfer per batch instead of one per element.
+// @code
+// cu::SpscRing<Msg> ring(1024);
+// // producer                       // consumer
+// n = ring.PushBatch(msgs, count);  ring.Drain([](Msg& m) { Handle(m); });
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_RING_BUFFER_H_
+#define CPPUTIL_RING_BUFFER_H_
+#include <atomic>       // for std::atomic
+#include <cstddef>      // for std::size_t
+#include <limits>       // for std::numeric_limits
+#include <memory>       // for std::allocator
+#include <new>          // for placement new
+#include <type_traits>  // for std::aligned_storage
+#include <utility>      // for std::move
+#include "mpmc_queue.h" // for cu::kCacheLineSize
+
+
+namespace cu {
+namespace detail {
+
+inline std::size_t RingCapacity(std::size_t capacity) {
+  std::size_t cap = 2;
+  while (cap < capacity)
+    cap *= 2;
+  return cap;
+}
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class SpscRing<T>
+//------------------------------------------------------------------------------
+// one producer thread, one consumer thread. both sides are wait-free: a push
+// or a pop is a few loads and one release store, without any CAS. each side
+// keeps a private copy of the other side's index and only reloads it when
+// the ring looks full/empty.
+//------------------------------------------------------------------------------
+template <typename T>
+class SpscRing {
+ public:
+  // capacity is rounded up to a power of two.
+  explicit SpscRing(std::size_t capacity)
+      : slots_{nullptr}, mask_{detail::RingCapacity(capacity) - 1},
+        tail_{0}, cached_head_{0}, head_{0}, cached_tail_{0} {
+    slots_ = std::allocator<Slot>().allocate(mask_ + 1);
+  }
+
+  ~SpscRing() {
+    Drain([](T&) { });
+    std::allocator<Slot>().deallocate(slots_, mask_ + 1);
+  }
+
+ public:
+  SpscRing(const SpscRing&) = delete;
+  SpscRing(SpscRing&&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+  SpscRing& operator=(SpscRing&&) = delete;
+
+ public:
+  std::size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  // (a snapshot, exact only on a quiet ring)
+  std::size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  // consumer side.
+  bool empty() const {
+    return tail_.load(std::memory_order_acquire) ==
+           head_.load(std::memory_order_relaxed);
+  }
+
+  // producer side. v is left untouched when the ring is full.
+  bool TryPush(T&& v) {
+    return PushBatch(&v, 1) == 1;
+  }
+
+  // producer side. moves as many of items[0, n) as fit.
+  // @return number of items pushed.
+  std::size_t PushBatch(T* items, std::size_t n) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (n > capacity() - (tail - cached_head_)) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (n > capacity() - (tail - cached_head_))
+        n = capacity() - (tail - cached_head_);
+    }
+    std::size_t i = 0;
+    try {
+      for (; i < n; i++)
+        new (At(tail + i)) T(std::move(items[i]));
+    } catch (...) {
+      tail_.store(tail + i, std::memory_order_release);
+      throw;
+    }
+    tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // consumer side.
+  bool TryPop(T& v) {
+    return Drain([&v](T& x) { v = std::move(x); }, 1) == 1;
+  }
+
+  // consumer side. moves up to n elements into out[0, n).
+  // @return number of elements popped.
+  std::size_t PopBatch(T* out, std::size_t n) {
+    return Drain([&out](T& x) { *out++ = std::move(x); }, n);
+  }
+
+  // consumer side. calls f(T&) on up to 'max' elements in place, oldest
+  // first, and destroys them. if f throws, the element it threw on is
+  // dropped too.
+  // @return number of elements consumed.
+  template <typename F>
+  std::size_t Drain(F&& f,
+                    std::size_t max = std::numeric_limits<std::size_t>::max()) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < max)
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    std::size_t n = cached_tail_ - head;
+    if (n > max)
+      n = max;
+    std::size_t i = 0;
+    try {
+      for (; i < n; i++) {
+        T* p = At(head + i);
+        f(*p);
+        p->~T();
+      }
+    } catch (...) {
+      At(head + i)->~T();
+      head_.store(head + i + 1, std::memory_order_release);
+      throw;
+    }
+    if (n > 0)
+      head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+ private:
+  using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  T* At(std::size_t pos) const {
+    return reinterpret_cast<T*>(&slots_[pos & mask_]);
+  }
+
+ private:
+  char pad0_[kCacheLineSize];
+  Slot* slots_;
+  std::size_t mask_;
+  char pad1_[kCacheLineSize - sizeof(Slot*) - sizeof(std::size_t)];
+  // producer
+  std::atomic<std::size_t> tail_;
+  std::size_t cached_head_;
+  char pad2_[kCacheLineSize - 2 * sizeof(std::size_t)];
+  // consumer
+  std::atomic<std::size_t> head_;
+  std::size_t cached_tail_;
+  char pad3_[kCacheLineSize - 2 * sizeof(std::size_t)];
+};
+
+
+//------------------------------------------------------------------------------
+// @class MpscRing<T>
+//------------------------------------------------------------------------------
+// any number of producer threads, one consumer thread. cells carry a
+// sequence number like MpmcQueue. producers claim positions with a CAS on
+// the tail, a batch claims all of its positions with one CAS, so a push is
+// lock-free: it only retries when another producer won the race. the
+// consumer owns the head and never retries: a pop is wait-free.
+// a claimed position has to be filled, or the consumer waits on it forever,
+// so T's move constructor must not throw.
+//------------------------------------------------------------------------------
+template <typename T>
+class MpscRing {
+  static_assert(std::is_nothrow_move_constructible<T>::value,
+                "MpscRing<T>: T's move constructor must be noexcept.");
+
+ public:
+  // capacity is rounded up to a power of two.
+  explicit MpscRing(std::size_t capacity)
+      : cells_{nullptr}, mask_{detail::RingCapacity(capacity) - 1},
+        tail_{0}, head_{0} {
+    cells_ = std::allocator<Cell>().allocate(mask_ + 1);
+    for (std::size_t i = 0; i <= mask_; i++)
+      new (&cells_[i].seq) std::atomic<std::size_t>(i);
+  }
+
+  ~MpscRing() {
+    Drain([](T&) { });
+    std::allocator<Cell>().deallocate(cells_, mask_ + 1);
+  }
+
+ public:
+  MpscRing(const MpscRing&) = delete;
+  MpscRing(MpscRing&&) = delete;
+  MpscRing& operator=(const MpscRing&) = delete;
+  MpscRing& operator=(MpscRing&&) = delete;
+
+ public:
+  std::size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  // (a snapshot, exact only on a quiet ring)
+  std::size_t size() const {
+    const std::size_t head = head_.load(std::memory_order_acquire);
+    const std::size_t tail = tail_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+
+  // consumer side. (true while the oldest push is still being written)
+  bool empty() const {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    return cells_[head & mask_].seq.load(std::memory_order_acquire) !=
+           head + 1;
+  }
+
+  // v is left untouched when the ring is full.
+  bool TryPush(T&& v) {
+    Cell* cell;
+    std::size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      std::size_t seq = cell->seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::move(v));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // moves as many of items[0, n) as fit, in order.
+  // @return number of items pushed.
+  std::size_t PushBatch(T* items, std::size_t n) {
+    std::size_t pos = tail_.load(std::memory_order_relaxed);
+    std::size_t k;
+    while (true) {
+      // every position below head + capacity() is free. TryPush() goes by
+      // the cells, so the tail may be further than that while a Drain()
+      // hasn't stored the head yet.
+      const std::size_t head = head_.load(std::memory_order_acquire);
+      const std::size_t used = pos - head;
+      if (static_cast<std::ptrdiff_t>(used) < 0) {
+        pos = tail_.load(std::memory_order_relaxed);  // stale
+        continue;
+      }
+      if (used >= capacity())
+        return 0;  // full
+      k = capacity() - used;
+      if (k > n)
+        k = n;
+      if (k == 0)
+        return 0;
+      if (tail_.compare_exchange_weak(pos, pos + k,
+                                      std::memory_order_relaxed))
+        break;
+    }
+    for (std::size_t i = 0; i < k; i++) {
+      Cell& cell = cells_[(pos + i) & mask_];
+      new (&cell.storage) T(std::move(items[i]));
+      cell.seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return k;
+  }
+
+  // consumer side.
+  bool TryPop(T& v) {
+    return Drain([&v](T& x) { v = std::move(x); }, 1) == 1;
+  }
+
+  // consumer side. moves up to n elements into out[0, n).
+  // @return number of elements popped.
+  std::size_t PopBatch(T* out, std::size_t n) {
+    return Drain([&out](T& x) { *out++ = std::move(x); }, n);
+  }
+
+  // consumer side. calls f(T&) on up to 'max' elements in place, oldest
+  // first, and destroys them. stops at the first position still being
+  // written. if f throws, the element it threw on is dropped too.
+  // @return number of elements consumed.
+  template <typename F>
+  std::size_t Drain(F&& f,
+                    std::size_t max = std::numeric_limits<std::size_t>::max()) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    std::size_t i = 0;
+    try {
+      for (; i < max; i++) {
+        Cell& cell = cells_[(head + i) & mask_];
+        if (cell.seq.load(std::memory_order_acquire) != head + i + 1)
+          break;
+        T* p = reinterpret_cast<T*>(&cell.storage);
+        f(*p);
+        Release(cell, head + i);
+      }
+    } catch (...) {
+      Release(cells_[(head + i) & mask_], head + i);
+      head_.store(head + i + 1, std::memory_order_release);
+      throw;
+    }
+    if (i > 0)
+      head_.store(head + i, std::memory_order_release);
+    return i;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void Release(Cell& cell, std::size_t pos) {
+    reinterpret_cast<T*>(&cell.storage)->~T();
+    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+  }
+
+ private:
+  char pad0_[kCacheLineSize];
+  Cell* cells_;
+  std::size_t mask_;
+  char pad1_[kCacheLineSize - sizeof(Cell*) - sizeof(std::size_t)];
+  std::atomic<std::size_t> tail_;  // producers
+  char pad2_[kCacheLineSize - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> head_;  // consumer
+  char pad3_[kCacheLineSize - sizeof(std::atomic<std::size_t>)];
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_RING_BUFFER_H_
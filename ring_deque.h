@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+// @file  ring_deque.h
+//------------------------------------------------------------------------------
+// @brief growable circular double-ended queue.
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_RING_DEQUE_H_
+#define CPPUTIL_RING_DEQUE_H_
+#include <cassert>  // for assert
+#include <cstddef>  // for std::size_t
+#include <memory>   // for std::allocator
+#include <new>      // for placement new
+#include <utility>  // for std::move
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class RingDeque<T>
+//------------------------------------------------------------------------------
+// std::deque allocates and frees a block every few elements while it is used
+// as a queue. RingDeque keeps one power-of-two buffer which only grows, so a
+// queue in steady state never touches the allocator.
+//------------------------------------------------------------------------------
+template <typename T>
+class RingDeque {
+ public:
+  RingDeque() : buf_{nullptr}, cap_{0}, head_{0}, size_{0} { }
+
+  ~RingDeque() {
+    clear();
+    if (buf_)
+      std::allocator<T>().deallocate(buf_, cap_);
+  }
+
+ public:
+  RingDeque(const RingDeque&) = delete;
+  RingDeque(RingDeque&&) = delete;
+  RingDeque& operator=(const RingDeque&) = delete;
+  RingDeque& operator=(RingDeque&&) = delete;
+
+ public:
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  std::size_t capacity() const {
+    return cap_;
+  }
+
+  T& front() {
+    assert(!empty());
+    return buf_[head_];
+  }
+
+  T& back() {
+    assert(!empty());
+    return buf_[(head_ + size_ - 1) & (cap_ - 1)];
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    if (size_ == cap_)
+      Grow();
+    new (&buf_[(head_ + size_) & (cap_ - 1)]) T(std::forward<Args>(args)...);
+    size_++;
+  }
+
+  void pop_front() {
+    assert(!empty());
+    buf_[head_].~T();
+    head_ = (head_ + 1) & (cap_ - 1);
+    size_--;
+  }
+
+  void pop_back() {
+    assert(!empty());
+    back().~T();
+    size_--;
+  }
+
+  void clear() {
+    while (!empty())
+      pop_front();
+  }
+
+  void reserve(std::size_t n) {
+    while (cap_ < n)
+      Grow();
+  }
+
+ private:
+  void Grow() {
+    std::size_t cap = cap_ ? cap_ * 2 : 16;
+    T* buf = std::allocator<T>().allocate(cap);
+    for (std::size_t i = 0; i < size_; i++) {
+      T& v = buf_[(head_ + i) & (cap_ - 1)];
+      new (&buf[i]) T(std::move(v));
+      v.~T();
+    }
+    if (buf_)
+      std::allocator<T>().deallocate(buf_, cap_);
+    buf_ = buf;
+    cap_ = cap;
+    head_ = 0;
+  }
+
+ private:
+  T* buf_;
+  std::size_t cap_;
+  std::size_t head_;
+  std::size_t size_;
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_RING_DEQUE_H_
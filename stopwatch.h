@@ -3,45 +3,62 @@
 //------------------------------------------------------------------------------
 // @brief 정밀도 시간을 측정한다.
 //------------------------------------------------------------------------------
+// 시계는 policy 로 고른다. (tsc_clock.h)
+// Stopwatch 는 high_resolution_clock, TscStopwatch 는 cpu 의 TSC 를 사용하며
+// 한 번 읽는 비용이 몇 ns 이므로 1us 미만의 구간을 잴 때 사용한다.
+// @code
+// cu::TscStopwatch sw;
+// Step1();
+// double t1 = sw.Lap();     // Step1 에 걸린 ns
+// Step2();
+// double t2 = sw.Lap();     // Step2 에 걸린 ns
+// double all = sw.Split();  // 시작부터 지금까지의 ns
+// @endcode
+//------------------------------------------------------------------------------
 #ifndef CPPUTIL_STOPWATCH_H_
 #define CPPUTIL_STOPWATCH_H_
 #include <chrono>
+#include "tsc_clock.h"  // for cu::ChronoClock, cu::TscClock
 
 
 namespace cu {
 
 
 //------------------------------------------------------------------------------
-// @class Stopwatch
+// @class BasicStopwatch<Clock>
 //------------------------------------------------------------------------------
-class Stopwatch {
+template <typename Clock>
+class BasicStopwatch {
  private:
-  using Resolution = std::chrono::high_resolution_clock;
-  using TimePoint  = std::chrono::time_point<Resolution>;
+  using tick = typename Clock::tick;
   using ns = std::chrono::nanoseconds;
-  using ms = std::chrono::microseconds;  
+  using us = std::chrono::microseconds;
+  using ms = std::chrono::milliseconds;
 
  private:
-  TimePoint tp_;
+  tick start_;
+  tick lap_;
 
  public:
-  Stopwatch() : tp_{Now()} { }
-  Stopwatch(const Stopwatch&) = delete;
-  Stopwatch(Stopwatch&&) = delete;
+  BasicStopwatch() : start_{Now()}, lap_{start_} { }
+  BasicStopwatch(const BasicStopwatch&) = delete;
+  BasicStopwatch(BasicStopwatch&&) = delete;
 
  private:
-  TimePoint Now() const {
-    return Resolution::now();
+  static tick Now() {
+    return Clock::now();
   }
 
  public  :
   template<typename U>
   typename U::rep Elapsed() const {
-    return std::chrono::duration_cast<U>(Now() - tp_).count();
+    return std::chrono::duration_cast<U>(
+        std::chrono::duration<double, std::nano>(nsec())).count();
   }
 
   void Reset() {
-    tp_ = Now();
+    start_ = Now();
+    lap_ = start_;
   }
 
   double sec() const {
@@ -49,14 +66,38 @@ class Stopwatch {
   }
 
   double msec() const {
-    return nsec() / std::milli::den;
+    return nsec() / (std::nano::den / std::milli::den);
+  }
+
+  double usec() const {
+    return nsec() / (std::nano::den / std::micro::den);
   }
 
   double nsec() const {
-    return Elapsed<typename Stopwatch::ns>();
+    return Clock::to_nsec(Now() - start_);
+  }
+
+  // 이전 Lap() (또는 시작) 부터의 ns. 다음 lap 을 시작한다.
+  double Lap() {
+    tick now = Now();
+    double lap = Clock::to_nsec(now - lap_);
+    lap_ = now;
+    return lap;
+  }
+
+  // 시작부터의 ns. (lap 에 영향을 주지 않는다)
+  double Split() const {
+    return nsec();
   }
 };
 
 
+using Stopwatch =
+    BasicStopwatch<ChronoClock<std::chrono::high_resolution_clock>>;
+using SteadyStopwatch =
+    BasicStopwatch<ChronoClock<std::chrono::steady_clock>>;
+using TscStopwatch = BasicStopwatch<TscClock>;
+
+
 }  // namespace cu
 #endif  // CPPUTIL_STOPWATCH_H_
@@ -0,0 +1,234 @@
+//------------------------------------------------------------------------------
+// @file  string_builder.h
+//------------------------------------------------------------------------------
+// @brief builds a string from mixed pieces (strings, integers, floats) in one
+//        reusable buffer.
+//------------------------------------------------------------------------------
+// Append(a, b, c, ...) first adds up an upper bound of the size of all its
+// arguments (exact for strings, a constant per type for numbers), grows the
+// buffer at most once, then formats every argument straight into it. there
+// are no temporaries per argument.
+// the buffer is either a per-thread scratch string, which keeps its capacity
+// from one builder to the next, or a std::string of the caller's, reused the
+// same way.
+// @code
+// cu::StringBuilder sb;
+// sb.Append("GET ", path, " ", status, " ", elapsed_ms, "ms");
+// log(sb.view());                  // valid until sb is destroyed or changed
+//
+// std::string buffer;              // reused for every response
+// for (...) {
+//   cu::StringBuilder rb(&buffer);
+//   rb << "{\"id\":" << id << ",\"score\":" << score << "}";
+//   send(rb.view());
+// }
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_STRING_BUILDER_H_
+#define CPPUTIL_STRING_BUILDER_H_
+#include <algorithm>      // for std::max
+#include <cstring>        // for std::memcpy, std::strlen
+#include <string>         // for std::string
+#include <type_traits>    // for std::enable_if, std::is_integral
+#include <utility>        // for std::move
+#include "numeric.h"      // for cu::strutil::to_chars
+#include "string_view.h"  // for cu::StringView
+#include "variadic.h"     // for cu::do_in_order
+
+
+namespace cu {
+namespace detail {
+
+
+//------------------------------------------------------------------------------
+// @struct Scratch
+// @brief the per-thread buffer of StringBuilder. (busy while a builder uses
+//        it, a second builder on the same thread gets a buffer of its own)
+//------------------------------------------------------------------------------
+struct Scratch {
+  std::string buffer;
+  bool busy = false;
+};
+
+inline Scratch& ThreadScratch() {
+  static thread_local Scratch scratch;
+  return scratch;
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class StringBuilder
+//------------------------------------------------------------------------------
+// appends strings (anything convertible to StringView), chars, bools,
+// integers and floating point numbers. the content is size() chars at the
+// front of the buffer, which may be larger. (it is grown by resize() and
+// never shrunk, so reuse costs nothing)
+//------------------------------------------------------------------------------
+class StringBuilder {
+ public:
+  // uses the scratch buffer of this thread.
+  StringBuilder() : buf_{nullptr}, size_{0}, scratch_{false} {
+    detail::Scratch& s = detail::ThreadScratch();
+    if (!s.busy) {
+      s.busy = true;
+      scratch_ = true;
+      buf_ = &s.buffer;
+    } else {
+      buf_ = &own_;
+    }
+  }
+
+  // builds in *buffer (its old content is dropped, its memory reused), which
+  // holds the result when the builder is destroyed.
+  explicit StringBuilder(std::string* buffer)
+      : buf_{buffer}, size_{0}, scratch_{false} { }
+
+  StringBuilder(const StringBuilder&) = delete;
+  StringBuilder& operator=(const StringBuilder&) = delete;
+
+  ~StringBuilder() {
+    if (scratch_)
+      detail::ThreadScratch().busy = false;
+    else if (buf_ != &own_)
+      buf_->resize(size_);
+  }
+
+ public:
+  template <typename... Args>
+  StringBuilder& Append(const Args&... args) {
+    std::size_t need = 0;
+    do_in_order{0, (need += MaxSize(args), 0)...};
+    Reserve(need);
+    do_in_order{0, (Write(args), 0)...};
+    return *this;
+  }
+
+  template <typename T>
+  StringBuilder& operator<<(const T& arg) {
+    return Append(arg);
+  }
+
+  // makes room for n more chars at once.
+  void Reserve(std::size_t n) {
+    if (size_ + n > buf_->size())
+      buf_->resize(std::max(size_ + n, 2 * buf_->size()));
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+ public:
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // valid until the builder is changed or destroyed.
+  StringView view() const {
+    return StringView(buf_->data(), size_);
+  }
+
+  std::string str() const {
+    return std::string(buf_->data(), size_);
+  }
+
+  // the content as a string. moved out of a caller's buffer (which is empty
+  // afterwards), copied out of the scratch buffer. (which keeps its capacity
+  // for the next builder)
+  std::string release() {
+    std::string result;
+    if (scratch_ || buf_ == &own_) {
+      result.assign(buf_->data(), size_);
+    } else {
+      buf_->resize(size_);
+      result = std::move(*buf_);
+      buf_->clear();
+    }
+    size_ = 0;
+    return result;
+  }
+
+ private:
+  // upper bound of the chars an argument needs.
+  static std::size_t MaxSize(StringView s) { return s.size(); }
+  static std::size_t MaxSize(const char* s) { return std::strlen(s); }
+  static std::size_t MaxSize(char) { return 1; }
+  static std::size_t MaxSize(bool) { return 5; }
+
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value, std::size_t>::type
+  MaxSize(T) {
+    return strutil::kMaxIntChars;
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value,
+                                 std::size_t>::type
+  MaxSize(T) {
+    return strutil::kMaxDoubleChars;
+  }
+
+  char* End() {
+    return &(*buf_)[0] + size_;
+  }
+
+  void Write(StringView s) {
+    if (!s.empty())
+      std::memcpy(End(), s.data(), s.size());
+    size_ += s.size();
+  }
+
+  // (not to be taken for a bool)
+  void Write(const char* s) {
+    Write(StringView(s));
+  }
+
+  void Write(char c) {
+    *End() = c;
+    size_++;
+  }
+
+  void Write(bool b) {
+    Write(b ? StringView("true", 4) : StringView("false", 5));
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value>::type
+  Write(T v) {
+    char* end = End();
+    size_ += strutil::to_chars(end, end + strutil::kMaxIntChars, v).ptr - end;
+  }
+
+  void Write(float v) {
+    char* end = End();
+    size_ += strutil::to_chars(end, end + strutil::kMaxDoubleChars, v).ptr -
+             end;
+  }
+
+  void Write(double v) {
+    char* end = End();
+    size_ += strutil::to_chars(end, end + strutil::kMaxDoubleChars, v).ptr -
+             end;
+  }
+
+  void Write(long double v) {
+    Write(static_cast<double>(v));
+  }
+
+ private:
+  std::string* buf_;
+  std::size_t size_;
+  bool scratch_;
+  std::string own_;
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_STRING_BUILDER_H_
@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------
+// @file  string_view.h
+//------------------------------------------------------------------------------
+// @brief non-owning reference to a character range. (c++11 std::string_view)
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_STRING_VIEW_H_
+#define CPPUTIL_STRING_VIEW_H_
+#include <algorithm>  // for std::min
+#include <cstddef>    // for std::size_t
+#include <cstring>    // for std::memchr, std::memcmp
+#include <ostream>    // for std::ostream
+#include <stdexcept>  // for std::out_of_range
+#include <string>     // for std::string
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class StringView
+//------------------------------------------------------------------------------
+// pointer + length into memory owned by someone else. the referenced string
+// must outlive the view. only the subset of std::string_view we need.
+//------------------------------------------------------------------------------
+class StringView {
+ public:
+  using const_iterator = const char*;
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+ public:
+  constexpr StringView() noexcept : data_{nullptr}, size_{0} { }
+  constexpr StringView(const char* data, std::size_t size) noexcept
+      : data_{data}, size_{size} { }
+  StringView(const char* str)  // NOLINT (implicit by design)
+      : data_{str}, size_{std::strlen(str)} { }
+  StringView(const std::string& str) noexcept  // NOLINT
+      : data_{str.data()}, size_{str.size()} { }
+
+ public:
+  constexpr const char* data() const noexcept { return data_; }
+  constexpr std::size_t size() const noexcept { return size_; }
+  constexpr std::size_t length() const noexcept { return size_; }
+  constexpr bool empty() const noexcept { return size_ == 0; }
+
+  const_iterator begin() const noexcept { return data_; }
+  const_iterator end() const noexcept { return data_ + size_; }
+
+  constexpr char operator[](std::size_t i) const { return data_[i]; }
+  char front() const { return data_[0]; }
+  char back() const { return data_[size_ - 1]; }
+
+  std::string to_string() const {
+    return std::string(data_, size_);
+  }
+
+  explicit operator std::string() const {
+    return to_string();
+  }
+
+  void remove_prefix(std::size_t n) {
+    data_ += n;
+    size_ -= n;
+  }
+
+  void remove_suffix(std::size_t n) {
+    size_ -= n;
+  }
+
+  StringView substr(std::size_t pos, std::size_t n = npos) const {
+    if (pos > size_)
+      throw std::out_of_range("StringView::substr");
+    return StringView(data_ + pos, std::min(n, size_ - pos));
+  }
+
+  int compare(StringView other) const {
+    int r = std::memcmp(data_, other.data_, std::min(size_, other.size_));
+    if (r != 0)
+      return r;
+    return size_ < other.size_ ? -1 : (size_ > other.size_ ? 1 : 0);
+  }
+
+  std::size_t find(char c, std::size_t pos = 0) const {
+    if (pos >= size_)
+      return npos;
+    const void* p = std::memchr(data_ + pos, c, size_ - pos);
+    return p ? static_cast<const char*>(p) - data_ : npos;
+  }
+
+  // memchr for the first byte, then memcmp for the rest.
+  std::size_t find(StringView s, std::size_t pos = 0) const {
+    if (s.size_ == 0)
+      return pos <= size_ ? pos : npos;
+    if (s.size_ > size_)
+      return npos;
+    const char* last = data_ + (size_ - s.size_);
+    const char* p = data_ + pos;
+    while (p <= last) {
+      p = static_cast<const char*>(std::memchr(p, s.data_[0], last - p + 1));
+      if (p == nullptr)
+        return npos;
+      if (std::memcmp(p + 1, s.data_ + 1, s.size_ - 1) == 0)
+        return p - data_;
+      p++;
+    }
+    return npos;
+  }
+
+ private:
+  const char* data_;
+  std::size_t size_;
+};
+
+
+inline bool operator==(StringView a, StringView b) {
+  return a.size() == b.size() && a.compare(b) == 0;
+}
+
+inline bool operator!=(StringView a, StringView b) {
+  return !(a == b);
+}
+
+inline bool operator<(StringView a, StringView b) {
+  return a.compare(b) < 0;
+}
+
+inline std::ostream& operator<<(std::ostream& os, StringView s) {
+  return os.write(s.data(), s.size());
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_STRING_VIEW_H_
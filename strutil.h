@@ -6,12 +6,207 @@
 #include <sstream>
 #include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <cstring>
+#include <memory>
+#include "char_scan.h"
+#include "replacer.h"
+#include "string_builder.h"
+#include "string_view.h"
 #include "variadic.h"
 
 namespace cu {
 namespace strutil {
 
 
+//------------------------------------------------------------------------------
+// split_view() 가 반환하는 range. 조각은 필요할 때 하나씩 찾으며, 원본 문자열을
+// 가리키는 StringView 로 반환되므로 메모리 할당이 전혀 없다.
+// 원본 문자열은 range 를 사용하는 동안 유지되어야 한다.
+// Delim 은 char (문자 하나), StringView (문자열) 또는 CharSet (문자 집합 중
+// 아무 문자) 이다. 구분자는 SIMD 로 찾는다. (char_scan.h)
+//------------------------------------------------------------------------------
+template <typename Delim>
+class SplitView {
+ public:
+  SplitView(StringView str, Delim delim, bool accept_empty)
+      : str_{str}, delim_{delim}, accept_empty_{accept_empty},
+        whole_{DelimSize(delim) == 0 || DelimSize(delim) > str.size()} { }
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = StringView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const StringView*;
+    using reference = const StringView&;
+
+    iterator() : view_{nullptr}, pos_{0}, piece_{}, done_{true} { }
+    explicit iterator(const SplitView* view)
+        : view_{view}, pos_{0}, piece_{}, done_{false} {
+      ++*this;
+    }
+
+    reference operator*() const { return piece_; }
+    pointer operator->() const { return &piece_; }
+
+    iterator& operator++() {
+      done_ = !view_->Next(pos_, piece_);
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    bool operator==(const iterator& other) const {
+      if (done_ || other.done_)
+        return done_ == other.done_;
+      return pos_ == other.pos_;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    const SplitView* view_;
+    std::size_t pos_;
+    StringView piece_;
+    bool done_;
+  };
+
+  iterator begin() const { return iterator(this); }
+  iterator end() const { return iterator(); }
+
+  // 조각들을 벡터로 모은다. (StringView 만 복사)
+  std::vector<StringView> to_vector() const {
+    return std::vector<StringView>(begin(), end());
+  }
+
+  // pos 위치부터 다음 조각을 찾아 piece 에 넣고 pos 를 그 다음으로 옮긴다.
+  // 더 이상 조각이 없으면 false. split() 과 같은 결과를 낸다.
+  bool Next(std::size_t& pos, StringView& piece) const {
+    const std::size_t size = str_.size();
+    while (pos < size) {
+      std::size_t fnd = whole_ ? StringView::npos : Find(str_, delim_, pos);
+      if (fnd == StringView::npos) {
+        piece = str_.substr(pos);
+        pos = size;
+        return true;
+      }
+      std::size_t begin = pos;
+      pos = fnd + DelimSize(delim_);
+      if (accept_empty_ || begin < fnd) {
+        piece = StringView(str_.data() + begin, fnd - begin);
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static std::size_t DelimSize(char) { return 1; }
+  static std::size_t DelimSize(StringView d) { return d.size(); }
+  static std::size_t DelimSize(const CharSet& d) { return d.size() ? 1 : 0; }
+
+  static std::size_t Find(StringView s, char d, std::size_t pos) {
+    return scan::find_char(s, d, pos);
+  }
+
+  // 첫 글자를 SIMD 로 찾은 뒤 나머지를 비교한다.
+  // (whole_ 이 아니므로 d 는 비어있지 않고 s 보다 길지 않다)
+  static std::size_t Find(StringView s, StringView d, std::size_t pos) {
+    const StringView head(s.data(), s.size() - d.size() + 1);
+    while (true) {
+      pos = scan::find_char(head, d[0], pos);
+      if (pos == StringView::npos)
+        return pos;
+      if (std::memcmp(s.data() + pos + 1, d.data() + 1, d.size() - 1) == 0)
+        return pos;
+      pos++;
+    }
+  }
+
+  static std::size_t Find(StringView s, const CharSet& d, std::size_t pos) {
+    return scan::find_first_of(s, d, pos);
+  }
+
+ private:
+  StringView str_;
+  Delim delim_;
+  bool accept_empty_;
+  bool whole_;  // delim 이 비었거나 str 보다 길다
+};
+
+
+//------------------------------------------------------------------------------
+// split() 과 같은 규칙으로 나누되, 조각을 복사하지 않고 str 을 가리키는
+// StringView 로 하나씩 돌려준다. 수 GB 의 로그를 읽을 때처럼 조각마다 할당하는
+// 비용이 클 때 사용한다.
+// @code
+// for (cu::StringView field : strutil::split_view(line, '\t'))
+//   Consume(field);
+// @endcode
+// @param str 대상 문자열. 결과를 사용하는 동안 유지되어야 한다.
+// @param delim delim 문자 또는 문자열
+// @param accept_empty true인 경우 빈 문자열도 결과에 포함.
+// @return 분할된 조각들의 range
+//------------------------------------------------------------------------------
+inline SplitView<char> split_view(StringView str, char delim,
+                                  bool accept_empty=false) {
+  return SplitView<char>(str, delim, accept_empty);
+}
+
+inline SplitView<StringView> split_view(StringView str, StringView delim,
+                                        bool accept_empty=false) {
+  return SplitView<StringView>(str, delim, accept_empty);
+}
+
+
+//------------------------------------------------------------------------------
+// range 의 조각(StringView)들을 문자열 벡터로 복사한다.
+//------------------------------------------------------------------------------
+template <typename Range>
+inline std::vector<std::string> to_strings(const Range& range) {
+  std::vector<std::string> result;
+  for (StringView piece : range)
+    result.emplace_back(piece.data(), piece.size());
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// allocator 를 받는 버전. 벡터와 문자열 모두 Alloc 으로 할당한다.
+// ArenaAllocator 를 쓰면 arena 를 Reset() 할 때 한 번에 해제된다. (arena.h)
+// @code
+// cu::Arena arena;
+// auto v = strutil::split(line, ",", false, cu::ArenaAllocator<char>(arena));
+// @endcode
+//------------------------------------------------------------------------------
+template <typename Alloc>
+using BasicString = std::basic_string<
+    char, std::char_traits<char>,
+    typename std::allocator_traits<Alloc>::template rebind_alloc<char>>;
+
+template <typename Alloc>
+using StringVector = std::vector<
+    BasicString<Alloc>,
+    typename std::allocator_traits<Alloc>::template rebind_alloc<
+        BasicString<Alloc>>>;
+
+template <typename Range, typename Alloc>
+inline StringVector<Alloc> to_strings(const Range& range, const Alloc& alloc) {
+  using CharAlloc = typename BasicString<Alloc>::allocator_type;
+  StringVector<Alloc> result(alloc);
+  for (StringView piece : range)
+    result.emplace_back(piece.data(), piece.size(), CharAlloc(alloc));
+  return result;
+}
+
+
 //------------------------------------------------------------------------------
 // str을 delim 문자열 기준으로 나눈다.
 // 이 때 사용되는 delim은 문자(char) 단위로 처리되는 것이 아니라 문자열 자체로
@@ -27,55 +222,81 @@ namespace strutil {
 inline std::vector<std::string> split(const std::string& str,
                                       const std::string& delim,
                                       bool accept_empty=false) {
-  std::vector<std::string> result;
-  if (str.empty())
-    return result;
-  if (delim.empty() || (delim.size() > str.size())) {
-    result.push_back(str);
-    return result;
-  }
-  std::size_t p = 0;
-  std::size_t q = str.size();
-  while (p < q) {
-    auto pos = str.find(delim, p);
-    if (std::string::npos == pos) {
-      result.push_back(str.substr(p));
-      break;
-    }
-    if (accept_empty == true) {
-      result.push_back(str.substr(p, pos - p));
-    }
-    else if (p < pos) {
-      result.push_back(str.substr(p, pos - p));
-    }
-    p = pos + delim.size();
-  }
-  return result;
+  if (delim.size() == 1)
+    return to_strings(split_view(str, delim[0], accept_empty));
+  return to_strings(split_view(str, StringView(delim), accept_empty));
+}
+
+template <typename Alloc>
+inline StringVector<Alloc> split(const std::string& str,
+                                 const std::string& delim,
+                                 bool accept_empty, const Alloc& alloc) {
+  if (delim.size() == 1)
+    return to_strings(split_view(str, delim[0], accept_empty), alloc);
+  return to_strings(split_view(str, StringView(delim), accept_empty), alloc);
 }
 
+
+//------------------------------------------------------------------------------
+// str을 chars 에 포함된 아무 문자 기준으로 나눈다. (문자 단위)
+// 나머지 규칙은 split() 과 같다.
+// @code
+// auto v = strutil::split_any("a b\tc", " \t");  // v = { "a", "b", "c" };
+// @endcode
+// @param str 대상 문자열
+// @param chars 구분자로 사용할 문자들
+// @param accept_empty true인 경우 빈 문자열도 결과에 포함.
+//------------------------------------------------------------------------------
+inline SplitView<CharSet> split_any_view(StringView str, StringView chars,
+                                         bool accept_empty=false) {
+  return SplitView<CharSet>(str, CharSet(chars), accept_empty);
+}
+
+inline std::vector<std::string> split_any(const std::string& str,
+                                          const std::string& chars,
+                                          bool accept_empty=false) {
+  return to_strings(split_any_view(str, chars, accept_empty));
+}
+
+template <typename Alloc>
+inline StringVector<Alloc> split_any(const std::string& str,
+                                     const std::string& chars,
+                                     bool accept_empty, const Alloc& alloc) {
+  return to_strings(split_any_view(str, chars, accept_empty), alloc);
+}
+
+
 //------------------------------------------------------------------------------
 // 입력받은 문자열을 모두 합쳐 하나의 문자열로 반환한다.
 // 이를 처리하기 위해 반드시 1 개 이상의 문자열을 입력받는다.
+// 인자들은 복사 없이 StringView 로 읽으며, 크기를 먼저 합산한 뒤 s1 에 한 번에
+// 붙인다.
 // @param s1 첫번째 문자열.
-// @param strs 나머지 문자열들.
+// @param strs 나머지 문자열들. (StringView 로 변환 가능한 타입)
 // @return argument 들을 결합하여 새롭게 생성된 문자열.
 //------------------------------------------------------------------------------
 template <typename... Args>
-inline std::string join(std::string s1, Args&&... args) {
-  if (sizeof...(args) == 0)
-    return s1;
-  auto str_list = vector_cast<std::string>(std::forward<Args>(args)...);
-  
+inline std::string join(std::string s1, const Args&... args) {
   std::size_t total_size = s1.size();
-  for (const auto& s : str_list)
-    total_size += s.size();
+  do_in_order{0, (total_size += StringView(args).size(), 0)...};
   s1.reserve(total_size);
-  for (auto& s : str_list) {
-    s1.insert(s1.end(),
-              std::make_move_iterator(s.begin()),
-              std::make_move_iterator(s.end()));
-  }
-  return s1
+  do_in_order{0, (s1.append(StringView(args).data(),
+                            StringView(args).size()), 0)...};
+  return s1;
+}
+
+//------------------------------------------------------------------------------
+// 문자열, 문자, 정수, 실수를 섞어서 하나의 문자열로 만든다.
+// 결과 크기를 한 번에 계산해 메모리 할당은 한 번이며, 숫자는 결과 버퍼에 바로
+// 기록된다. (string_builder.h)
+// e.g. concat("id=", 42, " score=", 0.5) == "id=42 score=0.5"
+//------------------------------------------------------------------------------
+template <typename... Args>
+inline std::string concat(const Args&... args) {
+  std::string result;
+  StringBuilder sb(&result);
+  sb.Append(args...);
+  return sb.release();
 }
 
 //------------------------------------------------------------------------------
@@ -117,45 +338,121 @@ inline std::string join(const std::vector<std::string>& str_list,
 // @param str 입력 문자열
 // @param prefix 비교해야 할 문자열
 //------------------------------------------------------------------------------
-inline bool startsWith(const std::string& str, const std::string& prefix) {
-  if (prefix.empty()) return true;
-  if (str.empty()) return false;
-  
+inline bool startsWith(StringView str, StringView prefix) {
   if (str.size() < prefix.size())
     return false;
-  
-  std::size_t idx = 0;
-  for(const auto& p : prefix) {
-    if (p != str[idx++])
-      return false;
-  }
-  return true;
+  return prefix.empty() ||
+         std::memcmp(str.data(), prefix.data(), prefix.size()) == 0;
 }
 
 
 //------------------------------------------------------------------------------
 // str 문자열이 postfix 문자열로 끝나는지 확인한다.
 // @param str 입력 문자열
-// @param prefix 비교해야 할 문자열
+// @param postfix 비교해야 할 문자열
 //------------------------------------------------------------------------------
-inline bool endsWith(const std::string& str, const std::string& postfix) {
-  if (postfix.empty()) return true;
-  if (str.empty()) return false;
-
+inline bool endsWith(StringView str, StringView postfix) {
   if (str.size() < postfix.size())
     return false;
+  return postfix.empty() ||
+         std::memcmp(str.data() + str.size() - postfix.size(), postfix.data(),
+                     postfix.size()) == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// ASCII 대소문자 변환. 'A'-'Z', 'a'-'z' 외의 바이트 (UTF-8 포함) 는 그대로 두며
+// locale 은 사용하지 않는다. SIMD 로 처리한다. (char_scan.h)
+// @code
+// strutil::to_lower(&header);              // 제자리 변환
+// strutil::to_lower(name, buf);            // buf 에 name.size() 만큼 기록
+// @endcode
+//------------------------------------------------------------------------------
+inline void to_lower(std::string* str) {
+  if (!str->empty())
+    scan::to_lower(*str, &(*str)[0]);
+}
+
+inline void to_upper(std::string* str) {
+  if (!str->empty())
+    scan::to_upper(*str, &(*str)[0]);
+}
+
+inline void to_lower(StringView str, char* out) {
+  scan::to_lower(str, out);
+}
+
+inline void to_upper(StringView str, char* out) {
+  scan::to_upper(str, out);
+}
+
+inline std::string to_lower(StringView str) {
+  std::string result(str.data(), str.size());
+  to_lower(&result);
+  return result;
+}
+
+inline std::string to_upper(StringView str) {
+  std::string result(str.data(), str.size());
+  to_upper(&result);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// ASCII 대소문자를 무시한 비교. 복사본을 만들지 않고 SIMD 로 비교한다.
+// e.g. iequals("Content-Type", "content-type") == true
+//------------------------------------------------------------------------------
+inline bool iequals(StringView a, StringView b) {
+  return scan::equal_nocase(a, b);
+}
+
+inline bool istartsWith(StringView str, StringView prefix) {
+  return str.size() >= prefix.size() &&
+         scan::equal_nocase(str.substr(0, prefix.size()), prefix);
+}
+
+inline bool iendsWith(StringView str, StringView postfix) {
+  return str.size() >= postfix.size() &&
+         scan::equal_nocase(str.substr(str.size() - postfix.size()), postfix);
+}
 
-  std::size_t idx(str.size() - postfix.size());
-  for(const auto& p : postfix) {
-    if (p!= str[idx++])
-      return false;
+
+//------------------------------------------------------------------------------
+// ASCII 대소문자를 무시하고 pos 이후에서 needle 을 찾는다.
+// needle 첫 문자의 두 가지 경우를 SIMD 로 찾은 뒤 나머지를 비교한다.
+// @return 찾은 위치. 없으면 StringView::npos
+//------------------------------------------------------------------------------
+inline std::size_t ifind(StringView str, StringView needle,
+                         std::size_t pos = 0) {
+  if (pos > str.size() || needle.size() > str.size() - pos)
+    return StringView::npos;
+  if (needle.empty())
+    return pos;
+  const char lower = scan::to_lower(needle[0]);
+  const char upper = scan::to_upper(needle[0]);
+  CharSet first;
+  first.insert(lower);
+  first.insert(upper);
+  // needle 이 시작할 수 있는 위치까지만 찾는다.
+  const StringView window(str.data(), str.size() - needle.size() + 1);
+  const StringView rest = needle.substr(1);
+  while (true) {
+    pos = lower == upper ? scan::find_char(window, lower, pos)
+                         : scan::find_first_of(window, first, pos);
+    if (pos == StringView::npos)
+      return pos;
+    if (scan::equal_nocase(StringView(str.data() + pos + 1, rest.size()), rest))
+      return pos;
+    pos++;
   }
-  return true;
 }
 
 
 //------------------------------------------------------------------------------
 // from 문자열을 to 문자열로 치환한다.
+// 중간 조각을 만들지 않고 한 번의 scan 으로 결과 문자열에 바로 쓴다.
+// 여러 쌍을 치환하거나 같은 치환을 반복한다면 Replacer (replacer.h) 를 쓴다.
 // @param str 대상 문자열.
 // @param from 대상 문자열 내에 변환하려고 하는 부분 문자열
 // @param to 치환하고자 하는 문자열.
@@ -164,21 +461,68 @@ inline bool endsWith(const std::string& str, const std::string& postfix) {
 inline std::string
 replace(const std::string& str,
         const std::string& from, const std::string& to) {
-  auto snip = split(str, from, true);
-  return join(snip, to);
+  if (from.empty())
+    return str;
+  StringView s(str);
+  std::string result;
+  result.reserve(str.size());
+  std::size_t p = 0;
+  for (;;) {
+    std::size_t pos = s.find(StringView(from), p);
+    if (pos == StringView::npos)
+      break;
+    result.append(str, p, pos - p);
+    result.append(to);
+    p = pos + from.size();
+  }
+  result.append(str, p, std::string::npos);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// 좌측 공백을 제외한 부분을 가리키는 view. delim 은 문자(char) 단위로 처리된다.
+// 경계는 SIMD 로 찾는다. (char_scan.h)
+//------------------------------------------------------------------------------
+inline StringView
+ltrim_view(StringView str, StringView delims=" \r\t\n") {
+  std::size_t pos = scan::find_first_not_of(str, CharSet(delims));
+  if (pos == scan::npos)
+    return StringView();
+  return str.substr(pos);
 }
 
+//------------------------------------------------------------------------------
+// 우측 공백을 제외한 부분을 가리키는 view. delim 은 문자(char) 단위로 처리된다.
+//------------------------------------------------------------------------------
+inline StringView
+rtrim_view(StringView str, StringView delims=" \r\t\n") {
+  std::size_t pos = scan::find_last_not_of(str, CharSet(delims));
+  if (pos == scan::npos)
+    return StringView();
+  return str.substr(0, pos + 1);
+}
+
+//------------------------------------------------------------------------------
+// 좌우측 공백을 제외한 부분을 가리키는 view. delim 은 문자(char) 단위로
+// 처리된다.
+//------------------------------------------------------------------------------
+inline StringView
+trim_view(StringView str, StringView delims=" \r\t\n") {
+  CharSet set(delims);
+  std::size_t first = scan::find_first_not_of(str, set);
+  if (first == scan::npos)
+    return StringView();
+  std::size_t last = scan::find_last_not_of(str, set);
+  return str.substr(first, last - first + 1);
+}
 
 //------------------------------------------------------------------------------
 // 좌측 공백 삭제. delim 은 문자(char) 단위로 처리된다.
 //------------------------------------------------------------------------------
 inline std::string
 ltrim(const std::string& str, const std::string& delims=" \r\t\n") {
-  std::string result;
-  auto pos = str.find_first_not_of(delims);
-  if (fnd == std::string::npos)
-    return std::string();
-  return str.substr(pos);
+  return ltrim_view(str, delims).to_string();
 }
 
 //------------------------------------------------------------------------------
@@ -186,11 +530,7 @@ ltrim(const std::string& str, const std::string& delims=" \r\t\n") {
 //------------------------------------------------------------------------------
 inline std::string
 rtrim(const std::string& str, const std::string& delims=" \r\t\n") {
-  std::string result = str;
-  std::size_t pos = str.find_last_not_of(delims);
-  if (pos != std::string::npos)
-    result.erase(pos + 1);
-  return result;
+  return rtrim_view(str, delims).to_string();
 }
 
 //------------------------------------------------------------------------------
@@ -198,11 +538,9 @@ rtrim(const std::string& str, const std::string& delims=" \r\t\n") {
 //------------------------------------------------------------------------------
 inline std::string
 trim(const std::string& str, const std::string& delims=" \r\t\n") {
-  std::string result;
-  result = rtrim(str, delims);
-  result = ltrim(result, delims);
-  return result;
+  return trim_view(str, delims).to_string();
 }
 
 }  // namespace strutil
-#endif  // STRUTIL_H_
+}  // namespace cu
+#endif  // CPPUTIL_STRUTIL_H_
@@ -5,16 +5,34 @@
 //------------------------------------------------------------------------------
 #ifndef CPPUTIL_THREAD_POOL_H_
 #define CPPUTIL_THREAD_POOL_H_
+#include <algorithm>          // for std::min, std::push_heap
+#include <chrono>             // for std::chrono::steady_clock
+#include <cstdint>            // for std::int64_t
 #include <vector>             // for std::vector
-#include <queue>              // for std::queue
-#include <memory>             // for std::make_shared
+#include <memory>             // for std::unique_ptr, std::allocator_arg
 #include <thread>             // for std::thread
 #include <mutex>              // for std::mutex
 #include <condition_variable> // for std::condition_variable
+#include <atomic>             // for std::atomic
 #include <future>             // for std::future
-#include <functional>         // for std::function
+#include <functional>         // for std::bind
 #include <stdexcept>          // for std::runtime_error
+#include <string>             // for std::to_string
 #include <cassert>            // for assert
+#include <type_traits>        // for std::enable_if
+#include "cpu_topology.h"     // for cu::CpuTopology
+#include "exception.h"        // for cu::InvalidParameterError
+#include "future.h"           // for cu::Future
+#include "mpmc_queue.h"       // for cu::MpmcQueue
+#include "pool_metrics.h"     // for cu::PoolMetrics
+#include "ring_deque.h"       // for cu::RingDeque
+#include "trace.h"            // for cu::Tracer
+#include "unique_task.h"      // for cu::UniqueTask
+
+// coroutine support (cu::Task, co_await pool.schedule()) needs c++20.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define CPPUTIL_HAS_COROUTINES 1
+#endif
 
 
 namespace cu {
@@ -23,12 +41,104 @@ namespace cu {
 //------------------------------------------------------------------------------
 // @class ThreadPool
 //------------------------------------------------------------------------------
+// kSharedQueue  : every task goes through one FIFO queue. (default)
+// kWorkStealing : each worker owns a deque. tasks enqueued from a worker are
+//                 pushed/popped at the back of its own deque (LIFO), idle
+//                 workers steal from the front of the others. tasks enqueued
+//                 from outside the pool are spread over the deques.
+// kLockFree     : every task goes through one bounded lock-free ring. when the
+//                 ring is full, tasks overflow into a locked queue.
+//
+// idle workers poll 'spin_count' times before parking on a condition
+// variable. producers only take the pool mutex when a worker is parked.
+//
+// tasks are queued in three lanes, drained in priority order:
+//   kHigh   : tasks with a priority of kHigh or with a deadline, run
+//             earliest deadline first. (kHigh tasks use the enqueue time)
+//   kNormal : tasks without priority, queued as described above.
+//   kLow    : tasks with a priority of kLow.
+// a non-empty lane passed over 'starvation_limit' times goes first once.
+//
+// placement: with 'pin_threads' every worker is pinned to one cpu. with
+// 'numa_aware' workers are spread round-robin over the numa nodes (and pinned
+// to their node), and each node gets a queue of its own. EnqueueOnNode() /
+// PostOnNode() push into that queue; workers of the node take from it before
+// anything else of the normal lane, others only when they ran out of work.
+// nodes are given by their kernel number (CpuTopology::node_id()), a node
+// without workers of the pool is an InvalidParameterError. without
+// 'numa_aware' the node is ignored.
+// 'cpus' restricts the placement to a subset of cpus. pinning is silently
+// skipped where the platform doesn't support it.
+//
+// Enqueue() returns std::future. Submit() returns cu::Future, whose shared
+// state comes from a pool, and Post() returns nothing. with small captures
+// Submit()/Post() don't allocate at all, larger ones are boxed in an
+// ObjectPool. Enqueue(std::allocator_arg, alloc, ...) takes the shared state
+// of its std::future from 'alloc'. an exception escaping a posted task
+// terminates the program, use Submit() to get it back.
+//
+// with 'metrics' every worker counts executed tasks, steals, busy/idle time
+// and histograms of queue wait and run time into a shard of its own.
+// metrics() sums them up. (see pool_metrics.h)
+//
+// while cu::Tracer is enabled every task is traced from its enqueue to the
+// end of its run. (see trace.h)
+//
+// built as c++20, coroutines can hop onto the pool with 'co_await
+// pool.schedule()'. (see coroutine.h)
+//------------------------------------------------------------------------------
 class ThreadPool {
  public:
-  using Task = std::function<void()>;
-  
+  // queued task. 'enqueued' is only stamped when metrics or tracing are on.
+  // with tracing it is also the flow id of the task. (see trace.h) it sits
+  // in the tail padding of UniqueTask, so a queue slot doesn't grow.
+  struct Task : UniqueTask {
+    Task() noexcept : UniqueTask{}, enqueued{0} { }
+
+    template <typename F,
+              typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type,
+                              Task>::value>::type>
+    Task(F&& f)  // NOLINT (implicit by design)
+        : UniqueTask(std::forward<F>(f)), enqueued{0} { }
+
+    Task(Task&&) noexcept = default;
+    Task& operator=(Task&&) noexcept = default;
+
+    std::int64_t enqueued;  // ns on Clock
+  };
+
+  enum class Scheduling {
+    kSharedQueue,
+    kWorkStealing,
+    kLockFree,
+  };
+
+  enum class Priority {
+    kHigh,
+    kNormal,
+    kLow,
+  };
+
+  using Clock = std::chrono::steady_clock;
+  using Deadline = Clock::time_point;
+
+  struct Options {
+    std::size_t num_threads = 1;
+    Scheduling scheduling = Scheduling::kSharedQueue;
+    std::size_t queue_capacity = 4096;  // ring size for kLockFree
+    std::size_t spin_count = 64;        // polls before an idle worker parks
+    std::size_t starvation_limit = 32;  // pops a waiting lane may be skipped
+    bool pin_threads = false;           // pin each worker to one cpu
+    bool numa_aware = false;            // group workers per numa node
+    std::vector<int> cpus;              // cpus to place workers on (all)
+    bool metrics = false;               // collect runtime metrics
+  };
+
  public:
-  explicit ThreadPool(std::size_t num_threads);
+  explicit ThreadPool(std::size_t num_threads,
+                      Scheduling scheduling = Scheduling::kSharedQueue);
+  explicit ThreadPool(const Options& options);
   ~ThreadPool();
 
  public:
@@ -42,49 +152,293 @@ class ThreadPool {
   auto Enqueue(F&& f, Args&&... args)
       -> std::future<typename std::result_of<F(Args...)>::type>;
 
+  template<typename F, typename... Args>
+  auto Enqueue(Priority priority, F&& f, Args&&... args)
+      -> std::future<typename std::result_of<F(Args...)>::type>;
+
+  template<typename F, typename... Args>
+  auto Enqueue(Deadline deadline, F&& f, Args&&... args)
+      -> std::future<typename std::result_of<F(Args...)>::type>;
+
+  // the shared state of the future comes from 'alloc'. (e.g. a
+  // PoolAllocator, see object_pool.h) the worker lets go of it just after
+  // the value is set, so an arena must not be reset while the pool is busy.
+  template<typename Alloc, typename F, typename... Args>
+  auto Enqueue(std::allocator_arg_t, const Alloc& alloc, F&& f,
+               Args&&... args)
+      -> std::future<typename std::result_of<F(Args...)>::type>;
+
+  template<typename F, typename... Args>
+  auto Submit(F&& f, Args&&... args)
+      -> Future<typename std::result_of<F(Args...)>::type>;
+
+  template<typename F, typename... Args>
+  auto Submit(Priority priority, F&& f, Args&&... args)
+      -> Future<typename std::result_of<F(Args...)>::type>;
+
+  template<typename F, typename... Args>
+  auto Submit(Deadline deadline, F&& f, Args&&... args)
+      -> Future<typename std::result_of<F(Args...)>::type>;
+
+  template<typename F, typename... Args>
+  void Post(F&& f, Args&&... args);
+
+  template<typename F>
+  void PostBulk(std::size_t count, const F& f);
+
+  template<typename F, typename... Args>
+  auto EnqueueOnNode(std::size_t node, F&& f, Args&&... args)
+      -> std::future<typename std::result_of<F(Args...)>::type>;
+
+  template<typename F, typename... Args>
+  void PostOnNode(std::size_t node, F&& f, Args&&... args);
+
+#if defined(CPPUTIL_HAS_COROUTINES)
+  // 'co_await pool.schedule()' resumes the coroutine on a worker.
+  // defined in coroutine.h
+  class ScheduleAwaiter;
+  ScheduleAwaiter schedule();
+#endif
+
  public:
   std::size_t size() const;
+  std::size_t size(Priority priority) const;
+
+  // queue depths and, with Options::metrics, what the workers did so far.
+  PoolMetrics metrics() const;
+
+  std::size_t num_threads() const {
+    return workers_.size();
+  }
+
+  Scheduling scheduling() const {
+    return scheduling_;
+  }
+
+  // number of numa nodes the workers are grouped in. (1 unless numa_aware)
+  std::size_t num_nodes() const {
+    return node_queues_.empty() ? 1 : node_queues_.size();
+  }
+
+  // numa node (kernel number) of a worker.
+  std::size_t worker_node(std::size_t index) const {
+    return node_queues_.empty() ? 0 : node_ids_[worker_node_[index]];
+  }
+
+ private:
+  // task queue. shared queue mode has only one, work stealing mode has one
+  // per worker. padded to avoid false sharing between neighbour queues.
+  struct WorkQueue {
+    std::mutex mtx;
+    RingDeque<Task> tasks;
+    char padding[64];
+  };
+
+  // identify the pool/worker which the current thread belongs to.
+  struct WorkerContext {
+    const ThreadPool* pool;
+    std::size_t index;
+  };
+
+  // fulfill the promise (cu::Promise or std::promise) with the result of
+  // func.
+  template <typename P, typename Func>
+  struct PromiseTask {
+    P promise;
+    Func func;
+    void operator()() { detail::Fulfill(promise, func); }
+  };
+
+  // entry of the kHigh lane. (min-heap on deadline, then enqueue order)
+  struct TimedTask {
+    Deadline deadline;
+    std::size_t seq;
+    Task task;
+    bool operator<(const TimedTask& other) const {
+      if (deadline != other.deadline)
+        return deadline > other.deadline;
+      return seq > other.seq;
+    }
+  };
+
+  // counts a push from outside the pool until it no longer touches the pool.
+  // a foreign thread may still be waking workers when the task it pushed has
+  // already run, and its owner has gone on to destroy the pool.
+  class PushScope {
+   public:
+    explicit PushScope(ThreadPool& pool)
+        : pool_{Current().pool == &pool ? nullptr : &pool} {
+      if (pool_)
+        pool_->pushers_.fetch_add(1);
+    }
+    ~PushScope() {
+      if (pool_)
+        pool_->pushers_.fetch_sub(1);
+    }
+    PushScope(const PushScope&) = delete;
+    PushScope& operator=(const PushScope&) = delete;
+
+   private:
+    ThreadPool* pool_;
+  };
+
+  static WorkerContext& Current() {
+    static thread_local WorkerContext ctx{nullptr, 0};
+    return ctx;
+  }
+
+ private:
+  void Run(std::size_t index);
+  void Place(const Options& options);
+  void Push(Task&& task);
+  void PushNode(std::size_t node, Task&& task);
+  void PushLane(Priority priority, Deadline deadline, Task&& task);
+  void Wake(std::size_t count);
+  bool HasWork() const;
+  bool Pop(std::size_t index, Task& task);
+  bool PopHigh(Task& task);
+  bool PopLow(Task& task);
+  bool PopNormal(std::size_t index, Task& task);
+  bool PopQueues(std::size_t index, Task& task);
+  bool PopNode(std::size_t index, Task& task);
+  bool PopFront(WorkQueue& q, Task& task);
+  bool Steal(std::size_t index, Task& task);
+  void Skip(std::atomic<std::size_t>& depth, std::atomic<std::size_t>& skipped);
+  void Stamp(Task& task) const;
+  void CountSteal(std::size_t index);
+
+  static std::int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+  }
 
  private:
   std::vector<std::thread> workers_;
-  std::queue<Task> tasks_;
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::unique_ptr<MpmcQueue<Task>> ring_;
+  Scheduling scheduling_;
+  std::size_t spin_count_;
+  std::atomic<std::size_t> next_queue_;
+  std::atomic<std::size_t> overflow_;
+
+ private:
+  // numa placement. node_queues_ is empty unless numa_aware. node_ids_
+  // holds the kernel number of each queue's node.
+  std::vector<std::unique_ptr<WorkQueue>> node_queues_;
+  std::vector<std::size_t> node_ids_;
+  std::vector<std::size_t> worker_node_;
+  std::vector<std::vector<int>> worker_cpus_;
+  std::atomic<std::size_t> node_depth_;
+
+ private:
+  // one shard per worker. empty unless Options::metrics.
+  std::vector<std::unique_ptr<detail::WorkerStats>> stats_;
+
+ private:
+  // kHigh/kLow lanes. the kNormal lane is queues_/ring_ above.
+  std::mutex lane_mtx_;
+  std::vector<TimedTask> high_;
+  RingDeque<Task> low_;
+  std::size_t lane_seq_;
+  std::size_t starvation_limit_;
+  std::atomic<std::size_t> high_depth_;
+  std::atomic<std::size_t> low_depth_;
+  std::atomic<std::size_t> normal_skipped_;
+  std::atomic<std::size_t> low_skipped_;
 
  private:
   std::mutex mtx_;
   std::condition_variable cond_;
-  volatile bool stop_;
+  std::atomic<std::size_t> pending_;  // depth of the kNormal lane
+  std::atomic<std::size_t> sleepers_;
+  std::atomic<std::size_t> pushers_;  // see PushScope
+  std::atomic<bool> stop_;
 };
 
 
 //------------------------------------------------------------------------------
 // @brief ThreadPool constructor
 //------------------------------------------------------------------------------
-inline ThreadPool::ThreadPool(std::size_t num_threads)
-    : workers_{}, tasks_{}, mtx_{}, cond_{}, stop_{false} {
+inline ThreadPool::ThreadPool(std::size_t num_threads, Scheduling scheduling)
+    : ThreadPool([=]() {
+        Options options;
+        options.num_threads = num_threads;
+        options.scheduling = scheduling;
+        return options;
+      }()) {
+}
+
+
+//------------------------------------------------------------------------------
+// @brief ThreadPool constructor
+//------------------------------------------------------------------------------
+inline ThreadPool::ThreadPool(const Options& options)
+    : workers_{}, queues_{}, ring_{}, scheduling_{options.scheduling},
+      spin_count_{options.spin_count}, next_queue_{0}, overflow_{0},
+      node_queues_{}, node_ids_{}, worker_node_{}, worker_cpus_{}, node_depth_{0}, stats_{},
+      lane_mtx_{}, high_{}, low_{}, lane_seq_{0},
+      starvation_limit_{options.starvation_limit}, high_depth_{0},
+      low_depth_{0}, normal_skipped_{0}, low_skipped_{0},
+      mtx_{}, cond_{}, pending_{0}, sleepers_{0}, pushers_{0},
+      stop_{false} {
+  const std::size_t num_threads = options.num_threads;
   assert(num_threads > 0);
+  std::size_t num_queues = 1;
+  if (scheduling_ == Scheduling::kWorkStealing)
+    num_queues = num_threads;
+  queues_.reserve(num_queues);
+  for (decltype(num_queues) i = 0; i < num_queues; i++)
+    queues_.emplace_back(new WorkQueue);
+  if (scheduling_ == Scheduling::kLockFree)
+    ring_.reset(new MpmcQueue<Task>(options.queue_capacity));
+  Place(options);
+  for (std::size_t i = 0; options.metrics && i < num_threads; i++)
+    stats_.emplace_back(new detail::WorkerStats);
+
   workers_.reserve(num_threads);
-  for (decltype(num_threads) i = 0; i < num_threads; i++) {
-    workers_.emplace_back([this]() {
-        while (true) {
-          Task task;
-          {
-            std::unique_lock<std::mutex> lock(this->mtx_);
-            this->cond_.wait(lock, [this] {
-                return this->stop_ || (!this->tasks_.empty());
-              });
-            if (this->stop_ && this->tasks_.empty())
-              return;
-            task = std::move(this->tasks_.front());
-            this->tasks_.pop();
-          }
-          task();  // call task
-        }
-      });
+  for (std::size_t i = 0; i < num_threads; i++) {
+    workers_.emplace_back([this, i]() { this->Run(i); });
   }  // for loop
   assert(workers_.size() == num_threads);
 }
 
 
+//------------------------------------------------------------------------------
+// @brief decide numa node and cpus of every worker.
+//------------------------------------------------------------------------------
+inline void ThreadPool::Place(const Options& options) {
+  const std::size_t num_threads = options.num_threads;
+  worker_node_.assign(num_threads, 0);
+  worker_cpus_.assign(num_threads, std::vector<int>());
+  if (!options.pin_threads && !options.numa_aware && options.cpus.empty())
+    return;
+
+  CpuTopology topo = CpuTopology::Detect();
+  if (!options.cpus.empty()) {
+    CpuTopology restricted = topo.Restrict(options.cpus);
+    if (restricted.num_nodes() > 0)
+      topo = std::move(restricted);
+  }
+  std::size_t nodes = options.numa_aware ? topo.num_nodes() : 1;
+  for (std::size_t n = 0; options.numa_aware && n < nodes; n++) {
+    node_queues_.emplace_back(new WorkQueue);
+    node_ids_.push_back(static_cast<std::size_t>(topo.node_id(n)));
+  }
+
+  const std::vector<int> all = topo.cpus();
+  for (std::size_t i = 0; i < num_threads; i++) {
+    std::size_t node = i % nodes;
+    const std::vector<int>& cpus = options.numa_aware ? topo.node_cpus(node)
+                                                      : all;
+    worker_node_[i] = node;
+    if (options.pin_threads)
+      worker_cpus_[i].push_back(cpus[(i / nodes) % cpus.size()]);
+    else
+      worker_cpus_[i] = cpus;
+  }
+}
+
+
 //------------------------------------------------------------------------------
 // @brief distructor
 //------------------------------------------------------------------------------
@@ -93,10 +447,12 @@ inline ThreadPool::~ThreadPool() {
     std::unique_lock<std::mutex> lock(this->mtx_);
     stop_ = true;
   }
-  cond_.notify_all();  
+  cond_.notify_all();
   for(auto& worker : workers_) {
     worker.join();
   }
+  while (pushers_.load() > 0)
+    std::this_thread::yield();
 }
 
 
@@ -109,27 +465,654 @@ inline auto ThreadPool::Enqueue(F&& f, Args&&... args)
   using RetType = typename std::result_of<F(Args...)>::type;
   using TaskType = std::packaged_task<RetType()>;
 
-  auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-  auto task = std::make_shared<TaskType>(std::move(func));
+  TaskType task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+  std::future<RetType> result = task.get_future();
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  // add task into queue.
+  Push(std::move(task));
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into thread pool. the shared state is taken from alloc.
+//------------------------------------------------------------------------------
+template<typename Alloc, typename F, typename... Args>
+inline auto ThreadPool::Enqueue(std::allocator_arg_t, const Alloc& alloc,
+                                F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using Func = decltype(std::bind(std::forward<F>(f),
+                                  std::forward<Args>(args)...));
+
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  std::promise<RetType> promise(std::allocator_arg, alloc);
+  std::future<RetType> result = promise.get_future();
+  Push(PromiseTask<std::promise<RetType>, Func>{
+      std::move(promise),
+      std::bind(std::forward<F>(f), std::forward<Args>(args)...)});
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into thread pool. result is delivered through cu::Future.
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline auto ThreadPool::Submit(F&& f, Args&&... args)
+    -> Future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using Func = decltype(std::bind(std::forward<F>(f),
+                                  std::forward<Args>(args)...));
+
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  Promise<RetType> promise;
+  Future<RetType> result = promise.get_future();
+  Push(PromiseTask<Promise<RetType>, Func>{
+      std::move(promise),
+      std::bind(std::forward<F>(f), std::forward<Args>(args)...)});
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into a priority lane.
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline auto ThreadPool::Enqueue(Priority priority, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using TaskType = std::packaged_task<RetType()>;
+
+  TaskType task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+  std::future<RetType> result = task.get_future();
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  Deadline now;
+  if (priority == Priority::kHigh)
+    now = Clock::now();
+  PushLane(priority, now, std::move(task));
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into the kHigh lane, ordered by deadline.
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline auto ThreadPool::Enqueue(Deadline deadline, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using TaskType = std::packaged_task<RetType()>;
+
+  TaskType task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+  std::future<RetType> result = task.get_future();
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  PushLane(Priority::kHigh, deadline, std::move(task));
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into a priority lane. result is delivered through
+//        cu::Future.
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline auto ThreadPool::Submit(Priority priority, F&& f, Args&&... args)
+    -> Future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using Func = decltype(std::bind(std::forward<F>(f),
+                                  std::forward<Args>(args)...));
+
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  Promise<RetType> promise;
+  Future<RetType> result = promise.get_future();
+  Deadline now;
+  if (priority == Priority::kHigh)
+    now = Clock::now();
+  PushLane(priority, now, PromiseTask<Promise<RetType>, Func>{
+      std::move(promise),
+      std::bind(std::forward<F>(f), std::forward<Args>(args)...)});
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into the kHigh lane, ordered by deadline. result is
+//        delivered through cu::Future.
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline auto ThreadPool::Submit(Deadline deadline, F&& f, Args&&... args)
+    -> Future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using Func = decltype(std::bind(std::forward<F>(f),
+                                  std::forward<Args>(args)...));
+
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  Promise<RetType> promise;
+  Future<RetType> result = promise.get_future();
+  PushLane(Priority::kHigh, deadline, PromiseTask<Promise<RetType>, Func>{
+      std::move(promise),
+      std::bind(std::forward<F>(f), std::forward<Args>(args)...)});
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into thread pool. (fire and forget)
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline void ThreadPool::Post(F&& f, Args&&... args) {
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  Push(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into the queue of a numa node.
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline auto ThreadPool::EnqueueOnNode(std::size_t node, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+  using RetType = typename std::result_of<F(Args...)>::type;
+  using TaskType = std::packaged_task<RetType()>;
+
+  TaskType task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+  std::future<RetType> result = task.get_future();
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  PushNode(node, std::move(task));
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief insert task into the queue of a numa node. (fire and forget)
+//------------------------------------------------------------------------------
+template<typename F, typename... Args>
+inline void ThreadPool::PostOnNode(std::size_t node, F&& f, Args&&... args) {
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  PushNode(node, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+}
+
+
+//------------------------------------------------------------------------------
+// @brief post f(0), f(1), ... f(count - 1) as one batch.
+//        each queue is locked once and sleeping workers are woken once.
+//------------------------------------------------------------------------------
+template<typename F>
+inline void ThreadPool::PostBulk(std::size_t count, const F& f) {
+  if (stop_)
+    throw std::runtime_error("enqueue on stopped ThreadPool");
+  if (count == 0)
+    return;
+  PushScope scope(*this);
+  std::size_t i = 0;
+  if (scheduling_ == Scheduling::kLockFree) {
+    for (; i < count; i++) {
+      Task task(std::bind(f, i));
+      Stamp(task);
+      pending_.fetch_add(1);
+      if (!ring_->TryPush(std::move(task))) {
+        pending_.fetch_sub(1);
+        break;
+      }
+    }
+    if (i < count) {
+      overflow_.fetch_add(count - i);
+      auto& wq = *queues_[0];
+      std::unique_lock<std::mutex> lock(wq.mtx);
+      for (std::size_t j = i; j < count; j++) {
+        wq.tasks.emplace_back(std::bind(f, j));
+        Stamp(wq.tasks.back());
+      }
+      pending_.fetch_add(count - i);
+    }
+    Wake(count);
+    return;
+  }
+  const std::size_t n = queues_.size();
+  std::size_t first = 0;
+  if (n > 1)
+    first = next_queue_.fetch_add(1, std::memory_order_relaxed);
+  // spread evenly over the queues, starting from a rotating one.
+  const std::size_t per_queue = (count + n - 1) / n;
+  for (std::size_t begin = 0, q = first; begin < count; q++) {
+    std::size_t end = std::min(begin + per_queue, count);
+    {
+      auto& wq = *queues_[q % n];
+      std::unique_lock<std::mutex> lock(wq.mtx);
+      for (std::size_t i = begin; i < end; i++) {
+        wq.tasks.emplace_back(std::bind(f, i));
+        Stamp(wq.tasks.back());
+      }
+      pending_.fetch_add(end - begin);
+    }
+    begin = end;
+  }
+  Wake(count);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief return number of queued tasks.
+//------------------------------------------------------------------------------
+inline std::size_t ThreadPool::size() const {
+  return high_depth_.load(std::memory_order_relaxed) +
+      pending_.load(std::memory_order_relaxed) +
+      low_depth_.load(std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief return number of queued tasks in a lane.
+//------------------------------------------------------------------------------
+inline std::size_t ThreadPool::size(Priority priority) const {
+  switch (priority) {
+    case Priority::kHigh:
+      return high_depth_.load(std::memory_order_relaxed);
+    case Priority::kLow:
+      return low_depth_.load(std::memory_order_relaxed);
+    default:
+      return pending_.load(std::memory_order_relaxed);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// @brief snapshot of queue depths and worker metrics.
+//------------------------------------------------------------------------------
+inline PoolMetrics ThreadPool::metrics() const {
+  PoolMetrics m;
+  m.enabled = !stats_.empty();
+  m.num_threads = workers_.size();
+  m.parked_workers = sleepers_.load(std::memory_order_relaxed);
+  m.queued_high = size(Priority::kHigh);
+  m.queued_normal = size(Priority::kNormal);
+  m.queued_low = size(Priority::kLow);
+  m.workers.resize(stats_.size());
+  for (std::size_t i = 0; i < stats_.size(); i++) {
+    stats_[i]->Snapshot(m.workers[i]);
+    m.total.Merge(m.workers[i]);
+  }
+  return m;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief remember when a task was pushed. (metrics and tracing only)
+//------------------------------------------------------------------------------
+inline void ThreadPool::Stamp(Task& task) const {
+  if (!stats_.empty())
+    task.enqueued = NowNs();
+  if (Tracer::enabled())
+    task.enqueued = detail::TraceEnqueue(stats_.empty() ? NowNs()
+                                                        : task.enqueued);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief count a task taken from another worker's or node's queue.
+//------------------------------------------------------------------------------
+inline void ThreadPool::CountSteal(std::size_t index) {
+  if (!stats_.empty())
+    stats_[index]->Steal();
+}
+
+
+//------------------------------------------------------------------------------
+// @brief true if any lane has a task.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::HasWork() const {
+  return (pending_ > 0) || (high_depth_ > 0) || (low_depth_ > 0);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief worker loop
+//------------------------------------------------------------------------------
+inline void ThreadPool::Run(std::size_t index) {
+  Current() = WorkerContext{this, index};
+  Tracer::SetThreadName("pool worker " + std::to_string(index));
+  if (!worker_cpus_[index].empty())
+    PinCurrentThread(worker_cpus_[index]);
+  detail::WorkerStats* stats = stats_.empty() ? nullptr
+                                              : stats_[index].get();
+  std::int64_t last_end = stats ? NowNs() : 0;
+  std::size_t spins = 0;
+  while (true) {
+    Task task;
+    if (Pop(index, task)) {
+      detail::TraceTaskScope trace(task.enqueued);
+      if (stats) {
+        std::int64_t start = NowNs();
+        task();
+        std::int64_t end = NowNs();
+        stats->Task(task.enqueued, start, end, start - last_end);
+        last_end = end;
+      } else {
+        task();  // call task
+      }
+      spins = 0;
+      continue;
+    }
+    if (stop_ && !HasWork())
+      return;
+    if (spins++ < spin_count_) {
+      CpuRelax();
+      continue;
+    }
+    spins = 0;
+    // nothing to do. park until a task is pushed.
+    // sleepers_ is raised before the lane depths are re-checked, so a
+    // producer either sees this worker as a sleeper or this worker sees its
+    // task.
+    sleepers_.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cond_.wait(lock, [this] {
+          return stop_ || HasWork();
+        });
+    }
+    sleepers_.fetch_sub(1);
+  }
+}
+
 
-  std::future<RetType> result = task->get_future();
+//------------------------------------------------------------------------------
+// @brief push task into the queue and wake up a sleeping worker.
+//------------------------------------------------------------------------------
+inline void ThreadPool::Push(Task&& task) {
+  PushScope scope(*this);
+  Stamp(task);
+  std::size_t target = 0;
+  if (scheduling_ == Scheduling::kLockFree) {
+    // the depth is raised before a worker can take the task and lower it.
+    pending_.fetch_add(1);
+    if (ring_->TryPush(std::move(task))) {
+      Wake(1);
+      return;
+    }
+    pending_.fetch_sub(1);
+    overflow_.fetch_add(1);
+  } else if (scheduling_ == Scheduling::kWorkStealing) {
+    const auto& ctx = Current();
+    if (ctx.pool == this)
+      target = ctx.index;
+    else
+      target = next_queue_.fetch_add(1, std::memory_order_relaxed)
+          % queues_.size();
+  }
   {
-    std::unique_lock<std::mutex> lock(mtx_);
-    if (true == stop_)
-      throw std::runtime_error("enqueue on stopped ThreadPool");
-    // add task into queue.
-    tasks_.emplace([task](){ (*task)(); });
+    auto& q = *queues_[target];
+    std::unique_lock<std::mutex> lock(q.mtx);
+    q.tasks.emplace_back(std::move(task));
+    pending_.fetch_add(1);  // under the lock, before a pop can lower it
   }
-  cond_.notify_one();
-  return result;
+  Wake(1);
 }
 
 
 //------------------------------------------------------------------------------
-// @brief return thread size.
+// @brief push task into the queue of a numa node. (normal lane)
 //------------------------------------------------------------------------------
-std::size_t ThreadPool::size() const {
-  return tasks_.size();
+inline void ThreadPool::PushNode(std::size_t node, Task&& task) {
+  PushScope scope(*this);
+  if (node_queues_.empty()) {
+    Push(std::move(task));
+    return;
+  }
+  std::size_t index = 0;
+  while (index < node_ids_.size() && node_ids_[index] != node)
+    index++;
+  if (index == node_ids_.size())
+    throw InvalidParameterError("ThreadPool: no workers on numa node " +
+                                std::to_string(node));
+  Stamp(task);
+  {
+    auto& q = *node_queues_[index];
+    std::unique_lock<std::mutex> lock(q.mtx);
+    q.tasks.emplace_back(std::move(task));
+    node_depth_.fetch_add(1);
+    pending_.fetch_add(1);
+  }
+  Wake(1);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief push task into the kHigh or kLow lane.
+//------------------------------------------------------------------------------
+inline void ThreadPool::PushLane(Priority priority, Deadline deadline,
+                                 Task&& task) {
+  PushScope scope(*this);
+  if (priority == Priority::kNormal) {
+    Push(std::move(task));
+    return;
+  }
+  Stamp(task);
+  {
+    std::unique_lock<std::mutex> lock(lane_mtx_);
+    if (priority == Priority::kHigh) {
+      high_.push_back(TimedTask{deadline, lane_seq_++, std::move(task)});
+      std::push_heap(high_.begin(), high_.end());
+      high_depth_.fetch_add(1);
+    } else {
+      low_.emplace_back(std::move(task));
+      low_depth_.fetch_add(1);
+    }
+  }
+  Wake(1);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief wake up to 'count' sleeping workers.
+//------------------------------------------------------------------------------
+inline void ThreadPool::Wake(std::size_t count) {
+  std::size_t sleepers = sleepers_.load();
+  if (sleepers == 0)
+    return;
+  { std::unique_lock<std::mutex> lock(mtx_); }
+  if (count >= sleepers) {
+    cond_.notify_all();
+    return;
+  }
+  for (std::size_t i = 0; i < count; i++)
+    cond_.notify_one();
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take a task, lane by lane. a lane which was skipped too many times
+//        while it had tasks goes first.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::Pop(std::size_t index, Task& task) {
+  if (low_skipped_.load(std::memory_order_relaxed) >= starvation_limit_ &&
+      PopLow(task))
+    return true;
+  if (normal_skipped_.load(std::memory_order_relaxed) >= starvation_limit_ &&
+      PopNormal(index, task)) {
+    normal_skipped_.store(0, std::memory_order_relaxed);
+    Skip(low_depth_, low_skipped_);
+    return true;
+  }
+  if (high_depth_.load(std::memory_order_relaxed) > 0 && PopHigh(task)) {
+    Skip(pending_, normal_skipped_);
+    Skip(low_depth_, low_skipped_);
+    return true;
+  }
+  if (PopNormal(index, task)) {
+    if (normal_skipped_.load(std::memory_order_relaxed) != 0)
+      normal_skipped_.store(0, std::memory_order_relaxed);
+    Skip(low_depth_, low_skipped_);
+    return true;
+  }
+  return PopLow(task);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief count a pop which passed over a non-empty lane.
+//------------------------------------------------------------------------------
+inline void ThreadPool::Skip(std::atomic<std::size_t>& depth,
+                             std::atomic<std::size_t>& skipped) {
+  if (depth.load(std::memory_order_relaxed) > 0)
+    skipped.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take the task with the earliest deadline.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::PopHigh(Task& task) {
+  std::unique_lock<std::mutex> lock(lane_mtx_);
+  if (high_.empty())
+    return false;
+  std::pop_heap(high_.begin(), high_.end());
+  task = std::move(high_.back().task);
+  high_.pop_back();
+  high_depth_.fetch_sub(1);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take the oldest low priority task.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::PopLow(Task& task) {
+  if (low_depth_.load(std::memory_order_relaxed) == 0)
+    return false;
+  std::unique_lock<std::mutex> lock(lane_mtx_);
+  if (low_.empty())
+    return false;
+  task = std::move(low_.front());
+  low_.pop_front();
+  low_depth_.fetch_sub(1);
+  low_skipped_.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take a task of the normal lane. own queue first, then steal.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::PopNormal(std::size_t index, Task& task) {
+  if (node_depth_.load(std::memory_order_relaxed) > 0 &&
+      PopFront(*node_queues_[worker_node_[index]], task)) {
+    node_depth_.fetch_sub(1);
+    return true;
+  }
+  if (PopQueues(index, task))
+    return true;
+  return PopNode(index, task);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take a task from the queues of the scheduling mode.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::PopQueues(std::size_t index, Task& task) {
+  if (scheduling_ == Scheduling::kSharedQueue)
+    return PopFront(*queues_[0], task);
+  if (scheduling_ == Scheduling::kLockFree) {
+    if (ring_->TryPop(task)) {
+      pending_.fetch_sub(1);
+      return true;
+    }
+    if (overflow_.load(std::memory_order_relaxed) == 0)
+      return false;
+    if (!PopFront(*queues_[0], task))
+      return false;
+    overflow_.fetch_sub(1);
+    return true;
+  }
+  {
+    auto& q = *queues_[index];
+    std::unique_lock<std::mutex> lock(q.mtx);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+      pending_.fetch_sub(1);
+      return true;
+    }
+  }
+  return Steal(index, task);
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take a task queued for another numa node.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::PopNode(std::size_t index, Task& task) {
+  if (node_depth_.load(std::memory_order_relaxed) == 0)
+    return false;
+  const std::size_t n = node_queues_.size();
+  const std::size_t own = worker_node_[index];
+  for (std::size_t i = 1; i < n; i++) {
+    if (PopFront(*node_queues_[(own + i) % n], task)) {
+      node_depth_.fetch_sub(1);
+      CountSteal(index);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief take the oldest task of a queue.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::PopFront(WorkQueue& q, Task& task) {
+  std::unique_lock<std::mutex> lock(q.mtx);
+  if (q.tasks.empty())
+    return false;
+  task = std::move(q.tasks.front());
+  q.tasks.pop_front();
+  pending_.fetch_sub(1);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief steal a task from the front of other workers' deques.
+//------------------------------------------------------------------------------
+inline bool ThreadPool::Steal(std::size_t index, Task& task) {
+  const std::size_t n = queues_.size();
+  // victims on the same numa node first, then the others.
+  for (int pass = 0; pass < 2; pass++) {
+    for (std::size_t i = 1; i < n; i++) {
+      std::size_t victim = (index + i) % n;
+      bool local = (worker_node_[victim] == worker_node_[index]);
+      if (local != (pass == 0))
+        continue;
+      auto& q = *queues_[victim];
+      // don't wait behind the owner. try the next victim instead.
+      std::unique_lock<std::mutex> lock(q.mtx, std::try_to_lock);
+      if (!lock.owns_lock() || q.tasks.empty())
+        continue;
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      pending_.fetch_sub(1);
+      CountSteal(index);
+      return true;
+    }
+    if (node_queues_.empty())
+      break;
+  }
+  return false;
 }
 
 
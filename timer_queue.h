@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// @file  timer_queue.h
+//------------------------------------------------------------------------------
+// @brief run callbacks at a point in time on one background thread.
+//------------------------------------------------------------------------------
+// callbacks run on the timer thread one after another, so they should be
+// short. hand longer work to a pool from there.
+// @code
+// cu::TimerQueue timers;
+// timers.ScheduleAfter(std::chrono::milliseconds(50),
+//                      [&pool] { pool.Post(Flush); });
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_TIMER_QUEUE_H_
+#define CPPUTIL_TIMER_QUEUE_H_
+#include <algorithm>           // for std::push_heap
+#include <chrono>              // for std::chrono::steady_clock
+#include <condition_variable>  // for std::condition_variable
+#include <mutex>               // for std::mutex
+#include <thread>              // for std::thread
+#include <vector>              // for std::vector
+#include "unique_task.h"       // for cu::UniqueTask
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class TimerQueue
+//------------------------------------------------------------------------------
+// min-heap of callbacks on their due time. the thread sleeps until the
+// earliest one is due. callbacks with the same due time run in scheduling
+// order. callbacks still pending when the queue is destroyed are dropped
+// without being called.
+//------------------------------------------------------------------------------
+class TimerQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimePoint = Clock::time_point;
+
+ public:
+  TimerQueue()
+      : mtx_{}, cond_{}, timers_{}, seq_{0}, stop_{false}, thread_{} {
+    thread_ = std::thread([this]() { this->Run(); });
+  }
+
+  ~TimerQueue() {
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+
+ public:
+  TimerQueue(const TimerQueue&) = delete;
+  TimerQueue(TimerQueue&&) = delete;
+  TimerQueue& operator=(const TimerQueue&) = delete;
+  TimerQueue& operator=(TimerQueue&&) = delete;
+
+ public:
+  // queue shared by the whole process. (started on first use)
+  static TimerQueue& Default() {
+    static TimerQueue timers;
+    return timers;
+  }
+
+  void Schedule(TimePoint when, UniqueTask&& task) {
+    bool earliest;
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      timers_.push_back(Timer{when, seq_++, std::move(task)});
+      std::push_heap(timers_.begin(), timers_.end());
+      earliest = timers_.front().seq == seq_ - 1;
+    }
+    // the thread only needs to wake up when its wait got shorter.
+    if (earliest)
+      cond_.notify_one();
+  }
+
+  template <typename Rep, typename Period>
+  void ScheduleAfter(const std::chrono::duration<Rep, Period>& delay,
+                     UniqueTask&& task) {
+    Schedule(Clock::now() + std::chrono::duration_cast<Clock::duration>(delay),
+             std::move(task));
+  }
+
+  std::size_t size() const {
+    std::unique_lock<std::mutex> lock(mtx_);
+    return timers_.size();
+  }
+
+ private:
+  // (min-heap on due time, then scheduling order)
+  struct Timer {
+    TimePoint when;
+    std::size_t seq;
+    UniqueTask task;
+    bool operator<(const Timer& other) const {
+      if (when != other.when)
+        return when > other.when;
+      return seq > other.seq;
+    }
+  };
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (!stop_) {
+      if (timers_.empty()) {
+        cond_.wait(lock);
+        continue;
+      }
+      TimePoint when = timers_.front().when;
+      if (Clock::now() < when) {
+        cond_.wait_until(lock, when);
+        continue;
+      }
+      std::pop_heap(timers_.begin(), timers_.end());
+      UniqueTask task = std::move(timers_.back().task);
+      timers_.pop_back();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+ private:
+  mutable std::mutex mtx_;
+  std::condition_variable cond_;
+  std::vector<Timer> timers_;
+  std::size_t seq_;
+  bool stop_;
+  std::thread thread_;
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_TIMER_QUEUE_H_
@@ -0,0 +1,514 @@
+//------------------------------------------------------------------------------
+// @file  trace.h
+//------------------------------------------------------------------------------
+// @brief scoped trace spans written into per-thread rings, exported as chrome
+//        trace-event json. (chrome://tracing, ui.perfetto.dev)
+//------------------------------------------------------------------------------
+// while tracing is off a span costs one load of a global flag and a branch,
+// so spans can stay compiled into production builds. while it is on a span
+// reads the tsc twice and writes one event into the ring of its thread:
+// single writer, no lock, the oldest events are overwritten when it is full.
+// the rings are read when the trace is exported, from any thread.
+// ThreadPool records every task: an 'enqueue' slice on the pushing thread, a
+// 'task' slice on the worker that ran it, and a flow arrow between the two.
+// @code
+// cu::Tracer::Enable();
+// {
+//   cu::TraceSpan span("parse");  // a literal: only the pointer is kept
+//   Parse(line);
+// }
+// cu::Tracer::Disable();
+// cu::Tracer::WriteChromeJson("trace.json");
+// @endcode
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_TRACE_H_
+#define CPPUTIL_TRACE_H_
+#include <unistd.h>       // for getpid
+#include <algorithm>      // for std::sort, std::max
+#include <atomic>         // for std::atomic
+#include <cerrno>         // for errno
+#include <cstdint>        // for std::int64_t, std::uint64_t, std::uint32_t
+#include <cstdio>         // for std::snprintf, std::fopen
+#include <cstring>        // for std::strerror
+#include <map>            // for std::map
+#include <memory>         // for std::unique_ptr
+#include <mutex>          // for std::mutex
+#include <string>         // for std::string
+#include <vector>         // for std::vector
+#include "exception.h"    // for cu::SystemError
+#include "tsc_clock.h"    // for cu::TscClock
+
+
+namespace cu {
+namespace detail {
+
+
+enum class TraceKind : std::uint32_t {
+  kSpan,     // a slice
+  kInstant,  // a point in time
+  kEnqueue,  // a pool task pushed. (id: flow id)
+  kTask,     // a pool task run. (id: flow id)
+};
+
+// an event as read out of a ring. (ts and dur in TscClock ticks)
+struct TraceEvent {
+  std::int64_t ts;
+  std::int64_t dur;
+  std::int64_t id;
+  const char* name;
+  TraceKind kind;
+  std::uint32_t tid;
+};
+
+// process wide state. (a template, so the header can define it)
+template <typename T = void>
+struct TraceGlobals {
+  static std::atomic<bool> enabled;
+  static std::atomic<std::int64_t> last_flow;
+};
+
+template <typename T>
+std::atomic<bool> TraceGlobals<T>::enabled{false};
+
+template <typename T>
+std::atomic<std::int64_t> TraceGlobals<T>::last_flow{0};
+
+
+//------------------------------------------------------------------------------
+// @class TraceBuffer
+//------------------------------------------------------------------------------
+// ring of events written by one thread. slots are relaxed atomics, so a
+// reader may copy them while they are written; Read() drops the slots the
+// writer came back to in the meantime.
+//------------------------------------------------------------------------------
+class TraceBuffer {
+ public:
+  explicit TraceBuffer(std::size_t capacity)
+      : slots_{new Slot[capacity]}, mask_{capacity - 1}, head_{0}, tail_{0},
+        tid_{0} { }
+
+  TraceBuffer(const TraceBuffer&) = delete;
+  TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+ public:
+  // (owning thread only)
+  void Add(TraceKind kind, const char* name, std::int64_t ts,
+           std::int64_t dur, std::int64_t id) {
+    const std::uint64_t h = head_.load(std::memory_order_relaxed);
+    // keeps the previous head_ store ahead of the slot stores. (see Read)
+    std::atomic_thread_fence(std::memory_order_release);
+    Slot& s = slots_[h & mask_];
+    s.ts.store(ts, std::memory_order_relaxed);
+    s.dur.store(dur, std::memory_order_relaxed);
+    s.id.store(id, std::memory_order_relaxed);
+    s.name.store(name, std::memory_order_relaxed);
+    s.meta.store(static_cast<std::uint64_t>(kind) << 32 | tid_,
+                 std::memory_order_relaxed);
+    head_.store(h + 1, std::memory_order_release);
+  }
+
+  // appends the events in the ring to 'out'.
+  void Read(std::vector<TraceEvent>* out) const {
+    const std::uint64_t capacity = mask_ + 1;
+    const std::uint64_t end = head_.load(std::memory_order_acquire);
+    const std::uint64_t begin = std::max(
+        tail_.load(std::memory_order_relaxed),
+        end > capacity ? end - capacity : 0);
+    const std::size_t first = out->size();
+    for (std::uint64_t i = begin; i < end; i++) {
+      const Slot& s = slots_[i & mask_];
+      const std::uint64_t meta = s.meta.load(std::memory_order_relaxed);
+      out->push_back(TraceEvent{
+          s.ts.load(std::memory_order_relaxed),
+          s.dur.load(std::memory_order_relaxed),
+          s.id.load(std::memory_order_relaxed),
+          s.name.load(std::memory_order_relaxed),
+          static_cast<TraceKind>(meta >> 32),
+          static_cast<std::uint32_t>(meta)});
+    }
+    // event 'now' may be half written, over event 'now - capacity'.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const std::uint64_t now = head_.load(std::memory_order_relaxed);
+    if (now + 1 > begin + capacity) {
+      std::size_t torn = static_cast<std::size_t>(
+          std::min(now + 1 - capacity - begin, end - begin));
+      out->erase(out->begin() + first, out->begin() + first + torn);
+    }
+  }
+
+  // forgets the events written so far. (any thread)
+  void Clear() {
+    tail_.store(head_.load(std::memory_order_acquire),
+                std::memory_order_relaxed);
+  }
+
+  std::uint32_t tid() const { return tid_; }
+
+  // (only while no thread owns the buffer)
+  void set_tid(std::uint32_t tid) { tid_ = tid; }
+
+ private:
+  struct Slot {
+    std::atomic<std::int64_t> ts;
+    std::atomic<std::int64_t> dur;
+    std::atomic<std::int64_t> id;
+    std::atomic<const char*> name;
+    std::atomic<std::uint64_t> meta;  // kind << 32 | tid
+  };
+
+ private:
+  std::unique_ptr<Slot[]> slots_;
+  const std::uint64_t mask_;
+  std::atomic<std::uint64_t> head_;  // next event
+  std::atomic<std::uint64_t> tail_;  // first event not cleared
+  std::uint32_t tid_;
+};
+
+
+//------------------------------------------------------------------------------
+// @class TraceRegistry
+//------------------------------------------------------------------------------
+// every ring ever made, and the thread names. a thread takes a ring on its
+// first event and gives it back when it exits; the ring keeps its events
+// and is handed to the next new thread. tids are never reused.
+// (never destroyed, threads may still trace while static objects go away)
+//------------------------------------------------------------------------------
+class TraceRegistry {
+ public:
+  static TraceRegistry& Get() {
+    static TraceRegistry* registry = new TraceRegistry;
+    return *registry;
+  }
+
+  TraceBuffer* Acquire(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TraceBuffer* b;
+    if (free_.empty()) {
+      buffers_.emplace_back(new TraceBuffer(capacity_));
+      b = buffers_.back().get();
+    } else {
+      b = free_.back();
+      free_.pop_back();
+    }
+    b->set_tid(++last_tid_);
+    if (!name.empty())
+      names_[last_tid_] = name;
+    return b;
+  }
+
+  void Release(TraceBuffer* b) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(b);
+  }
+
+  void Name(std::uint32_t tid, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    names_[tid] = name;
+  }
+
+  // capacity of rings made from now on. (a power of two, at least 2)
+  void set_capacity(std::size_t events) {
+    std::size_t capacity = 2;
+    while (capacity < events)
+      capacity <<= 1;
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+  }
+
+  std::vector<TraceEvent> Read(
+      std::map<std::uint32_t, std::string>* names) const {
+    std::vector<TraceEvent> events;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& b : buffers_)
+      b->Read(&events);
+    *names = names_;
+    return events;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& b : buffers_)
+      b->Clear();
+  }
+
+ private:
+  TraceRegistry() : capacity_{std::size_t(1) << 15}, last_tid_{0} { }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+  std::vector<TraceBuffer*> free_;
+  std::map<std::uint32_t, std::string> names_;
+  std::size_t capacity_;
+  std::uint32_t last_tid_;
+};
+
+// the ring of the calling thread. (taken on its first event)
+struct TraceThread {
+  TraceBuffer* buffer = nullptr;
+  std::string name;
+
+  ~TraceThread() {
+    if (buffer)
+      TraceRegistry::Get().Release(buffer);
+  }
+};
+
+inline TraceThread& CurrentTraceThread() {
+  static thread_local TraceThread thread;
+  return thread;
+}
+
+inline void TraceRecord(TraceKind kind, const char* name, std::int64_t ts,
+                        std::int64_t dur, std::int64_t id) {
+  TraceThread& t = CurrentTraceThread();
+  if (t.buffer == nullptr)
+    t.buffer = TraceRegistry::Get().Acquire(t.name);
+  t.buffer->Add(kind, name, ts, dur, id);
+}
+
+// records the enqueue of a pool task at about 'ns' (ns on any clock), and
+// returns its flow id: 'ns', raised just enough to be unique.
+inline std::int64_t TraceEnqueue(std::int64_t ns) {
+  std::atomic<std::int64_t>& last = TraceGlobals<>::last_flow;
+  std::int64_t prev = last.load(std::memory_order_relaxed);
+  std::int64_t id;
+  do {
+    id = ns > prev ? ns : prev + 1;
+  } while (!last.compare_exchange_weak(prev, id, std::memory_order_relaxed));
+  TraceRecord(TraceKind::kEnqueue, "enqueue", TscClock::now(), 0, id);
+  return id;
+}
+
+// json string literal.
+inline void AppendJsonString(std::string* out, const char* s) {
+  out->push_back('"');
+  for (; *s; s++) {
+    const unsigned char c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(*s);
+    } else if (c < 0x20) {
+      char esc[8];
+      std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out->append(esc);
+    } else {
+      out->push_back(*s);
+    }
+  }
+  out->push_back('"');
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @class Tracer
+// @brief switches tracing on and off, and exports what was recorded.
+//------------------------------------------------------------------------------
+class Tracer {
+ public:
+  static bool enabled() {
+    return detail::TraceGlobals<>::enabled.load(std::memory_order_relaxed);
+  }
+
+  static void Enable() {
+    TscClock::invariant();  // calibrate here, not inside the first span
+    detail::TraceGlobals<>::enabled.store(true, std::memory_order_relaxed);
+  }
+
+  static void Disable() {
+    detail::TraceGlobals<>::enabled.store(false, std::memory_order_relaxed);
+  }
+
+  // drops every event recorded so far.
+  static void Clear() {
+    detail::TraceRegistry::Get().Clear();
+  }
+
+  // events kept per thread, for threads tracing for the first time.
+  // (rounded up to a power of two, 32768 by default: ~1.3MB per thread)
+  static void set_buffer_size(std::size_t events) {
+    detail::TraceRegistry::Get().set_capacity(events);
+  }
+
+  // name of the calling thread in the trace.
+  static void SetThreadName(const std::string& name) {
+    detail::TraceThread& t = detail::CurrentTraceThread();
+    t.name = name;
+    if (t.buffer)
+      detail::TraceRegistry::Get().Name(t.buffer->tid(), name);
+  }
+
+  // the trace as chrome trace-event json. (best taken once tracing is
+  // disabled: events written meanwhile may be missed)
+  static std::string ToChromeJson();
+
+  // throws SystemError if the file can't be written.
+  static void WriteChromeJson(const std::string& path);
+};
+
+
+//------------------------------------------------------------------------------
+// @class TraceSpan
+// @brief a slice from construction to destruction, named by a string that
+//        outlives the trace. (usually a literal)
+//------------------------------------------------------------------------------
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name)
+      : name_{name}, start_{Tracer::enabled() ? TscClock::now() : 0} { }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  ~TraceSpan() {
+    if (start_ != 0) {
+      detail::TraceRecord(detail::TraceKind::kSpan, name_, start_,
+                          TscClock::now() - start_, 0);
+    }
+  }
+
+ private:
+  const char* name_;
+  TscClock::tick start_;  // 0 while tracing is off
+};
+
+
+// a point in time.
+inline void TraceInstant(const char* name) {
+  if (Tracer::enabled())
+    detail::TraceRecord(detail::TraceKind::kInstant, name, TscClock::now(),
+                        0, 0);
+}
+
+
+namespace detail {
+
+// the run of a pool task. (see TraceEnqueue)
+class TraceTaskScope {
+ public:
+  explicit TraceTaskScope(std::int64_t id)
+      : id_{id}, start_{Tracer::enabled() ? TscClock::now() : 0} { }
+
+  TraceTaskScope(const TraceTaskScope&) = delete;
+  TraceTaskScope& operator=(const TraceTaskScope&) = delete;
+
+  ~TraceTaskScope() {
+    if (start_ != 0)
+      TraceRecord(TraceKind::kTask, "task", start_, TscClock::now() - start_,
+                  id_);
+  }
+
+ private:
+  std::int64_t id_;
+  TscClock::tick start_;
+};
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @brief the trace as chrome trace-event json.
+//------------------------------------------------------------------------------
+inline std::string Tracer::ToChromeJson() {
+  using detail::TraceEvent;
+  using detail::TraceKind;
+  std::map<std::uint32_t, std::string> names;
+  std::vector<TraceEvent> events = detail::TraceRegistry::Get().Read(&names);
+  std::sort(events.begin(), events.end(),
+            [](const TraceEvent& a, const TraceEvent& b) {
+              return a.ts < b.ts;
+            });
+  const std::int64_t base = events.empty() ? 0 : events.front().ts;
+  const int pid = static_cast<int>(::getpid());
+
+  std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  char buf[160];
+  auto open = [&](const char* name) {
+    out += first ? "\n{\"name\":" : ",\n{\"name\":";
+    first = false;
+    detail::AppendJsonString(&out, name);
+  };
+  // ',"ph":...,"ts":...,"pid":...,"tid":...' (ts in us)
+  auto common = [&](const char* ph, std::int64_t ts, std::uint32_t tid) {
+    std::snprintf(buf, sizeof(buf),
+                  ",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u", ph,
+                  TscClock::to_nsec(ts - base) / 1e3, pid, tid);
+    out += buf;
+  };
+  auto flow = [&](std::int64_t id) {
+    std::snprintf(buf, sizeof(buf), ",\"id\":\"0x%llx\"",
+                  static_cast<unsigned long long>(id));
+    out += buf;
+  };
+
+  for (const auto& n : names) {
+    open("thread_name");
+    std::snprintf(buf, sizeof(buf), ",\"ph\":\"M\",\"pid\":%d,\"tid\":%u",
+                  pid, n.first);
+    out += buf;
+    out += ",\"args\":{\"name\":";
+    detail::AppendJsonString(&out, n.second.c_str());
+    out += "}}";
+  }
+  for (const TraceEvent& e : events) {
+    switch (e.kind) {
+      case TraceKind::kSpan:
+      case TraceKind::kEnqueue:
+      case TraceKind::kTask:
+        open(e.name);
+        out += e.kind == TraceKind::kSpan ? ",\"cat\":\"span\""
+                                          : ",\"cat\":\"pool\"";
+        common("X", e.ts, e.tid);
+        std::snprintf(buf, sizeof(buf), ",\"dur\":%.3f}",
+                      TscClock::to_nsec(e.dur) / 1e3);
+        out += buf;
+        break;
+      case TraceKind::kInstant:
+        open(e.name);
+        out += ",\"cat\":\"instant\",\"s\":\"t\"";
+        common("i", e.ts, e.tid);
+        out += "}";
+        break;
+    }
+    // the arrow from the enqueue to the run of a task.
+    if (e.kind == TraceKind::kEnqueue) {
+      open("task");
+      out += ",\"cat\":\"pool\"";
+      common("s", e.ts, e.tid);
+      flow(e.id);
+      out += "}";
+    } else if (e.kind == TraceKind::kTask && e.id != 0) {
+      open("task");
+      out += ",\"cat\":\"pool\",\"bp\":\"e\"";
+      common("f", e.ts, e.tid);
+      flow(e.id);
+      out += "}";
+    }
+  }
+  out += "\n]}\n";
+  return out;
+}
+
+
+//------------------------------------------------------------------------------
+// @brief write the trace to a file.
+//------------------------------------------------------------------------------
+inline void Tracer::WriteChromeJson(const std::string& path) {
+  const std::string json = ToChromeJson();
+  std::FILE* f = std::fopen(path.c_str(), "w");
+  if (f == nullptr)
+    throw SystemError("Tracer: " + path + ": " + std::strerror(errno));
+  const bool ok = std::fwrite(json.data(), 1, json.size(), f) == json.size();
+  const int saved = errno;
+  if (std::fclose(f) != 0 || !ok)
+    throw SystemError("Tracer: " + path + ": " +
+                      std::strerror(ok ? errno : saved));
+}
+
+
+}  // namespace cu
+#endif  // CPPUTIL_TRACE_H_
@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+// @file  tsc_clock.h
+//------------------------------------------------------------------------------
+// @brief clock policies for BasicStopwatch: std::chrono clocks, and the cpu's
+//        time stamp counter (rdtsc / rdtscp), calibrated once.
+//------------------------------------------------------------------------------
+// a policy has a tick type, now() returning ticks, and to_nsec() turning a
+// difference of ticks into nanoseconds. the conversion is only done when a
+// stopwatch is read, so now() of the tsc clocks is a single instruction.
+// the tsc is used only when the cpu says it is invariant (constant rate in
+// every power state, in sync across cores). it is then calibrated against
+// steady_clock on first use, which takes ~10 ms. without it (or off x86) the
+// tsc clocks read steady_clock instead.
+// rdtsc may be executed before earlier instructions are done, rdtscp waits
+// for them. (better for timing very short code, a few cycles more)
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_TSC_CLOCK_H_
+#define CPPUTIL_TSC_CLOCK_H_
+#include <chrono>   // for std::chrono::steady_clock
+#include <cstdint>  // for std::int64_t, std::uint64_t
+#include <limits>   // for std::numeric_limits
+#include <thread>   // for std::this_thread::sleep_for
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPPUTIL_HAS_TSC 1
+#include <cpuid.h>        // for __get_cpuid
+#include <x86intrin.h>    // for __rdtsc, __rdtscp
+#endif
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @struct ChronoClock<C>
+// @brief a std::chrono clock as a policy. (ticks are nanoseconds)
+//------------------------------------------------------------------------------
+template <typename C>
+struct ChronoClock {
+  using tick = std::int64_t;
+
+  static tick now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        C::now().time_since_epoch()).count();
+  }
+
+  static double to_nsec(tick t) {
+    return static_cast<double>(t);
+  }
+};
+
+
+namespace detail {
+
+
+inline bool CpuHasInvariantTsc() {
+#if defined(CPPUTIL_HAS_TSC)
+  unsigned a, b, c, d;
+  if (!__get_cpuid(0x80000000u, &a, &b, &c, &d) || a < 0x80000007u)
+    return false;
+  __get_cpuid(0x80000007u, &a, &b, &c, &d);
+  return (d >> 8) & 1;
+#else
+  return false;
+#endif
+}
+
+inline std::int64_t SteadyNanos() {
+  return ChronoClock<std::chrono::steady_clock>::now();
+}
+
+inline std::int64_t ReadTsc() {
+#if defined(CPPUTIL_HAS_TSC)
+  return static_cast<std::int64_t>(__rdtsc());
+#else
+  return SteadyNanos();
+#endif
+}
+
+inline std::int64_t ReadTscp() {
+#if defined(CPPUTIL_HAS_TSC)
+  unsigned aux;
+  return static_cast<std::int64_t>(__rdtscp(&aux));
+#else
+  return SteadyNanos();
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// @struct TscCalibration
+//------------------------------------------------------------------------------
+struct TscCalibration {
+  bool invariant;      // the tsc is used at all
+  double ns_per_tick;  // 1 when it is not
+
+  // a (tsc, steady_clock) pair: the tightest of a few tsc reads around one
+  // clock read, taking the tsc halfway between them.
+  static void Sample(std::int64_t* tsc, std::int64_t* ns) {
+    std::int64_t best = std::numeric_limits<std::int64_t>::max();
+    for (int i = 0; i < 8; i++) {
+      std::int64_t t0 = ReadTscp();
+      std::int64_t n = SteadyNanos();
+      std::int64_t t1 = ReadTscp();
+      if (t1 - t0 < best) {
+        best = t1 - t0;
+        *tsc = t0 + (t1 - t0) / 2;
+        *ns = n;
+      }
+    }
+  }
+
+  static TscCalibration Calibrate() {
+    TscCalibration c{CpuHasInvariantTsc(), 1.0};
+    if (!c.invariant)
+      return c;
+    std::int64_t t0 = 0, n0 = 0, t1 = 0, n1 = 0;
+    Sample(&t0, &n0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Sample(&t1, &n1);
+    if (t1 <= t0 || n1 <= n0) {
+      c.invariant = false;
+      return c;
+    }
+    c.ns_per_tick = static_cast<double>(n1 - n0) / (t1 - t0);
+    return c;
+  }
+};
+
+// calibrated on first use. (thread safe)
+inline const TscCalibration& Tsc() {
+  static const TscCalibration calibration = TscCalibration::Calibrate();
+  return calibration;
+}
+
+
+}  // namespace detail
+
+
+//------------------------------------------------------------------------------
+// @struct TscClock
+// @brief rdtsc ticks. (steady_clock ns without an invariant tsc)
+//------------------------------------------------------------------------------
+struct TscClock {
+  using tick = std::int64_t;
+
+  static tick now() {
+    return detail::Tsc().invariant ? detail::ReadTsc() : detail::SteadyNanos();
+  }
+
+  static double to_nsec(tick t) {
+    return t * detail::Tsc().ns_per_tick;
+  }
+
+  // false if the tsc clocks fall back to steady_clock.
+  static bool invariant() {
+    return detail::Tsc().invariant;
+  }
+
+  // ticks per second. (1e9 on the fallback)
+  static double frequency() {
+    return 1e9 / detail::Tsc().ns_per_tick;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+// @struct TscpClock
+// @brief rdtscp ticks, read after the preceding instructions completed.
+//------------------------------------------------------------------------------
+struct TscpClock {
+  using tick = std::int64_t;
+
+  static tick now() {
+    return detail::Tsc().invariant ? detail::ReadTscp() : detail::SteadyNanos();
+  }
+
+  static double to_nsec(tick t) {
+    return TscClock::to_nsec(t);
+  }
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_TSC_CLOCK_H_
@@ -0,0 +1,171 @@
+//------------------------------------------------------------------------------
+// @file  unique_task.h
+//------------------------------------------------------------------------------
+// @brief move-only 'void()' callable with inline (small-buffer) storage.
+//------------------------------------------------------------------------------
+#ifndef CPPUTIL_UNIQUE_TASK_H_
+#define CPPUTIL_UNIQUE_TASK_H_
+#include <cstddef>      // for std::max_align_t
+#include <new>          // for placement new
+#include <type_traits>  // for std::aligned_storage
+#include <utility>      // for std::move
+#include "object_pool.h"  // for cu::ObjectPool
+
+
+namespace cu {
+
+
+//------------------------------------------------------------------------------
+// @class UniqueTask
+//------------------------------------------------------------------------------
+// unlike std::function, it accepts move-only callables and keeps callables up
+// to kInlineSize bytes inside the object, so wrapping a small lambda or a
+// std::bind object doesn't touch the heap. larger callables are boxed in an
+// ObjectPool.
+// @code
+// UniqueTask t([x]() { std::cout << x; });
+// t();
+// @endcode
+//------------------------------------------------------------------------------
+class UniqueTask {
+ public:
+  static constexpr std::size_t kInlineSize = 6 * sizeof(void*);
+
+ public:
+  UniqueTask() noexcept : ops_{nullptr} { }
+
+  template <typename F,
+            typename = typename std::enable_if<
+              !std::is_same<typename std::decay<F>::type,
+                            UniqueTask>::value>::type>
+  UniqueTask(F&& f) : ops_{nullptr} {  // NOLINT (implicit by design)
+    using Func = typename std::decay<F>::type;
+    using Impl = typename std::conditional<IsInline<Func>::value,
+                                           InlineImpl<Func>,
+                                           HeapImpl<Func>>::type;
+    Impl::Create(&storage_, std::forward<F>(f));
+    ops_ = &Impl::ops;
+  }
+
+  UniqueTask(UniqueTask&& other) noexcept : ops_{other.ops_} {
+    if (ops_) {
+      ops_->move(&storage_, &other.storage_);
+      other.ops_ = nullptr;
+    }
+  }
+
+  UniqueTask& operator=(UniqueTask&& other) noexcept {
+    if (this != &other) {
+      reset();
+      if (other.ops_) {
+        other.ops_->move(&storage_, &other.storage_);
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  UniqueTask(const UniqueTask&) = delete;
+  UniqueTask& operator=(const UniqueTask&) = delete;
+
+  ~UniqueTask() {
+    reset();
+  }
+
+ public:
+  void operator()() {
+    ops_->invoke(&storage_);
+  }
+
+  explicit operator bool() const noexcept {
+    return ops_ != nullptr;
+  }
+
+  void reset() noexcept {
+    if (ops_) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  using Storage = typename std::aligned_storage<
+    kInlineSize, alignof(std::max_align_t)>::type;
+
+  struct Ops {
+    void (*invoke)(void*);
+    void (*move)(void* dst, void* src);  // move-construct dst, destroy src
+    void (*destroy)(void*);
+  };
+
+  template <typename F>
+  struct IsInline {
+    static constexpr bool value =
+        (sizeof(F) <= sizeof(Storage)) &&
+        (alignof(Storage) % alignof(F) == 0) &&
+        std::is_nothrow_move_constructible<F>::value;
+  };
+
+  // callable lives in storage_.
+  template <typename F>
+  struct InlineImpl {
+    template <typename G>
+    static void Create(void* p, G&& g) {
+      new (p) F(std::forward<G>(g));
+    }
+    static void Invoke(void* p) {
+      (*static_cast<F*>(p))();
+    }
+    static void Move(void* dst, void* src) {
+      new (dst) F(std::move(*static_cast<F*>(src)));
+      static_cast<F*>(src)->~F();
+    }
+    static void Destroy(void* p) {
+      static_cast<F*>(p)->~F();
+    }
+    static const Ops ops;
+  };
+
+  // storage_ holds a pointer to the boxed callable. (from ObjectPool<F>)
+  template <typename F>
+  struct HeapImpl {
+    template <typename G>
+    static void Create(void* p, G&& g) {
+      *static_cast<F**>(p) = ObjectPool<F>::New(std::forward<G>(g));
+    }
+    static void Invoke(void* p) {
+      (**static_cast<F**>(p))();
+    }
+    static void Move(void* dst, void* src) {
+      *static_cast<F**>(dst) = *static_cast<F**>(src);
+    }
+    static void Destroy(void* p) {
+      ObjectPool<F>::Delete(*static_cast<F**>(p));
+    }
+    static const Ops ops;
+  };
+
+ private:
+  Storage storage_;
+  const Ops* ops_;
+};
+
+
+template <typename F>
+const UniqueTask::Ops UniqueTask::InlineImpl<F>::ops = {
+  &UniqueTask::InlineImpl<F>::Invoke,
+  &UniqueTask::InlineImpl<F>::Move,
+  &UniqueTask::InlineImpl<F>::Destroy,
+};
+
+template <typename F>
+const UniqueTask::Ops UniqueTask::HeapImpl<F>::ops = {
+  &UniqueTask::HeapImpl<F>::Invoke,
+  &UniqueTask::HeapImpl<F>::Move,
+  &UniqueTask::HeapImpl<F>::Destroy,
+};
+
+
+}  // namespace cu
+#endif  // CPPUTIL_UNIQUE_TASK_H_
@@ -6,6 +6,7 @@
 #ifndef CPPUTIL_VARIADIC_HPP__
 #define CPPUTIL_VARIADIC_HPP__
 #include <type_traits>
+#include <utility>
 #include <vector>
 #include <array>
 
@@ -29,11 +30,8 @@ struct do_in_order {
 //------------------------------------------------------------------------------
 template <typename T, typename R, typename...Args>
 inline std::vector<T> vector_cast(R&& arg1, Args&&... args) {
-  std::vector<T> result;
-  if (0 != sizeof...(args)) {
-    result = { static_cast<T>(arg1), args... };
-  }
-  return result;
+  return { static_cast<T>(std::forward<R>(arg1)),
+           static_cast<T>(std::forward<Args>(args))... };
 }
 
 